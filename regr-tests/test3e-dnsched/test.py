@@ -0,0 +1,158 @@
+# --- Revised 3-Clause BSD License ---
+# Copyright Semtech Corporation 2022. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without modification,
+# are permitted provided that the following conditions are met:
+#
+#     * Redistributions of source code must retain the above copyright notice,
+#       this list of conditions and the following disclaimer.
+#     * Redistributions in binary form must reproduce the above copyright notice,
+#       this list of conditions and the following disclaimer in the documentation
+#       and/or other materials provided with the distribution.
+#     * Neither the name of the Semtech corporation nor the names of its
+#       contributors may be used to endorse or promote products derived from this
+#       software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL SEMTECH CORPORATION. BE LIABLE FOR ANY DIRECT,
+# INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+# BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+# DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+# LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+# OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+# ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+# Replay a recorded stream of dnmsg and count frames handed to the radios.
+# Each line of the stream: {"t": <ms since first message>, "xoff": <xtime offset in us
+# relative to t - class A only>, "dnmsg": {...}} - any capture of dnmsg
+# in this form can be supplied via env DNSTREAM.
+# Class A xtimes are anchored to the start of the replay and not to the time a message
+# is actually sent, so scheduling hiccups of this script do not move their TX times.
+
+import os
+import sys
+import time
+import json
+import asyncio
+from asyncio import subprocess
+
+import logging
+logger = logging.getLogger('test3e-dnsched')
+
+import tcutils as tu
+import simutils as su
+import testutils as tstu
+
+
+station = None
+infos = None
+muxs = None
+sim = None
+
+stream_file = os.environ.get('DNSTREAM', 'dnstream.jsonl')
+result_file = os.environ.get('DNSCHED_RESULT', 'dnsched.res')
+
+
+class TestLgwSimServer(su.LgwSimServer):
+    updf_task = None
+    txcnt = 0
+
+    async def on_connected(self, lgwsim:su.LgwSim) -> None:
+        if lgwsim.unitIdx == 0:
+            self.updf_task = asyncio.ensure_future(self.send_updf())
+            muxs.xticks = lgwsim.xticks
+
+    async def on_close(self):
+        if self.updf_task:
+            self.updf_task.cancel()
+            self.updf_task = None
+        logger.debug('LGWSIM - close')
+
+    async def on_tx(self, lgwsim, pkt):
+        logger.debug('LGWSIM: TX %r' % (pkt,))
+        self.txcnt += 1
+
+    async def send_updf(self) -> None:
+        try:
+            await asyncio.sleep(1.0)
+            lgwsim = self.units[0]
+            await lgwsim.send_rx(rps=(7,125), freq=869.525, frame=su.makeDF(fcnt=0, port=1))
+            self.updf_task = None
+        except Exception as exc:
+            logger.error('send_updf failed!', exc_info=True)
+
+
+class TestMuxs(tu.Muxs):
+    ws = None
+    send_task = None
+    xtime_ext = 0
+    xticks = None
+    dntxed = 0
+
+    async def testDone(self, status):
+        global station
+        if station:
+            station.terminate()
+            await station.wait()
+            station = None
+        os._exit(status)
+
+    async def handle_updf(self, ws, msg):
+        self.ws = ws
+        self.xtime_ext = msg['upinfo']['xtime'] >> 32
+        if not self.send_task:
+            self.send_task = asyncio.ensure_future(self.replay())
+
+    async def handle_dntxed(self, ws, msg):
+        logger.debug('DNTXED %d ant#%d' % (msg['seqno'], msg['rctx']))
+        self.dntxed += 1
+
+    async def replay(self):
+        try:
+            with open(stream_file) as f:
+                stream = [json.loads(l) for l in f if l.strip()]
+            t0 = time.time()
+            x0 = self.xticks() + (self.xtime_ext<<32)
+            for seqno, rec in enumerate(stream):
+                delay = t0 + rec['t']/1e3 - time.time()
+                if delay > 0:
+                    await asyncio.sleep(delay)
+                dnmsg = rec['dnmsg']
+                dnmsg['seqno'] = seqno
+                dnmsg['MuxTime'] = time.time()
+                dnmsg['xtime'] = 0
+                if dnmsg['dC'] == 0:
+                    dnmsg['xtime'] = x0 + rec['t']*1000 + rec.get('xoff', -500000)
+                await self.ws.send(json.dumps(dnmsg))
+            await asyncio.sleep(6.0)  # all frames done with TX incl. RX2 and class C retries
+            logger.info('Replayed %d dnmsg: %d dntxed, %d TX' % (len(stream), self.dntxed, sim.txcnt))
+            with open(result_file, 'a') as f:
+                f.write('%s %d %d %d\n' % (os.environ.get('LOOKAHEAD','?'), len(stream), self.dntxed, sim.txcnt))
+            await self.testDone(0)
+        except Exception as exc:
+            logger.error('replay failed: %s', exc, exc_info=True)
+            await self.testDone(1)
+
+
+with open("tc.uri","w") as f:
+    f.write('ws://localhost:6038')
+
+async def test_start():
+    global station, infos, muxs, sim
+    infos = tu.Infos()
+    muxs = TestMuxs()
+    sim = TestLgwSimServer()
+
+    await infos.start_server()
+    await muxs.start_server()
+    await sim.start_server()
+
+    station_args = ['station','-p', '--temp', '.']
+    station = await subprocess.create_subprocess_exec(*station_args)
+
+tstu.setup_logging()
+
+asyncio.ensure_future(test_start())
+asyncio.get_event_loop().run_forever()
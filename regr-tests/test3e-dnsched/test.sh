@@ -0,0 +1,66 @@
+#!/bin/bash
+
+# --- Revised 3-Clause BSD License ---
+# Copyright Semtech Corporation 2022. All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without modification,
+# are permitted provided that the following conditions are met:
+#
+#     * Redistributions of source code must retain the above copyright notice,
+#       this list of conditions and the following disclaimer.
+#     * Redistributions in binary form must reproduce the above copyright notice,
+#       this list of conditions and the following disclaimer in the documentation
+#       and/or other materials provided with the distribution.
+#     * Neither the name of the Semtech corporation nor the names of its
+#       contributors may be used to endorse or promote products derived from this
+#       software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL SEMTECH CORPORATION. BE LIABLE FOR ANY DIRECT,
+# INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+# BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+# DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+# LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+# OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+# ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+# Replay dnmsg streams with and without TX_LOOKAHEAD and compare delivered downlinks.
+# Class C TX times still depend on when a message arrives - each mode is replayed
+# several times per stream and the medians are compared. On every stream lookahead
+# must deliver at least as many frames as greedy placement.
+#   dnstream.jsonl         38 class A + 10 class C dnmsgs over ~10s on two antennas
+#   dnstream-classc.jsonl  33 class A + 15 class C dnmsgs over ~12s on two antennas
+# Other captures can be replayed by setting DNSTREAMS to a list of files.
+. ../testlib.sh
+
+runs=${DNSCHED_RUNS:-3}
+streams=${DNSTREAMS:-"dnstream.jsonl dnstream-classc.jsonl"}
+
+function median () {
+    awk -v la=$2 '$1==la {print $3}' $1 | sort -n | awk '{v[NR]=$1} END {print v[int((NR+1)/2)]}'
+}
+
+rm -f dnsched*.res
+failed=0
+for stream in $streams; do
+    res=dnsched-$(basename $stream .jsonl).res
+    for la in false true; do
+        for run in $(seq $runs); do
+            cleanup
+            export LOOKAHEAD=$la DNSTREAM=$stream DNSCHED_RESULT=$res
+            banner "replay $stream - TX_LOOKAHEAD=$la (run $run/$runs)"
+            sed -e "s/LOOKAHEAD/$la/" station.conf.in > station.conf
+            python test.py || exit 1
+            collect_gcda _$(basename $stream .jsonl)_${la}_$run
+        done
+    done
+    # columns: lookahead dnmsgs dntxed tx
+    cat $res
+    greedy=$(median $res false)
+    planned=$(median $res true)
+    banner "$stream - delivered downlinks (median of $runs): greedy=$greedy lookahead=$planned"
+    [[ $planned -ge $greedy ]] || failed=1
+done
+exit $failed
@@ -39,6 +39,9 @@
 #include <time.h>
 #include <sys/wait.h>
 #include <wordexp.h>
+#if !defined(CFG_no_ral_shm)
+#include <sys/eventfd.h>
+#endif
 
 #include "timesync.h"
 #include "tc.h"
@@ -47,6 +50,7 @@
 #include "sx130xconf.h"
 #include "ral.h"
 #include "ralsub.h"
+#include "metrics.h"
 
 
 #define WAIT_SLAVE_PID_INTV rt_millis(500)
@@ -67,6 +71,11 @@ typedef struct slave {
     dbuf_t     sx1301confJson;
     chdefl_t   upchs;
     int        last_expcmd;
+#if !defined(CFG_no_ral_shm)
+    struct ral_shm* shm;      // NULL if talking through pipes
+    aio_t*     evup;          // eventfd - slave has published messages
+    aio_t*     evdn;          // eventfd - master has published messages
+#endif
     // Read Spill Buffer
     struct {
         u1_t buf[PIPE_BUF];
@@ -79,11 +88,101 @@ static int    n_slaves;
 static slave_t* slaves;
 static pid_t    master_pid;
 static u4_t     region;
+static u1_t     rxpending;  // rxjobs added but not yet flushed
 
 
 // Fwd decl
 static void restart_slave (tmr_t* tmr);
 
+// Size of next message from slave - 0 if unexpected.
+// For variable sized messages this may first return the size of the header only.
+static int slave_msgsize (slave_t* slave, struct ral_header* hdr, int dlen, int expcmd) {
+    int cmd = hdr->cmd;
+    if( cmd == RAL_CMD_RXBATCH ) {
+        if( dlen < sizeof(struct ral_rxbatch_resp) )
+            return sizeof(struct ral_rxbatch_resp);
+        int len = ((struct ral_rxbatch_resp*)hdr)->len;
+        return len < sizeof(struct ral_rxbatch_resp) || len > RAL_RXBATCH_MAX ? 0 : len;
+    }
+    if( (expcmd >= 0 && cmd == expcmd) || (slave->last_expcmd >= 0 && cmd == slave->last_expcmd) )
+        return sizeof(struct ral_response);
+    if( cmd == RAL_CMD_TIMESYNC )
+        return sizeof(struct ral_timesync_resp);
+    if( cmd == RAL_CMD_RX )
+        return sizeof(struct ral_rx_resp);
+    return 0;
+}
+
+// Queue one RX frame - rxjobs are flushed once per batch of messages by flush_rxjobs
+static void add_rxframe (int slave_idx, sL_t rctx, rps_t rps, u4_t freq, sL_t xtime, u1_t rssi, s1_t snr, u1_t* rxdata, int rxlen) {
+    rxjob_t* rxjob = !TC ? NULL : s2e_nextRxjob(&TC->s2ctx);
+    if( rxjob == NULL ) {
+        LOG(MOD_RAL|ERROR, "Slave (%d) has RX frame dropped - out of space", slave_idx);
+        metric_inc(MET_RX_DROPPED);
+        return;
+    }
+    memcpy(&TC->s2ctx.rxq.rxdata[rxjob->off], rxdata, rxlen);
+    rxjob->len = rxlen;
+    rxjob->freq = freq;
+    rxjob->rctx = rctx;
+    rxjob->xtime = xtime;
+    rxjob->rssi = rssi;
+    rxjob->snr = snr;
+    rxjob->dr = s2e_rps2dr(&TC->s2ctx, rps);
+    if( rxjob->dr == DR_ILLEGAL ) {
+        LOG(MOD_RAL|ERROR, "Unable to map to an up DR: %R", rps);
+        metric_inc(MET_RX_DROPPED);
+        return;
+    }
+    s2e_addRxjob(&TC->s2ctx, rxjob);
+    rxpending = 1;
+}
+
+static void flush_rxjobs () {
+    if( rxpending && TC )
+        s2e_flushRxjobs(&TC->s2ctx);
+    rxpending = 0;
+}
+
+// Process one complete message from slave - returns 1 if it was the expected response
+static int handle_slave_msg (slave_t* slave, struct ral_header* hdr, int dlen, int* expcmd, struct ral_response* expresp) {
+    u1_t slave_idx = (int)(slave-slaves);
+    if( *expcmd >= 0 && hdr->cmd == *expcmd ) {
+        *expresp = *(struct ral_response*)hdr;
+        slave->last_expcmd = *expcmd = -1;
+        return 1;
+    }
+    if( slave->last_expcmd >= 0 && hdr->cmd == slave->last_expcmd ) {
+        LOG(MOD_RAL|WARNING, "Slave (%d) responded to expired synchronous cmd: %d. Ignoring.", slave_idx, hdr->cmd);
+        slave->last_expcmd = -1;
+        return 0;
+    }
+    if( hdr->cmd == RAL_CMD_TIMESYNC ) {
+        struct ral_timesync_resp* resp = (struct ral_timesync_resp*)hdr;
+        ustime_t delay = ts_updateTimesync(slave_idx, resp->quality, &resp->timesync);
+        rt_setTimer(&slave->tsync, rt_micros_ahead(delay));
+        return 0;
+    }
+    if( hdr->cmd == RAL_CMD_RX ) {
+        struct ral_rx_resp* resp = (struct ral_rx_resp*)hdr;
+        add_rxframe(slave_idx, resp->rctx, resp->rps, resp->freq, resp->xtime, resp->rssi, resp->snr, resp->rxdata, resp->rxlen);
+        return 0;
+    }
+    if( hdr->cmd == RAL_CMD_RXBATCH ) {
+        struct ral_rxbatch_resp* batch = (struct ral_rxbatch_resp*)hdr;
+        int off = sizeof(*batch);
+        for( int i=0; i < batch->count; i++ ) {
+            struct ral_rxframe* f = (struct ral_rxframe*)((u1_t*)batch + off);
+            if( off + sizeof(*f) > batch->len || (off += RAL_RXFRAME_SIZE(f->rxlen)) > batch->len )
+                rt_fatal("Slave (%d) sent malformed RX batch: count=%d len=%d", slave_idx, batch->count, batch->len);
+            add_rxframe(slave_idx, batch->rctx, f->rps, f->freq, f->xtime, f->rssi, f->snr, (u1_t*)(f+1), f->rxlen);
+        }
+        return 0;
+    }
+    rt_fatal("Slave (%d) sent unexpected data: cmd=%d size=%d", slave_idx, hdr->cmd, dlen);
+    return 0; // NOT REACHED
+}
+
 static int read_slave_pipe (slave_t* slave, u1_t* buf, int bufsize, int expcmd, struct ral_response* expresp) {
     u1_t slave_idx = (int)(slave-slaves);
     u1_t retries = 0;
@@ -116,7 +215,6 @@ static int read_slave_pipe (slave_t* slave, u1_t* buf, int bufsize, int expcmd,
         while( off < n ) {
             int dlen = n - off;
             struct ral_header* hdr = (struct ral_header*)&buf[off];
-            int consumed = 0;
             if( slave->rsb.off ) {
                 assert(slave->rsb.off<slave->rsb.exp);
                 int chunksz = min(slave->rsb.exp-slave->rsb.off, n-off);
@@ -129,59 +227,19 @@ static int read_slave_pipe (slave_t* slave, u1_t* buf, int bufsize, int expcmd,
                 hdr = (struct ral_header*)slave->rsb.buf;
                 dlen = slave->rsb.off;
             }
-            if( expcmd >= 0 && hdr->cmd == expcmd ) {
-                if( (slave->rsb.exp = sizeof(struct ral_response)) > dlen ) goto spill;
-                *expresp = *(struct ral_response*)hdr;
-                consumed = sizeof(*expresp);
-                expok = 1;
-                slave->last_expcmd = expcmd = -1;
-            }
-            else if( slave->last_expcmd >= 0 && hdr->cmd == slave->last_expcmd ) {
-                if( (slave->rsb.exp = sizeof(struct ral_response)) > dlen ) goto spill;
-                LOG(MOD_RAL|WARNING, "Slave (%d) responded to expired synchronous cmd: %d. Ignoring.", slave_idx, hdr->cmd);
-                consumed = sizeof(struct ral_response);
-                slave->last_expcmd = -1;
-            }
-            else if( hdr->cmd == RAL_CMD_TIMESYNC ) {
-                if( (slave->rsb.exp= sizeof(struct ral_timesync_resp)) > dlen ) goto spill;
-                struct ral_timesync_resp* resp = (struct ral_timesync_resp*)hdr;
-                ustime_t delay = ts_updateTimesync(slave_idx, resp->quality, &resp->timesync);
-                rt_setTimer(&slave->tsync, rt_micros_ahead(delay));
-                consumed = sizeof(*resp);
-            }
-            else if( hdr->cmd == RAL_CMD_RX ) {
-                if( (slave->rsb.exp = sizeof(struct ral_rx_resp)) > dlen ) goto spill;
-                struct ral_rx_resp* resp = (struct ral_rx_resp*)hdr;
-                rxjob_t* rxjob = !TC ? NULL : s2e_nextRxjob(&TC->s2ctx);
-                if( rxjob != NULL ) {
-                    memcpy(&TC->s2ctx.rxq.rxdata[rxjob->off], resp->rxdata, resp->rxlen);
-                    rxjob->len = resp->rxlen;
-                    rxjob->freq = resp->freq;
-                    rxjob->rctx = resp->rctx;
-                    rxjob->xtime = resp->xtime;
-                    rxjob->rssi = resp->rssi;
-                    rxjob->snr = resp->snr;
-                    rxjob->dr = s2e_rps2dr(&TC->s2ctx, resp->rps);
-                    printf("ral_master");
-                    if( rxjob->dr == DR_ILLEGAL ) {
-                        LOG(MOD_RAL|ERROR, "Unable to map to an up DR: %R", resp->rps);
-                    } else {
-                        s2e_addRxjob(&TC->s2ctx, rxjob);
-                        s2e_flushRxjobs(&TC->s2ctx); // XXX
-                    }
-                } else {
-                    LOG(MOD_RAL|ERROR, "Slave (%d) has RX frame dropped - out of space", slave_idx);
-                }
-                consumed = sizeof(*resp);
-            }
-            else {
-                
+            int msgsz = slave_msgsize(slave, hdr, dlen, expcmd);
+            if( msgsz == 0 )
                 rt_fatal("Slave (%d) sent unexpected data: cmd=%d size=%d", slave_idx, hdr->cmd, dlen);
+            if( (slave->rsb.exp = msgsz) > dlen ) {
+                if( slave->rsb.off )
+                    continue;  // header of variable sized message complete - collect the rest
+                goto spill;
             }
+            expok |= handle_slave_msg(slave, hdr, dlen, &expcmd, expresp);
             if( slave->rsb.off ) {
                 slave->rsb.off = 0;
             } else {
-                off += consumed;
+                off += msgsz;
             }
             continue;
         spill:
@@ -194,10 +252,67 @@ static int read_slave_pipe (slave_t* slave, u1_t* buf, int bufsize, int expcmd,
             }
         }
         assert(off==n);
+        flush_rxjobs();
+    }
+}
+
+
+#if !defined(CFG_no_ral_shm)
+// Process messages published by slave directly from the shared memory slots
+static int read_slave_shm (slave_t* slave, int expcmd, struct ral_response* expresp) {
+    u1_t slave_idx = (int)(slave-slaves);
+    u1_t retries = 0;
+    u1_t expok = 0;
+    while(1) {
+        struct ral_header* hdr;
+        while( slave->shm && (hdr = ral_shmRdSlot(slave->shm, RAL_SHM_UP)) != NULL ) {
+            slave->restartCnt = 0;
+            expok |= handle_slave_msg(slave, hdr, RAL_SHM_UPSLOTSZ, &expcmd, expresp);
+            ral_shmRelease(slave->shm, RAL_SHM_UP);
+        }
+        flush_rxjobs();
+        if( expcmd == -1 )
+            return expok;
+        if( ++retries < 5 ) {
+            rt_usleep(RETRY_PIPE_IO);
+            continue;
+        }
+        LOG(MOD_RAL|WARNING, "Slave (%d) did not send reply data - expecting cmd=%d", slave_idx, expcmd);
+        slave->last_expcmd = expcmd;
+        return expok;
     }
 }
 
 
+static void shm_read (aio_t* aio) {
+    slave_t* slave = aio->ctx;
+    struct ral_response resp;
+    ral_shmClear(aio->fd);
+    read_slave_shm(slave, -1, &resp);
+}
+
+
+static void close_shm (slave_t* slave) {
+    aio_close(slave->evup);
+    aio_close(slave->evdn);
+    ral_shmFree(slave->shm);
+    slave->evup = slave->evdn = NULL;
+    slave->shm = NULL;
+}
+#endif // !defined(CFG_no_ral_shm)
+
+
+// Wait for a synchronous response from slave
+static int read_slave (slave_t* slave, int expcmd, struct ral_response* expresp) {
+#if !defined(CFG_no_ral_shm)
+    if( slave->shm )
+        return read_slave_shm(slave, expcmd, expresp);
+#endif // !defined(CFG_no_ral_shm)
+    u1_t buf[PIPE_BUF];
+    return read_slave_pipe(slave, buf, PIPE_BUF, expcmd, expresp);
+}
+
+
 static void pipe_read (aio_t* aio) {
     slave_t* slave = aio->ctx;
     u1_t buf[PIPE_BUF];
@@ -217,6 +332,9 @@ static void killAllSlaves () {
         slave->pid = 0;
         aio_close(slave->up);
         aio_close(slave->dn);
+#if !defined(CFG_no_ral_shm)
+        close_shm(slave);
+#endif // !defined(CFG_no_ral_shm)
         rt_clrTimer(&slave->tmr);
         if( pid )
             kill(pid, SIGKILL);
@@ -320,6 +438,22 @@ static int write_slave_pipe (slave_t* slave, void* data, int len) {
         return 0;
     }
     int n, retries = 0;
+#if !defined(CFG_no_ral_shm)
+    if( slave->shm ) {
+        void* slot;
+        while( (slot = ral_shmWrSlot(slave->shm, RAL_SHM_DN)) == NULL ) {
+            if( ++retries >= 5 ) {
+                LOG(MOD_RAL|ERROR, "Shared memory ring to slave full");
+                return 0;
+            }
+            rt_usleep(RETRY_PIPE_IO);
+        }
+        memcpy(slot, data, len);
+        ral_shmPublish(slave->shm, RAL_SHM_DN);
+        ral_shmSignal(slave->evdn->fd);
+        return 1;
+    }
+#endif // !defined(CFG_no_ral_shm)
  again:
     n = write(slave->dn->fd, data, len);
     if( n != -1 ) {
@@ -384,6 +518,9 @@ static void restart_slave (tmr_t* tmr) {
     aio_close(slave->up);
     aio_close(slave->dn);
     slave->up = slave->dn = NULL;
+#if !defined(CFG_no_ral_shm)
+    close_shm(slave);
+#endif // !defined(CFG_no_ral_shm)
 
     if( is_slave_alive(slave) ) {
         LOG(MOD_RAL|INFO, "Slave pid=%d idx=%d: Trying kill (cnt=%d)", slaveIdx, pid, slave->killCnt);
@@ -401,10 +538,30 @@ static void restart_slave (tmr_t* tmr) {
     }
     slave->up = aio_open(slave, up[0], pipe_read, NULL);
     slave->dn = aio_open(slave, dn[1], NULL, NULL);  // we need this only for O_CLOEXEC
+#if !defined(CFG_no_ral_shm)
+    // Shared memory transport - inherited by slave, falls back to pipes on any failure
+    int memfd = -1, evup = -1, evdn = -1;
+    if( (slave->shm = ral_shmCreate(&memfd)) != NULL &&
+        ((evup = eventfd(0, EFD_NONBLOCK)) == -1 || (evdn = eventfd(0, EFD_NONBLOCK)) == -1) ) {
+        LOG(MOD_RAL|WARNING, "Slave (%d) - eventfd failed - using pipes: %s", slaveIdx, strerror(errno));
+        if( evup >= 0 ) close(evup);
+        close(memfd);
+        ral_shmFree(slave->shm);
+        slave->shm = NULL;
+        memfd = evup = -1;
+    }
+#endif // !defined(CFG_no_ral_shm)
     sys_flushLog();
 
     if( (pid = fork()) == 0 ) {
         // This is the child process.  Execute the shell command.
+#if !defined(CFG_no_ral_shm)
+        if( slave->shm ) {
+            char fdbuf[40];
+            snprintf(fdbuf, sizeof(fdbuf), "%d,%d,%d", memfd, evup, evdn);
+            setenv("SLAVE_SHMFDS", fdbuf, 1);
+        }
+#endif // !defined(CFG_no_ral_shm)
         execSlave(slaveIdx, dn[0], up[1]);
         // NOT REACHED
         assert(0);
@@ -416,6 +573,14 @@ static void restart_slave (tmr_t* tmr) {
     LOG(MOD_RAL|INFO, "Master has started slave: pid=%d idx=%d (attempt %d)", pid, slaveIdx, slave->restartCnt);
     close(up[1]);
     close(dn[0]);
+#if !defined(CFG_no_ral_shm)
+    if( slave->shm ) {
+        close(memfd);  // mapping stays
+        slave->evup = aio_open(slave, evup, shm_read, NULL);
+        slave->evdn = aio_open(slave, evdn, NULL, NULL);
+        LOG(MOD_RAL|INFO, "Slave (%d) - using shared memory transport", slaveIdx);
+    }
+#endif // !defined(CFG_no_ral_shm)
     slave->pid = pid;
     send_config(slave);
     pipe_read(slave->up);
@@ -472,8 +637,7 @@ int ral_tx (txjob_t* txjob, s2ctx_t* s2ctx, int nocca) {
     if( region == 0 )
         return RAL_TX_OK;
     struct ral_response resp;
-    u1_t buf[PIPE_BUF];
-    if( !read_slave_pipe(slave, buf, PIPE_BUF, RAL_CMD_TX, &resp) )
+    if( !read_slave(slave, RAL_CMD_TX, &resp) )
         return TXSTATUS_IDLE;
     return resp.status;
 }
@@ -487,8 +651,7 @@ int ral_txstatus (u1_t txunit) {
     if( !write_slave_pipe(slave, &req, sizeof(req)) )
         return TXSTATUS_IDLE;
     struct ral_response resp;
-    u1_t buf[PIPE_BUF];
-    if( !read_slave_pipe(slave, buf, PIPE_BUF, RAL_CMD_TXSTATUS, &resp) )
+    if( !read_slave(slave, RAL_CMD_TXSTATUS, &resp) )
         return TXSTATUS_IDLE;
     return resp.status;
 }
@@ -0,0 +1,135 @@
+/*
+ * --- Revised 3-Clause BSD License ---
+ * Copyright Semtech Corporation 2022. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright notice,
+ *       this list of conditions and the following disclaimer in the documentation
+ *       and/or other materials provided with the distribution.
+ *     * Neither the name of the Semtech corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SEMTECH CORPORATION. BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#if defined(CFG_lgw1) && defined(CFG_ral_master_slave) && !defined(CFG_no_ral_shm)
+
+#define _GNU_SOURCE
+#include <limits.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "rt.h"
+#include "ral.h"
+#include "ralsub.h"
+
+static const u2_t NSLOTS[2] = { RAL_SHM_UPSLOTS,  RAL_SHM_DNSLOTS  };
+
+
+static u1_t* slotAddr (struct ral_shm* shm, int dir, u4_t idx) {
+    idx %= NSLOTS[dir];
+    return dir == RAL_SHM_UP ? shm->upslots[idx] : shm->dnslots[idx];
+}
+
+static struct ral_shm* mapShm (int memfd) {
+    void* p = mmap(NULL, sizeof(struct ral_shm), PROT_READ|PROT_WRITE, MAP_SHARED, memfd, 0);
+    if( p == MAP_FAILED ) {
+        LOG(MOD_RAL|ERROR, "Failed to map shared memory: %s", strerror(errno));
+        return NULL;
+    }
+    return p;
+}
+
+struct ral_shm* ral_shmCreate (int* memfd) {
+    *memfd = -1;
+#if defined(SYS_memfd_create)
+    int fd = syscall(SYS_memfd_create, "station-ral", 0);
+#else
+    int fd = -1;
+    errno = ENOSYS;
+#endif
+    if( fd == -1 ) {
+        LOG(MOD_RAL|WARNING, "memfd_create failed: %s", strerror(errno));
+        return NULL;
+    }
+    if( ftruncate(fd, sizeof(struct ral_shm)) == -1 ) {
+        LOG(MOD_RAL|WARNING, "Failed to size shared memory: %s", strerror(errno));
+        close(fd);
+        return NULL;
+    }
+    struct ral_shm* shm = mapShm(fd);
+    if( shm == NULL ) {
+        close(fd);
+        return NULL;
+    }
+    *memfd = fd;
+    return shm;   // memfd pages are zero - both rings empty
+}
+
+struct ral_shm* ral_shmAttach (int memfd) {
+    struct ral_shm* shm = mapShm(memfd);
+    close(memfd);
+    return shm;
+}
+
+void ral_shmFree (struct ral_shm* shm) {
+    if( shm != NULL )
+        munmap(shm, sizeof(*shm));
+}
+
+void* ral_shmWrSlot (struct ral_shm* shm, int dir) {
+    ral_shmring_t* r = &shm->ring[dir];
+    u4_t head = r->head;
+    if( head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) >= NSLOTS[dir] )
+        return NULL;
+    return slotAddr(shm, dir, head);
+}
+
+void ral_shmPublish (struct ral_shm* shm, int dir) {
+    ral_shmring_t* r = &shm->ring[dir];
+    __atomic_store_n(&r->head, r->head+1, __ATOMIC_RELEASE);
+}
+
+void* ral_shmRdSlot (struct ral_shm* shm, int dir) {
+    ral_shmring_t* r = &shm->ring[dir];
+    u4_t tail = r->tail;
+    if( tail == __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) )
+        return NULL;
+    return slotAddr(shm, dir, tail);
+}
+
+void ral_shmRelease (struct ral_shm* shm, int dir) {
+    ral_shmring_t* r = &shm->ring[dir];
+    __atomic_store_n(&r->tail, r->tail+1, __ATOMIC_RELEASE);
+}
+
+void ral_shmSignal (int evfd) {
+    uL_t one = 1;
+    if( write(evfd, &one, sizeof(one)) == -1 && errno != EAGAIN )
+        LOG(MOD_RAL|ERROR, "eventfd write failed: %s", strerror(errno));
+}
+
+// Reset wakeup counter - must be done before draining the ring
+void ral_shmClear (int evfd) {
+    uL_t cnt;
+    if( read(evfd, &cnt, sizeof(cnt)) == -1 && errno != EAGAIN )
+        LOG(MOD_RAL|ERROR, "eventfd read failed: %s", strerror(errno));
+}
+
+#endif // defined(CFG_lgw1) && defined(CFG_ral_master_slave) && !defined(CFG_no_ral_shm)
@@ -32,6 +32,7 @@
 #include <unistd.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <stddef.h>
 
 #include "uj.h"
 #include "ral.h"
@@ -53,11 +54,42 @@ static aio_t* rd_aio;
 static aio_t* wr_aio;
 static s2_t   txpowAdjust; // scaled by TXPOW_SCALE
 static struct lgw_pkt_rx_s pkt_rx[LGW_PKT_FIFO_SIZE];
+static uL_t   rxbatch[RAL_RXBATCH_MAX/sizeof(uL_t)];  // struct ral_rxbatch_resp + frames
+#if !defined(CFG_no_ral_shm)
+static struct ral_shm* shm;     // NULL if talking through pipes
+static aio_t*  evdn_aio;
+static int     evup_fd = -1;
+
+// Next free slot towards master - NULL if ring is full
+static void* shm_wrslot () {
+    void* slot;
+    int retries = 0;
+    while( (slot = ral_shmWrSlot(shm, RAL_SHM_UP)) == NULL ) {
+        if( ++retries > 5 ) {
+            LOG(MOD_RAL|ERROR, "Slave (%d) - Shared memory ring full - dropping message", sys_slaveIdx);
+            return NULL;
+        }
+        rt_usleep(rt_millis(1));
+    }
+    return slot;
+}
+#endif // !defined(CFG_no_ral_shm)
 
 
 static void pipe_write_data (void* data, int len) {
-    assert(len < PIPE_BUF);
+    assert(len <= PIPE_BUF);
     int retries = 0;
+#if !defined(CFG_no_ral_shm)
+    if( shm ) {
+        void* slot = shm_wrslot();
+        if( slot == NULL )
+            return;
+        memcpy(slot, data, len);
+        ral_shmPublish(shm, RAL_SHM_UP);
+        ral_shmSignal(evup_fd);
+        return;
+    }
+#endif // !defined(CFG_no_ral_shm)
     while(1) {
         int n = write(wr_aio->fd, data, len);
         if( n == len )
@@ -97,8 +129,23 @@ static void log_rawpkt(u1_t level, str_t msg, struct lgw_pkt_rx_s * pkt_rx) {
     );
 }
 
+// Send RX frames collected so far as one message
+static void flush_rxbatch () {
+    struct ral_rxbatch_resp* batch = (struct ral_rxbatch_resp*)rxbatch;
+    if( batch->count )
+        pipe_write_data(batch, batch->len);
+    batch->rctx  = sys_slaveIdx;
+    batch->cmd   = RAL_CMD_RXBATCH;
+    batch->count = 0;
+    batch->len   = sizeof(*batch);
+}
+
 static void rx_polling (tmr_t* tmr) {
+    struct ral_rxbatch_resp* batch = (struct ral_rxbatch_resp*)rxbatch;
     int n;
+#if !defined(CFG_no_ral_shm)
+    int published = 0;
+#endif // !defined(CFG_no_ral_shm)
     while( (n = lgw_receive(LGW_PKT_FIFO_SIZE, pkt_rx)) != 0 ) {
         if( n < 0 || n > LGW_PKT_FIFO_SIZE ) {
             LOG(MOD_RAL|ERROR, "lgw_receive error: %d", n);
@@ -118,29 +165,55 @@ static void rx_polling (tmr_t* tmr) {
                 log_rawpkt(ERROR, "Dropped RX frame - frame size too large: ", p);
                 continue;
             }
-            struct ral_rx_resp resp;
-            memset(&resp, 0, sizeof(resp));
-            resp.rctx   = sys_slaveIdx;
-            resp.cmd    = RAL_CMD_RX;
-            resp.xtime  = ts_xticks2xtime(p->count_us, last_xtime);
-            resp.rps    = ral_lgw2rps(p);
-            resp.freq   = p->freq_hz;
+            if( log_shallLog(MOD_RAL|XDEBUG) ) {
+                log_rawpkt(XDEBUG, "", p);
+            }
+            sL_t xtime = ts_xticks2xtime(p->count_us, last_xtime);
 #if defined(CFG_sx1302)
-            resp.rssi  = (u1_t)-p->rssis;
+            u1_t rssi = (u1_t)-p->rssis;
 #else
-            resp.rssi  = (u1_t)-p->rssi;
+            u1_t rssi = (u1_t)-p->rssi;
 #endif
-            resp.snr    = (s1_t)(p->snr  *  4);
-            resp.rxlen  = p->size;
-            memcpy(resp.rxdata, p->payload, p->size);
-
-            if( log_shallLog(MOD_RAL|XDEBUG) ) {
-                log_rawpkt(XDEBUG, "", p);
+#if !defined(CFG_no_ral_shm)
+            if( shm ) {
+                // Frame is assembled right in the slot read by master
+                struct ral_rx_resp* resp = shm_wrslot();
+                if( resp == NULL )
+                    continue;
+                memset(resp, 0, offsetof(struct ral_rx_resp, rxdata));
+                resp->rctx   = sys_slaveIdx;
+                resp->cmd    = RAL_CMD_RX;
+                resp->xtime  = xtime;
+                resp->rps    = ral_lgw2rps(p);
+                resp->freq   = p->freq_hz;
+                resp->rssi   = rssi;
+                resp->snr    = (s1_t)(p->snr  *  4);
+                resp->rxlen  = p->size;
+                memcpy(resp->rxdata, p->payload, p->size);
+                ral_shmPublish(shm, RAL_SHM_UP);
+                published += 1;
+                continue;
             }
-
-            pipe_write_data(&resp, sizeof(resp));
+#endif // !defined(CFG_no_ral_shm)
+            if( batch->len + RAL_RXFRAME_SIZE(p->size) > RAL_RXBATCH_MAX )
+                flush_rxbatch();
+            struct ral_rxframe* f = (struct ral_rxframe*)((u1_t*)rxbatch + batch->len);
+            f->rxlen = p->size;
+            f->rps   = ral_lgw2rps(p);
+            f->rssi  = rssi;
+            f->snr   = (s1_t)(p->snr  *  4);
+            f->freq  = p->freq_hz;
+            f->xtime = xtime;
+            memcpy(f+1, p->payload, p->size);
+            batch->len += RAL_RXFRAME_SIZE(p->size);
+            batch->count += 1;
         }
     }
+    flush_rxbatch();
+#if !defined(CFG_no_ral_shm)
+    if( published )
+        ral_shmSignal(evup_fd);  // one wakeup for the whole batch
+#endif // !defined(CFG_no_ral_shm)
     rt_setTimer(&rxpoll_tmr, rt_micros_ahead(RX_POLL_INTV));
 }
 
@@ -154,6 +227,119 @@ static void sendTimesync () {
 }
 
 
+// Execute one request from master - returns the number of bytes consumed
+static int handle_master_msg (struct ral_header* req, int avail) {
+    assert(avail >= sizeof(*req));
+    if( avail >= sizeof(struct ral_txstatus_req) && req->cmd == RAL_CMD_TXSTATUS ) {
+        struct ral_response* resp = (struct ral_response*)req;
+        u1_t ret=TXSTATUS_IDLE, status;
+#if defined(CFG_sx1302)
+        int err = lgw_status(0, TX_STATUS, &status);  
+#else
+        int err = lgw_status(TX_STATUS, &status);
+#endif
+        /**/ if (err != LGW_HAL_SUCCESS)  { LOG(MOD_RAL|ERROR, "lgw_status failed"); }
+        else if( status == TX_SCHEDULED ) { ret = TXSTATUS_SCHEDULED; }
+        else if( status == TX_EMITTING  ) { ret = TXSTATUS_EMITTING; }
+        resp->status = ret;
+        pipe_write_data(resp, sizeof(*resp));
+        return sizeof(struct ral_txstatus_req);
+    }
+    else if( avail >= sizeof(struct ral_txabort_req) && req->cmd == RAL_CMD_TXABORT) {
+#if defined(CFG_sx1302)
+        lgw_abort_tx(0); 
+#else
+        lgw_abort_tx();
+#endif
+        return sizeof(struct ral_txabort_req);
+    }
+    else if( avail >= sizeof(struct ral_timesync_req) && req->cmd == RAL_CMD_TIMESYNC) {
+        sendTimesync();
+        return sizeof(struct ral_timesync_req);
+    }
+    else if( avail >= sizeof(struct ral_tx_req) && (req->cmd == RAL_CMD_TX_NOCCA || req->cmd == RAL_CMD_TX  )) {
+        struct ral_tx_req* txreq = (struct ral_tx_req*)req;
+        struct lgw_pkt_tx_s pkt_tx;
+
+        pkt_tx.invert_pol = true;
+        pkt_tx.no_header  = false;
+
+        if( (txreq->rps & RPS_BCN) ) {  
+            pkt_tx.tx_mode = ON_GPS;
+            pkt_tx.preamble = 10;
+            pkt_tx.invert_pol = false;
+            pkt_tx.no_header  = true;
+        } else {
+            pkt_tx.tx_mode = TIMESTAMPED;
+            pkt_tx.preamble = 8;
+        }
+        ral_rps2lgw(txreq->rps, &pkt_tx);
+        pkt_tx.freq_hz    = txreq->freq;
+        pkt_tx.count_us   = txreq->xtime;
+        pkt_tx.rf_chain   = 0;
+        pkt_tx.rf_power   = (float)(txreq->txpow - txpowAdjust)/TXPOW_SCALE;
+        pkt_tx.coderate   = CR_LORA_4_5;
+        pkt_tx.no_crc     = !txreq->addcrc;
+        pkt_tx.size       = txreq->txlen;
+        memcpy(pkt_tx.payload, txreq->txdata, txreq->txlen);
+#if defined(CFG_sx1302)
+        int err = lgw_send(&pkt_tx);
+#else
+        int err = lgw_send(pkt_tx);
+#endif
+        if( region == 0 ) {
+            return sizeof(struct ral_tx_req);
+        }
+        // Send back CCA/LBT result
+        struct ral_response* resp = (struct ral_response*)req;
+        u1_t ret = RAL_TX_OK;
+        if( err == LGW_HAL_SUCCESS ) {
+            ret = RAL_TX_OK;
+        } else if( err == LGW_LBT_ISSUE ) {
+            ret = RAL_TX_NOCA;
+        } else {
+            LOG(MOD_RAL|ERROR, "lgw_send failed");
+            ret = RAL_TX_FAIL;
+        }
+        resp->status = ret;
+        pipe_write_data(resp, sizeof(*resp));
+        return sizeof(struct ral_tx_req);
+    }
+    else if( avail >= sizeof(struct ral_config_req) && req->cmd == RAL_CMD_CONFIG) {
+        struct ral_config_req* confreq = (struct ral_config_req*)req;
+        struct sx130xconf sx1301conf;
+        int status = 0;
+        // Note: sx1301conf_start can take considerable amount of time (if LBT on up to 8s!!)
+        if( (status = !sx130xconf_parse_setup(&sx1301conf, sys_slaveIdx, confreq->hwspec, confreq->json, confreq->jsonlen)) ||
+            (status = !sx130xconf_challoc(&sx1301conf, &confreq->upchs)   << 1) ||
+            (status = !sys_runRadioInit(sx1301conf.device)                << 2) ||
+            (status = !sx130xconf_start(&sx1301conf, confreq->region)     << 3) )
+            rt_fatal("Slave radio start up failed with status 0x%02x", status);
+        if( sx1301conf.pps && sys_slaveIdx ) {
+            LOG(MOD_RAL|ERROR, "Only slave#0 may have PPS enabled");
+            sx1301conf.pps = 0;
+        }
+        pps_en = sx1301conf.pps;
+        region = confreq->region;
+        txpowAdjust = sx1301conf.txpowAdjust;
+        last_xtime = ts_newXtimeSession(sys_slaveIdx);
+        rt_yieldTo(&rxpoll_tmr, rx_polling);
+        sendTimesync();
+        return sizeof(struct ral_config_req);
+    }
+    else if( avail >= sizeof(struct ral_stop_req) && req->cmd == RAL_CMD_STOP) {
+        last_xtime = 0;
+        rt_clrTimer(&rxpoll_tmr);
+        lgw_stop();
+        return sizeof(struct ral_stop_req);
+    }
+    else {
+        rt_fatal("Master sent unexpected data: cmd=%d size=%d", req->cmd, avail);
+    }
+    return 0; // NOT REACHED
+}
+
+
 static void pipe_read (aio_t* aio) {
     u1_t buf[PIPE_BUF];
     while(1) {
@@ -170,125 +356,42 @@ static void pipe_read (aio_t* aio) {
             rt_fatal("Slave pipe read fail: %s", strerror(errno));
         }
         int off = 0;
-        while( off < n ) {
-            struct ral_header* req = (struct ral_header*)&buf[off];
-            assert(n >= off + sizeof(*req));
-            if( n >= off + sizeof(struct ral_txstatus_req) && req->cmd == RAL_CMD_TXSTATUS ) {
-                off += sizeof(struct ral_txstatus_req);
-                struct ral_response* resp = (struct ral_response*)req;
-                u1_t ret=TXSTATUS_IDLE, status;
-#if defined(CFG_sx1302)
-                int err = lgw_status(0, TX_STATUS, &status);  
-#else
-                int err = lgw_status(TX_STATUS, &status);
-#endif
-                /**/ if (err != LGW_HAL_SUCCESS)  { LOG(MOD_RAL|ERROR, "lgw_status failed"); }
-                else if( status == TX_SCHEDULED ) { ret = TXSTATUS_SCHEDULED; }
-                else if( status == TX_EMITTING  ) { ret = TXSTATUS_EMITTING; }
-                resp->status = ret;
-                pipe_write_data(resp, sizeof(*resp));
-                continue;
-            }
-            else if( n >= off + sizeof(struct ral_txabort_req) && req->cmd == RAL_CMD_TXABORT) {
-                off += sizeof(struct ral_txabort_req);
-#if defined(CFG_sx1302)
-                lgw_abort_tx(0); 
-#else
-                lgw_abort_tx();
-#endif
-                continue;
-            }
-            else if( n >= off + sizeof(struct ral_timesync_req) && req->cmd == RAL_CMD_TIMESYNC) {
-                off += sizeof(struct ral_timesync_req);
-                sendTimesync();
-                continue;
-            }
-            else if( n >= off + sizeof(struct ral_tx_req) && (req->cmd == RAL_CMD_TX_NOCCA || req->cmd == RAL_CMD_TX  )) {
-                off += sizeof(struct ral_tx_req);
-                struct ral_tx_req* txreq = (struct ral_tx_req*)req;
-                struct lgw_pkt_tx_s pkt_tx;
+        while( off < n )
+            off += handle_master_msg((struct ral_header*)&buf[off], n-off);
+        assert(off==n); // req fragments should not exist
+    }
+}
 
-                pkt_tx.invert_pol = true;
-                pkt_tx.no_header  = false;
 
-                if( (txreq->rps & RPS_BCN) ) {  
-                    pkt_tx.tx_mode = ON_GPS;
-                    pkt_tx.preamble = 10;
-                    pkt_tx.invert_pol = false;
-                    pkt_tx.no_header  = true;
-                } else {
-                    pkt_tx.tx_mode = TIMESTAMPED;
-                    pkt_tx.preamble = 8;
-                }
-                ral_rps2lgw(txreq->rps, &pkt_tx);
-                pkt_tx.freq_hz    = txreq->freq;
-                pkt_tx.count_us   = txreq->xtime;
-                pkt_tx.rf_chain   = 0;
-                pkt_tx.rf_power   = (float)(txreq->txpow - txpowAdjust)/TXPOW_SCALE;
-                pkt_tx.coderate   = CR_LORA_4_5;
-                pkt_tx.no_crc     = !txreq->addcrc;
-                pkt_tx.size       = txreq->txlen;
-                memcpy(pkt_tx.payload, txreq->txdata, txreq->txlen);
-#if defined(CFG_sx1302)
-                int err = lgw_send(&pkt_tx);
-#else
-                int err = lgw_send(pkt_tx);
-#endif
-                if( region == 0 ) {
-                    continue;
-                }
-                // Send back CCA/LBT result
-                struct ral_response* resp = (struct ral_response*)req;
-                u1_t ret = RAL_TX_OK;
-                if( err == LGW_HAL_SUCCESS ) {
-                    ret = RAL_TX_OK;
-                } else if( err == LGW_LBT_ISSUE ) {
-                    ret = RAL_TX_NOCA;
-                } else {
-                    LOG(MOD_RAL|ERROR, "lgw_send failed");
-                    ret = RAL_TX_FAIL;
-                }
-                resp->status = ret;
-                pipe_write_data(resp, sizeof(*resp));
-                continue;
-            }
-            else if( n >= off + sizeof(struct ral_config_req) && req->cmd == RAL_CMD_CONFIG) {
-                off += sizeof(struct ral_config_req);
-                struct ral_config_req* confreq = (struct ral_config_req*)req;
-                struct sx130xconf sx1301conf;
-                int status = 0;
-                // Note: sx1301conf_start can take considerable amount of time (if LBT on up to 8s!!)
-                if( (status = !sx130xconf_parse_setup(&sx1301conf, sys_slaveIdx, confreq->hwspec, confreq->json, confreq->jsonlen)) ||
-                    (status = !sx130xconf_challoc(&sx1301conf, &confreq->upchs)   << 1) ||
-                    (status = !sys_runRadioInit(sx1301conf.device)                << 2) ||
-                    (status = !sx130xconf_start(&sx1301conf, confreq->region)     << 3) )
-                    rt_fatal("Slave radio start up failed with status 0x%02x", status);
-                if( sx1301conf.pps && sys_slaveIdx ) {
-                    LOG(MOD_RAL|ERROR, "Only slave#0 may have PPS enabled");
-                    sx1301conf.pps = 0;
-                }
-                pps_en = sx1301conf.pps;
-                region = confreq->region;
-                txpowAdjust = sx1301conf.txpowAdjust;
-                last_xtime = ts_newXtimeSession(sys_slaveIdx);
-                rt_yieldTo(&rxpoll_tmr, rx_polling);
-                sendTimesync();
-                continue;
-            }
-            else if( n >= off + sizeof(struct ral_stop_req) && req->cmd == RAL_CMD_STOP) {
-                off += sizeof(struct ral_stop_req);
-                last_xtime = 0;
-                rt_clrTimer(&rxpoll_tmr);
-                lgw_stop();
-                continue;
-            }
-            else {
-                rt_fatal("Master sent unexpected data: cmd=%d size=%d", req->cmd, n-off);
-            }
-        }
-        assert(off==n); // req fragments should not exist
+#if !defined(CFG_no_ral_shm)
+static void shm_read (aio_t* aio) {
+    ral_shmClear(aio->fd);
+    struct ral_header* req;
+    while( (req = ral_shmRdSlot(shm, RAL_SHM_DN)) != NULL ) {
+        handle_master_msg(req, RAL_SHM_DNSLOTSZ);
+        ral_shmRelease(shm, RAL_SHM_DN);
+    }
+}
+
+// Master passes shared memory and eventfds as: SLAVE_SHMFDS=memfd,evup,evdn
+static void startShm () {
+    str_t s = getenv("SLAVE_SHMFDS");
+    if( s == NULL )
+        return;
+    int memfd = rt_readDec(&s);
+    int evup = *s == ',' ? (s++, rt_readDec(&s)) : -1;
+    int evdn = *s == ',' ? (s++, rt_readDec(&s)) : -1;
+    if( memfd < 0 || evup < 0 || evdn < 0 || *s ) {
+        LOG(MOD_RAL|ERROR, "Slave (%d) - Illegal SLAVE_SHMFDS - using pipes", sys_slaveIdx);
+        return;
     }
+    if( (shm = ral_shmAttach(memfd)) == NULL )
+        return;
+    evup_fd = evup;
+    fcntl(evup_fd, F_SETFD, FD_CLOEXEC);
+    evdn_aio = aio_open(&rxpoll_tmr, evdn, shm_read, NULL);
 }
+#endif // !defined(CFG_no_ral_shm)
 
 
 void sys_startupSlave (int rdfd, int wrfd) {
@@ -296,7 +399,15 @@ void sys_startupSlave (int rdfd, int wrfd) {
     rd_aio = aio_open(&rxpoll_tmr, rdfd, pipe_read, NULL);
     wr_aio = aio_open(&rxpoll_tmr, wrfd, NULL, NULL);
     rt_iniTimer(&rxpoll_tmr, NULL);
+    flush_rxbatch();  // init batch header
+#if !defined(CFG_no_ral_shm)
+    startShm();
+#endif // !defined(CFG_no_ral_shm)
     pipe_read(rd_aio);
+#if !defined(CFG_no_ral_shm)
+    if( evdn_aio )
+        shm_read(evdn_aio);
+#endif // !defined(CFG_no_ral_shm)
     LOG(MOD_RAL|INFO, "Slave LGW (%d) - started.", sys_slaveIdx);
     aio_loop();
     // NOT REACHED
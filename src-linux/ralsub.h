@@ -43,6 +43,7 @@ enum {
     RAL_CMD_RX,
     RAL_CMD_TIMESYNC,
     RAL_CMD_STOP,
+    RAL_CMD_RXBATCH,
 };
 
 struct ral_header {
@@ -123,6 +124,65 @@ struct ral_rx_resp {
     u1_t  rxdata[MAX_RXFRAME_LEN];
 };
 
+// All frames from one RX poll in a single message. The frames follow the header
+// back to back - each a ral_rxframe plus rxlen payload bytes, padded to 8 bytes.
+// A batch never exceeds RAL_RXBATCH_MAX and thus goes through the pipe in one write.
+struct ral_rxbatch_resp {
+    sL_t  rctx;
+    u1_t  cmd;
+    u1_t  count;  // number of frames
+    u2_t  len;    // total message size including this header
+};
+
+struct ral_rxframe {
+    u1_t  rxlen;
+    rps_t rps;
+    u1_t  rssi;   // scaled RSSI (*-1)
+    s1_t  snr;    // scaled SNR (*8)
+    u4_t  freq;
+    sL_t  xtime;
+    // followed by rxlen bytes of frame data
+};
+
+enum { RAL_RXBATCH_MAX = PIPE_BUF };
+#define RAL_RXFRAME_SIZE(rxlen) ((sizeof(struct ral_rxframe)+(rxlen)+7) & ~7)
+
+#if !defined(CFG_no_ral_shm)
+// Shared memory transport between master and slave: one single producer/consumer
+// ring per direction in a memfd mapped by both processes. A slot carries one of the
+// structs above, exactly as they would go through the pipes. The producer wakes up
+// the peer with an eventfd. Pipes stay in place - they signal liveness (EOF if the
+// peer dies) and carry all traffic if the shared memory cannot be set up.
+enum { RAL_SHM_UP=0, RAL_SHM_DN=1 };
+enum { RAL_SHM_UPSLOTS = 64, RAL_SHM_UPSLOTSZ = 320 };       // slave -> master: rx/timesync/responses
+enum { RAL_SHM_DNSLOTS = 16, RAL_SHM_DNSLOTSZ = PIPE_BUF };  // master -> slave: incl. ral_config_req
+static_assert(sizeof(struct ral_rx_resp) <= RAL_SHM_UPSLOTSZ && sizeof(struct ral_timesync_resp) <= RAL_SHM_UPSLOTSZ,
+              "slave -> master message exceeds RAL_SHM_UPSLOTSZ");
+static_assert(sizeof(struct ral_config_req) <= RAL_SHM_DNSLOTSZ && sizeof(struct ral_tx_req) <= RAL_SHM_DNSLOTSZ,
+              "master -> slave message exceeds RAL_SHM_DNSLOTSZ");
+
+typedef struct ral_shmring {
+    u4_t head __attribute__((aligned(64)));  // slots published - written by producer only
+    u4_t tail __attribute__((aligned(64)));  // slots consumed - written by consumer only
+} ral_shmring_t;
+
+struct ral_shm {
+    ral_shmring_t ring[2];  // RAL_SHM_UP/DN
+    u1_t upslots[RAL_SHM_UPSLOTS][RAL_SHM_UPSLOTSZ];
+    u1_t dnslots[RAL_SHM_DNSLOTS][RAL_SHM_DNSLOTSZ];
+};
+
+struct ral_shm* ral_shmCreate  (int* memfd);  // master
+struct ral_shm* ral_shmAttach  (int memfd);   // slave
+void            ral_shmFree    (struct ral_shm* shm);
+void*           ral_shmWrSlot  (struct ral_shm* shm, int dir);  // NULL if ring is full
+void            ral_shmPublish (struct ral_shm* shm, int dir);
+void            ral_shmSignal  (int evfd);
+void            ral_shmClear   (int evfd);
+void*           ral_shmRdSlot  (struct ral_shm* shm, int dir);  // NULL if ring is empty
+void            ral_shmRelease (struct ral_shm* shm, int dir);
+#endif // !defined(CFG_no_ral_shm)
+
 // Fwd decl.
 struct lgw_pkt_tx_s;
 struct lgw_pkt_rx_s;
@@ -847,6 +847,8 @@ static struct argp_option options[] = {
     },
     { "log-level", 'l', "LVL|0..7", 0,
       ("Set a log level LVL=#loglvls# or use a numeric value. "
+       "Levels can be set per module (MOD:LVL) as a comma separated list. "
+       "Appending /RATE limits each log statement of a module to RATE messages per second. "
        "Overrides environment STATION_LOGLEVEL.")
     },
     { "home", 'h', "DIR", 0,
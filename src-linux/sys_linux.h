@@ -49,8 +49,6 @@ void     sys_startLogThread ();
 void     sys_iniLogging (struct logfile* lf, int captureStdio);
 void     sys_flushLog ();
 int      sys_findPids (str_t device, u4_t* pids, int n_pids);
-dbuf_t   sys_checkFile (str_t filename);
-void     sys_writeFile (str_t filename, dbuf_t* data);
 void     sys_startupSlave (int rdfd, int wrfd);
 int      sys_enableGPS (str_t device);
 void     sys_enableCmdFIFO (str_t file);
@@ -48,15 +48,13 @@
 static struct logfile* logfile;
 
 static tmr_t delay;               // wait until we flush
-static char  outbuf[LOG_OUTSIZ];  // buffer output
-static int   outfill = 0;         // write index
+static char  outbuf[LOG_OUTSIZ];  // lines formatted from log ring - owned by holder of mxcond
 
 static aio_t* stdout_aio;         //
 static char   stdout_buf[MAX_LOGHDR+PIPE_BUF];
 static int    stdout_idx = MAX_LOGHDR;
 
 
-static pthread_mutex_t  mxfill  = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t  mxcond  = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t   condvar = PTHREAD_COND_INITIALIZER;
 static pthread_t        thr;
@@ -174,26 +172,30 @@ static void addLog (const char *logline, int len) {
         writeLogData(logline, len);
         return;
     }
-    pthread_mutex_lock(&mxfill);
-    int k = min(LOG_OUTSIZ-outfill, len);
-    memcpy(outbuf + outfill, logline, k);
-    outfill += k;
-    int notify = (len == 0 || outfill >= LOG_HIGHWATER);
-    pthread_mutex_unlock(&mxfill);
-    if( notify ) {
+    log_addText(logline, len);
+}
+
+
+// Called by main thread after adding records to the log ring
+void sys_wakeLog (int fill) {
+    if( fill >= LOG_HIGHWATER )
         pthread_cond_signal(&condvar);
-    } else if( delay.next == TMR_NIL ) {
-        // Delay timer not running
+    // Also arm timer - a signal is lost if log thread is not waiting
+    if( delay.next == TMR_NIL )
         rt_setTimer(&delay, rt_millis_ahead(LOG_LAG));
-    }
 }
 
 
 static void on_delay (tmr_t* tmr) {
-    pthread_mutex_lock(&mxfill);
-    if( outfill )
-        pthread_cond_signal(&condvar);
-    pthread_mutex_unlock(&mxfill);
+    pthread_cond_signal(&condvar);
+}
+
+
+// Format records from the log ring and write them out - caller must hold mxcond
+static void drainLog (void) {
+    int len;
+    while( (len = log_drainRing(outbuf, LOG_OUTSIZ)) > 0 )
+        writeLogData(outbuf, len);
 }
 
 
@@ -201,20 +203,7 @@ static void thread_log (void) {
     pthread_mutex_lock(&mxcond);
     while(1) {
         pthread_cond_wait(&condvar, &mxcond);
-        pthread_mutex_lock(&mxfill);
-        int len = outfill;
-        pthread_mutex_unlock(&mxfill);
-        if( len ) {
-            writeLogData(outbuf, len);
-            pthread_mutex_lock(&mxfill);
-            if( len < outfill ) {
-                memcpy(&outbuf[0], &outbuf[len], outfill-len);
-                outfill -= len;
-            } else {
-                outfill = 0;
-            }
-            pthread_mutex_unlock(&mxfill);
-        }
+        drainLog();
     }
 }
 
@@ -223,10 +212,7 @@ void sys_flushLog (void) {
     fflush(stdout);
     fflush(stderr);
     pthread_mutex_lock(&mxcond);
-    pthread_mutex_lock(&mxfill);
-    writeLogData(outbuf, outfill);
-    outfill = 0;
-    pthread_mutex_unlock(&mxfill);
+    drainLog();
     pthread_mutex_unlock(&mxcond);
 }
 
@@ -279,6 +265,7 @@ void sys_startLogThread () {
         if( pthread_create(&thr, NULL, (void * (*)(void *))thread_log, NULL) != 0 )
             sys_fatal(FATAL_PTHREAD);
         rt_iniTimer(&delay, on_delay);
+        log_startRing();
         thrUp = 1;
     }
 }
@@ -0,0 +1,139 @@
+/*
+ * --- Revised 3-Clause BSD License ---
+ * Copyright Semtech Corporation 2022. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright notice,
+ *       this list of conditions and the following disclaimer in the documentation
+ *       and/or other materials provided with the distribution.
+ *     * Neither the name of the Semtech corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SEMTECH CORPORATION. BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <netdb.h>
+#include <pthread.h>
+#include "rt.h"
+#include "sys.h"
+
+
+// Name resolution runs on short lived helper threads so that a slow or
+// unreachable DNS server does not stall the event loop. A finished job is
+// handed back by writing its pointer into a pipe watched by AIO.
+// The helper thread never touches a job after it has posted it.
+
+typedef struct resjob {
+    char*            host;
+    char*            port;
+    sys_resolvecb_t  cb;       // NULL if cancelled
+    void*            ctx;
+    struct addrinfo* res;
+    int              err;
+} resjob_t;
+
+static int    resolvePipe[2] = { -1, -1 };
+static aio_t* resolveAio;
+
+
+static void resolve_done (aio_t* aio) {
+    while(1) {
+        resjob_t* job;
+        int n = read(aio->fd, &job, sizeof(job));
+        if( n == -1 && (errno == EAGAIN || errno == EINTR) )
+            return;
+        if( n != sizeof(job) ) {
+            LOG(MOD_AIO|ERROR, "Resolver pipe read failed (n=%d): %s", n, strerror(errno));
+            return;
+        }
+        if( job->cb ) {
+            job->cb(job->ctx, job->res, job->err);
+        } else if( job->res ) {
+            freeaddrinfo(job->res);
+        }
+        rt_free(job->host);
+        rt_free(job->port);
+        rt_free(job);
+    }
+}
+
+
+static void* thread_resolve (void* arg) {
+    resjob_t* job = arg;
+    struct addrinfo hints = {
+        .ai_family   = AF_UNSPEC,
+        .ai_socktype = SOCK_STREAM,
+        .ai_protocol = IPPROTO_TCP,
+    };
+    job->err = getaddrinfo(job->host, job->port, &hints, &job->res);
+    // Pointer sized writes to a pipe are atomic - write end blocks if the pipe is full
+    int n;
+    while( (n = write(resolvePipe[1], &job, sizeof(job))) == -1 && errno == EINTR );
+    if( n != sizeof(job) ) {
+        // Not on the main thread - cannot use LOG. Job is lost and its callback never fires.
+        fprintf(stderr, "Resolver pipe write failed for %s:%s (n=%d): %s\n",
+                job->host, job->port, n, strerror(errno));
+    }
+    return NULL;
+}
+
+
+void* sys_resolve (str_t host, str_t port, sys_resolvecb_t cb, void* ctx) {
+    if( resolveAio == NULL ) {
+        if( pipe2(resolvePipe, O_NONBLOCK|O_CLOEXEC) == -1 ) {
+            LOG(MOD_AIO|ERROR, "Failed to create resolver pipe: %s", strerror(errno));
+            return NULL;
+        }
+        // Only the read end is polled by AIO - helper threads block instead of dropping jobs
+        int flags = fcntl(resolvePipe[1], F_GETFL, 0);
+        if( flags != -1 )
+            fcntl(resolvePipe[1], F_SETFL, flags & ~O_NONBLOCK);
+        resolveAio = aio_open(&resolvePipe, resolvePipe[0], resolve_done, NULL);
+    }
+    resjob_t* job = rt_malloc(resjob_t);
+    job->host = rt_strdup(host);
+    job->port = rt_strdup(port);
+    job->cb   = cb;
+    job->ctx  = ctx;
+
+    pthread_t thr;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int err = pthread_create(&thr, &attr, thread_resolve, job);
+    pthread_attr_destroy(&attr);
+    if( err != 0 ) {
+        LOG(MOD_AIO|ERROR, "Failed to start resolver thread: %s", strerror(err));
+        rt_free(job->host);
+        rt_free(job->port);
+        rt_free(job);
+        return NULL;
+    }
+    return job;
+}
+
+
+void sys_cancelResolve (void* job) {
+    if( job )
+        ((resjob_t*)job)->cb = NULL;
+}
@@ -32,40 +32,104 @@
 #include <fcntl.h>
 #include "rt.h"
 
+#if defined(CFG_epoll)
+#if !defined(CFG_timerfd)
+#error "CFG_epoll requires CFG_timerfd"
+#endif
+#include <sys/epoll.h>
 
-enum { N_AIO_HANDLES = 10 };
-static aio_t aioHandles[N_AIO_HANDLES];
+enum { N_EPOLL_EVENTS = 16 };
+#define TIMER_TOKEN (~(uL_t)0)
 
+static int epollFD;
+#else // !defined(CFG_epoll)
+#include <sys/select.h>
+#endif // !defined(CFG_epoll)
+
+#if defined(CFG_timerfd)
+#include <sys/timerfd.h>
+
+static int timerFD;
+#endif // CFG_timerfd
+
+
+// Handles are allocated one by one and never freed. Pointers handed out
+// to callers thus stay valid and closed handles are reused by aio_open.
+// Only the table of handle pointers grows if more handles are needed.
+static aio_t** aioHandles;
+static int     aioCnt;
+static int     aioCap;
+
+
+static aio_t* allocHandle () {
+    for( int i=0; i < aioCnt; i++ ) {
+        if( NULL == aioHandles[i]->ctx )
+            return aioHandles[i];
+    }
+    if( aioCnt == aioCap ) {
+        int cap = aioCap == 0 ? 16 : 2*aioCap;
+        aio_t** handles = rt_mallocN(aio_t*, cap);
+        if( aioCnt > 0 )
+            memcpy(handles, aioHandles, aioCnt*sizeof(handles[0]));
+        rt_free(aioHandles);
+        aioHandles = handles;
+        aioCap = cap;
+    }
+    aio_t* aio = rt_malloc(aio_t);
+    aio->fd = -1;
+#if defined(CFG_epoll)
+    aio->idx = aioCnt;
+#endif // defined(CFG_epoll)
+    aioHandles[aioCnt++] = aio;
+    return aio;
+}
+
+
+#if defined(CFG_epoll)
+// Keep epoll interest set in sync with the installed callbacks.
+// Handles without any callback are not registered at all - otherwise
+// EPOLLHUP/EPOLLERR would be reported over and over again.
+static void updateEvents (aio_t* aio) {
+    u4_t events = (aio->rdfn ? EPOLLIN : 0) | (aio->wrfn ? EPOLLOUT : 0);
+    if( events == aio->events )
+        return;
+    struct epoll_event ev = { .events = events, .data.u64 = (uL_t)aio->gen<<32 | (u4_t)aio->idx };
+    int op = aio->events == 0 ? EPOLL_CTL_ADD : events == 0 ? EPOLL_CTL_DEL : EPOLL_CTL_MOD;
+    if( epoll_ctl(epollFD, op, aio->fd, &ev) == -1 ) {
+        LOG(MOD_AIO|ERROR, "epoll_ctl(fd=%d, op=%d) failed: %s", aio->fd, op, strerror(errno));
+        return;
+    }
+    aio->events = events;
+}
+#endif // defined(CFG_epoll)
 
-// There aren't that many fd open thus recalc every time we go into select
-//int aio_maxfd;
-//fd_set aio_rdset;
-//fd_set aio_wrset;
 
 aio_t* aio_open(void* ctx, int fd, aiofn_t rdfn, aiofn_t wrfn) {
     assert(ctx != NULL);
-    for( int i=0; i < N_AIO_HANDLES; i++ ) {
-        if( NULL == aioHandles[i].ctx ) {
-            aioHandles[i].ctx = ctx;
-            aioHandles[i].fd  = fd;
-            aioHandles[i].rdfn = rdfn;
-            aioHandles[i].wrfn = wrfn;
-            int flags;
-            if( (flags = fcntl(fd, F_GETFD, 0)) == -1 ||
-                fcntl(fd, F_SETFD, flags|FD_CLOEXEC) == -1 )
-                LOG(MOD_AIO|ERROR, "fcntl(fd, F_SETFD, FD_CLOEXEC) failed: %s", strerror(errno));
-            return &aioHandles[i];
-        }
-    }
-    rt_fatal("Out of AIO handles");
-    return NULL;
+#if !defined(CFG_epoll)
+    if( fd >= FD_SETSIZE )
+        rt_fatal("AIO fd=%d out of range for select (FD_SETSIZE=%d)", fd, FD_SETSIZE);
+#endif // !defined(CFG_epoll)
+    aio_t* aio = allocHandle();
+    aio->ctx = ctx;
+    aio->fd  = fd;
+    aio->rdfn = rdfn;
+    aio->wrfn = wrfn;
+    int flags;
+    if( (flags = fcntl(fd, F_GETFD, 0)) == -1 ||
+        fcntl(fd, F_SETFD, flags|FD_CLOEXEC) == -1 )
+        LOG(MOD_AIO|ERROR, "fcntl(fd, F_SETFD, FD_CLOEXEC) failed: %s", strerror(errno));
+#if defined(CFG_epoll)
+    updateEvents(aio);
+#endif // defined(CFG_epoll)
+    return aio;
 }
 
 
 aio_t* aio_fromCtx(void* ctx) {
-   for( int i=0; i < N_AIO_HANDLES; i++ ) {
-        if( ctx == aioHandles[i].ctx )
-            return &aioHandles[i];
+   for( int i=0; i < aioCnt; i++ ) {
+        if( ctx == aioHandles[i]->ctx )
+            return aioHandles[i];
    }
    return NULL;
 }
@@ -74,33 +138,111 @@ aio_t* aio_fromCtx(void* ctx) {
 void aio_close (aio_t* aio) {
     if( aio == NULL )
         return;
+#if defined(CFG_epoll)
+    assert(aio->idx < aioCnt && aioHandles[aio->idx] == aio);
+    if( aio->fd >= 0 && aio->events )
+        epoll_ctl(epollFD, EPOLL_CTL_DEL, aio->fd, NULL);
+    int idx = aio->idx;
+    u4_t gen = aio->gen + 1;   // invalidate any pending events for this handle
+#endif // defined(CFG_epoll)
     if( aio->fd >= 0 ) {
         close(aio->fd);
         aio->fd = -1;
     }
-    assert(aio >= aioHandles && aio < &aioHandles[N_AIO_HANDLES]);
     memset(aio, 0, sizeof(*aio));
+    aio->fd = -1;
+#if defined(CFG_epoll)
+    aio->idx = idx;
+    aio->gen = gen;
+#endif // defined(CFG_epoll)
 }
 
 
 void aio_set_rdfn (aio_t* aio, aiofn_t rdfn) {
     assert(aio->ctx != NULL && aio->fd >= 0);
     aio->rdfn = rdfn;
+#if defined(CFG_epoll)
+    updateEvents(aio);
+#endif // defined(CFG_epoll)
 }
 
 
 void aio_set_wrfn (aio_t* aio, aiofn_t wrfn) {
     assert(aio->ctx != NULL && aio->fd >= 0);
     aio->wrfn = wrfn;
+#if defined(CFG_epoll)
+    updateEvents(aio);
+#endif // defined(CFG_epoll)
 }
 
 
 #if defined(CFG_timerfd)
-#include <sys/timerfd.h>
+static void armTimerFD (ustime_t deadline) {
+    if( deadline == USTIME_MAX )
+        return;
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = deadline / rt_seconds(1);
+    spec.it_value.tv_nsec = (deadline % rt_seconds(1)) * 1000;
+    if( timerfd_settime(timerFD, TFD_TIMER_ABSTIME, &spec, NULL) == -1 )
+        rt_fatal("timerfd_settime failed: %s", strerror(errno));      // LCOV_EXCL_LINE
+}
 
-static int timerFD;
-#endif // CFG_timerfd
+static void drainTimerFD () {
+    u1_t buf[8];
+    int err;
+    while( (err = read(timerFD, buf, sizeof(buf))) > 0 );
+    if( err != -1 || errno != EAGAIN )
+        rt_fatal("Failed to read timerfd: err=%d %s\n", err, strerror(errno));     // LCOV_EXCL_LINE
+}
+#endif // defined(CFG_timerfd)
+
+
+#if defined(CFG_epoll)
+
+void aio_loop () {
+    struct epoll_event events[N_EPOLL_EVENTS];
+    while(1) {
+        int n;
+        do {
+            armTimerFD(rt_processTimerQ());
+            n = epoll_wait(epollFD, events, N_EPOLL_EVENTS, -1);
+        } while( n == -1 && errno == EINTR );
+        if( n == -1 )
+            rt_fatal("epoll_wait failed: %s", strerror(errno));      // LCOV_EXCL_LINE
+        for( int k=0; k < n; k++ ) {
+            uL_t token = events[k].data.u64;
+            if( token == TIMER_TOKEN ) {
+                drainTimerFD();
+                rt_processTimerQ();
+                continue;
+            }
+            aio_t* aio = aioHandles[(u4_t)token];
+            u4_t gen = token >> 32;
+            u4_t ev = events[k].events;
+            // Errors/hangups are reported like select does - fd becomes readable/writable
+            if( aio->gen == gen && aio->rdfn && (ev & (EPOLLIN|EPOLLERR|EPOLLHUP)) )
+                aio->rdfn(aio);
+            if( aio->gen == gen && aio->wrfn && (ev & (EPOLLOUT|EPOLLERR|EPOLLHUP)) )
+                aio->wrfn(aio);
+        }
+    }
+}
+
+
+void aio_ini () {
+    epollFD = epoll_create1(EPOLL_CLOEXEC);
+    if( epollFD == -1 )
+        rt_fatal("epoll_create1 failed: %s", strerror(errno));      // LCOV_EXCL_LINE
+    timerFD = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC);
+    if( timerFD == -1 )
+        rt_fatal("timerfd_create failed: %s", strerror(errno));      // LCOV_EXCL_LINE
+    struct epoll_event ev = { .events = EPOLLIN, .data.u64 = TIMER_TOKEN };
+    if( epoll_ctl(epollFD, EPOLL_CTL_ADD, timerFD, &ev) == -1 )
+        rt_fatal("epoll_ctl(timerfd) failed: %s", strerror(errno));      // LCOV_EXCL_LINE
+}
 
+#else // !defined(CFG_epoll)
 
 void aio_loop () {
     while(1) {
@@ -115,12 +257,7 @@ void aio_loop () {
 #if defined(CFG_timerfd)
             ustime_t deadline = rt_processTimerQ();
             if( deadline != USTIME_MAX ) {
-                struct itimerspec spec;
-                memset(&spec, 0, sizeof(spec));
-                spec.it_value.tv_sec = deadline / rt_seconds(1);
-                spec.it_value.tv_nsec = (deadline % rt_seconds(1)) * 1000;
-                if( timerfd_settime(timerFD, TFD_TIMER_ABSTIME, &spec, NULL) == -1 )
-                    rt_fatal("timerfd_settime failed: %s", strerror(errno));      // LCOV_EXCL_LINE
+                armTimerFD(deadline);
                 FD_SET(timerFD, &rdset);
                 maxfd = max(maxfd, timerFD);
             }
@@ -133,8 +270,8 @@ void aio_loop () {
                 timeout.tv_usec = ahead % rt_seconds(1);
             }
 #endif // !defined(CFG_timerfd)
-            for( int i=0; i < N_AIO_HANDLES; i++ ) {
-                aio_t* aio = &aioHandles[i];
+            for( int i=0; i < aioCnt; i++ ) {
+                aio_t* aio = aioHandles[i];
                 if( !aio->ctx )
                     continue;
                 int fd = aio->fd;
@@ -146,24 +283,20 @@ void aio_loop () {
         } while( n == -1 && errno == EINTR );
 #if defined(CFG_timerfd)
         if( FD_ISSET(timerFD, &rdset) ) {
-            u1_t buf[8];
-            int err;
-            while( (err = read(timerFD, buf, sizeof(buf))) > 0 );
-            if( err != -1 || errno != EAGAIN )
-                rt_fatal("Failed to read timerfd: err=%d %s\n", err, strerror(errno));     // LCOV_EXCL_LINE
+            drainTimerFD();
             rt_processTimerQ();
             n--;
         }
 #endif // defined(CFG_timerfd)
-        for( int i=0; n > 0 && i < N_AIO_HANDLES; i++ ) {
-            aio_t* aio = &aioHandles[i];
+        for( int i=0; n > 0 && i < aioCnt; i++ ) {
+            aio_t* aio = aioHandles[i];
             if( !aio->ctx )
                 continue;
             if( FD_ISSET(aio->fd, &rdset) && aio->rdfn ) {
                 aio->rdfn(aio);
                 n--;
             }
-            if( FD_ISSET(aio->fd, &wrset) && aio->wrfn ) {
+            if( aio->fd >= 0 && FD_ISSET(aio->fd, &wrset) && aio->wrfn ) {
                 aio->wrfn(aio);
                 n--;
             }
@@ -173,8 +306,6 @@ void aio_loop () {
 
 
 void aio_ini () {
-   for( int i=0; i < N_AIO_HANDLES; i++ )
-       aioHandles[i].fd = -1;
 #if defined(CFG_timerfd)
     timerFD = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC);
     if( timerFD == -1 )
@@ -182,3 +313,4 @@ void aio_ini () {
 #endif // defined(CFG_timerfd)
 }
 
+#endif // !defined(CFG_epoll)
@@ -57,6 +57,7 @@ enum {
     HTTP_SENDING_REQ,
     HTTP_READING_HDR,
     HTTP_READING_BODY,
+    HTTP_CONNECTING,   // resolving host name / TCP connect in progress
 };
 
 enum {
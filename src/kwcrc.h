@@ -13,6 +13,7 @@
 #define J_AU915                ((ujcrc_t)(0xD8599E68))
 #define J_bcning               ((ujcrc_t)(0x1EE5E245))
 #define J_beaconing            ((ujcrc_t)(0x58428CA7))
+#define J_bin_updf             ((ujcrc_t)(0xB79FA16E))
 #define J_cca                  ((ujcrc_t)(0x00636361))
 #define J_CN470                ((ujcrc_t)(0xD75F977D))
 #define J_CN779                ((ujcrc_t)(0xD75E9777))
@@ -40,6 +41,7 @@
 #define J_EU863                ((ujcrc_t)(0xE0529B68))
 #define J_EU868                ((ujcrc_t)(0xE0529B63))
 #define J_euiprefix            ((ujcrc_t)(0x9D5E0C96))
+#define J_expires              ((ujcrc_t)(0xEBF14149))
 #define J_shell                ((ujcrc_t)(0x767A1E0A))
 #define J_cmd                  ((ujcrc_t)(0x0063716A))
 #define J_freq                 ((ujcrc_t)(0x66E0EB00))
@@ -64,6 +66,7 @@
 #define J_log_rotate           ((ujcrc_t)(0x240F1106))
 #define J_log_size             ((ujcrc_t)(0x6453ABB5))
 #define J_max_eirp             ((ujcrc_t)(0x60B4BA83))
+#define J_metrics              ((ujcrc_t)(0xFDF84245))
 #define J_mix_gain             ((ujcrc_t)(0xC7F3BD05))
 #define J_msgid                ((ujcrc_t)(0x66901419))
 #define J_msgtype              ((ujcrc_t)(0xBD07399C))
@@ -115,6 +118,7 @@
 #define J_type                 ((ujcrc_t)(0x74F5FE18))
 #define J_upchannels           ((ujcrc_t)(0x7FCAA9EB))
 #define J_updf                 ((ujcrc_t)(0x75EFDB07))
+#define J_updf_batch           ((ujcrc_t)(0x2A8712BC))
 #define J_upgrade              ((ujcrc_t)(0xF49BF544))
 #define J_uri                  ((ujcrc_t)(0x00757C6E))
 #define J_US902                ((ujcrc_t)(0x061FA968))
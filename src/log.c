@@ -62,6 +62,9 @@ const char* MODSTR[] = {
 #ifndef CFG_logini_lvl
 #define CFG_logini_lvl INFO
 #endif
+#ifndef CFG_logini_rate
+#define CFG_logini_rate 0
+#endif
 
 static char   logline[LOGLINE_LEN];
 static dbuf_t logbuf = { .buf=logline, .bufsize=sizeof(logline), .pos=0 };
@@ -72,16 +75,410 @@ static u1_t   logLevels[32] = {
     CFG_logini_lvl, CFG_logini_lvl, CFG_logini_lvl, CFG_logini_lvl,
     CFG_logini_lvl, CFG_logini_lvl, CFG_logini_lvl, CFG_logini_lvl
 };
+static u2_t       logRates[32] = { [0 ... 31] = CFG_logini_rate };  // msgs/s per call site
+static logsite_t* suppressedSites;
+static tmr_t      summaryTmr;
 
 
-static int log_header (u1_t mod_level) {
+static void fmtHeader (dbuf_t* b, u1_t mod_level, ustime_t utc) {
     int mod = (mod_level & MOD_ALL) >> 3;
-    logbuf.pos = 0;
     str_t mod_s = slaveMod[0] ? slaveMod : mod >= SIZE_ARRAY(MODSTR) ? "???":MODSTR[mod];
-    xprintf(&logbuf, "%.3T [%s:%s] ", rt_getUTC(), mod_s, LVLSTR[mod_level & 7]);
+    xprintf(b, "%.3T [%s:%s] ", utc, mod_s, LVLSTR[mod_level & 7]);
+}
+
+static int log_header (u1_t mod_level) {
+    logbuf.pos = 0;
+    fmtHeader(&logbuf, mod_level, rt_getUTC());
     return logbuf.pos;
 }
 
+
+// --------------------------------------------------------------------------------
+//
+// Log ring
+//
+// Once the log thread runs, log_vmsg does not format on the caller's thread.
+// It stores time, mod_level, format string and raw arguments in a single producer
+// (main thread) / single consumer (log thread) ring. The log thread turns these
+// records into text via log_drainRing - output is the same as formatting right away.
+// Data referenced by arguments (%s/%H/%B) is copied. Records which cannot be
+// captured (%J, large data) are formatted immediately and queued as text.
+//
+// --------------------------------------------------------------------------------
+
+enum { LOGREC_FMT=1, LOGREC_TEXT=2 };
+enum { LOGREC_MAX = 2*LOGLINE_LEN };       // max size of a captured record
+
+typedef struct logrec {
+    u2_t        len;        // record size incl. header - multiple of 8, 0 marks wrap to ring start
+    u1_t        kind;       // LOGREC_x
+    u1_t        mod_level;
+    u2_t        textlen;    // LOGREC_TEXT: length of text following the header
+    ustime_t    utc;        // LOGREC_FMT: time of log call
+    const char* fmt;        // LOGREC_FMT: format string - captured arguments follow the header
+} logrec_t;
+
+// Format element as parsed by vxprintf
+typedef struct logspec {
+    int len;        // chars following the % incl. conversion char
+    int stars;      // number of int arguments consumed by '*'
+    int fracStar;   // index of '*' providing the precision, -1 if none
+    int frac;       // literal precision, -1 if none
+    int lng;        // 'l' modifier present
+} logspec_t;
+
+static u1_t      logringBuf[LOGRING_SIZE] __attribute__((aligned(8)));
+static logring_t logring = { .buf=logringBuf, .size=LOGRING_SIZE };
+static u1_t      ringUp;
+
+
+// Returns conversion char or 0 if vxprintf prints the element verbatim.
+static int parseSpec (const char* fmt, logspec_t* spec) {
+    int inFrac = 0;
+    spec->stars = spec->lng = 0;
+    spec->fracStar = spec->frac = -1;
+    for( int i=0; i < XPRINTF_MAX_FMT; i++ ) {
+        int c = fmt[i];
+        switch(c) {
+        case 0:
+            return 0;
+        case '*':
+            if( inFrac )
+                spec->fracStar = spec->stars;
+            spec->stars += 1;
+            break;
+        case '.':
+            inFrac = 1;
+            break;
+        case '0': case '1': case '2': case '3': case '4':
+        case '5': case '6': case '7': case '8': case '9':
+            if( inFrac )
+                spec->frac = max(0,spec->frac)*10 + c - '0';
+            break;
+        case 'l':
+            spec->lng = 1;
+            break;
+        case 'c': case 'd': case 'u': case 'x': case 'X': case 'f': case 'g': case 's': case 'p':
+        case 'H': case 'B': case 'M': case 'E': case 'T': case 'F': case 'R': case 'J':
+            spec->len = i+1;
+            return c;
+        }
+    }
+    return 0;
+}
+
+static u1_t* putVal (u1_t* p, u1_t* end, uL_t v) {
+    if( p == NULL || p+8 > end )
+        return NULL;
+    memcpy(p, &v, 8);
+    return p+8;
+}
+
+// Length (-1 for NULL) followed by data plus trailing zero - padded to a multiple of 8
+static u1_t* putData (u1_t* p, u1_t* end, const void* d, int n) {
+    p = putVal(p, end, d ? n : -1);
+    if( p == NULL || d == NULL )
+        return p;
+    int sz = (n+1+7) & ~7;
+    if( p+sz > end )
+        return NULL;
+    memcpy(p, d, n);
+    p[n] = 0;
+    return p+sz;
+}
+
+static const u1_t* getVal (const u1_t* p, uL_t* v) {
+    memcpy(v, p, 8);
+    return p+8;
+}
+
+static const u1_t* getData (const u1_t* p, const void** d, int* n) {
+    uL_t v;
+    p = getVal(p, &v);
+    *n = (sL_t)v;
+    if( *n < 0 ) {
+        *d = NULL;
+        return p;
+    }
+    *d = p;
+    return p + ((*n+1+7) & ~7);
+}
+
+// Capture arguments referenced by fmt - returns record size or 0 if not possible.
+static int captureRec (logrec_t* r, u1_t mod_level, const char* fmt, va_list args) {
+    u1_t* p = (u1_t*)(r+1);
+    u1_t* end = (u1_t*)r + LOGREC_MAX;
+    for( const char* f = fmt; *f; f++ ) {
+        if( f[0] != '%' )
+            continue;
+        if( f[1] == '%' ) {
+            f++;
+            continue;
+        }
+        logspec_t spec;
+        int c = parseSpec(f+1, &spec);
+        if( c == 0 ) {
+            if( spec.stars )
+                return 0;   // vxprintf consumes '*' arguments even if element is printed verbatim
+            continue;
+        }
+        if( spec.stars > 2 || c == 'J' )
+            return 0;
+        int sv[2];
+        for( int i=0; i < spec.stars; i++ )
+            p = putVal(p, end, sv[i] = va_arg(args, int));
+        switch(c) {
+        case 'c': case 'd': case 'u': case 'x': case 'X': {
+            p = putVal(p, end, spec.lng ? va_arg(args, uL_t) : (uL_t)va_arg(args, int));
+            break;
+        }
+        case 'p': {
+            p = putVal(p, end, (uL_t)(ptrdiff_t)va_arg(args, void*));
+            break;
+        }
+        case 'f': case 'g': {
+            double d = va_arg(args, double);
+            uL_t v;
+            memcpy(&v, &d, 8);
+            p = putVal(p, end, v);
+            break;
+        }
+        case 's': {
+            const char* s = va_arg(args, const char*);
+            int frac = spec.fracStar >= 0 ? sv[spec.fracStar] : spec.frac;
+            int n = s == NULL ? 0 : frac >= 0 ? strnlen(s, frac) : strlen(s);
+            // Longer strings overflow the log line anyway
+            p = putData(p, end, s, min(n, LOGLINE_LEN));
+            break;
+        }
+        case 'H': case 'B': {
+            int n = va_arg(args, int);
+            const u1_t* d = va_arg(args, const u1_t*);
+            if( n > LOGLINE_LEN )
+                return 0;   // %H may show the tail of the data - keep all of it
+            p = putVal(p, end, n);
+            p = putData(p, end, d, max(0,n));
+            break;
+        }
+        case 'M': case 'E': case 'T': {
+            p = putVal(p, end, va_arg(args, uL_t));
+            break;
+        }
+        case 'F': {
+            p = putVal(p, end, va_arg(args, unsigned));
+            break;
+        }
+        case 'R': {
+            p = putVal(p, end, va_arg(args, int));
+            break;
+        }
+        }
+        if( p == NULL )
+            return 0;
+        f += spec.len;
+    }
+    r->kind = LOGREC_FMT;
+    r->mod_level = mod_level;
+    r->textlen = 0;
+    r->utc = rt_getUTC();
+    r->fmt = fmt;
+    return p - (u1_t*)r;
+}
+
+// Replay captured arguments through xprintf - one format element at a time.
+static void formatRec (dbuf_t* b, const logrec_t* r) {
+    fmtHeader(b, r->mod_level, r->utc);
+    const u1_t* a = (const u1_t*)(r+1);
+    const char* f = r->fmt;
+    while( *f ) {
+        const char* pct = strchr(f, '%');
+        if( pct == NULL ) {
+            xputs(b, f, -1);
+            break;
+        }
+        xputs(b, f, pct-f);
+        f = pct+1;
+        if( f[0] == '%' ) {
+            xputs(b, "%", 1);
+            f++;
+            continue;
+        }
+        logspec_t spec;
+        int c = parseSpec(f, &spec);
+        if( c == 0 ) {
+            xputs(b, "%", 1);
+            continue;
+        }
+        char efmt[XPRINTF_MAX_FMT+2];
+        efmt[0] = '%';
+        memcpy(efmt+1, f, spec.len);
+        efmt[spec.len+1] = 0;
+        f += spec.len;
+        int sv[2] = { 0, 0 };
+        uL_t v;
+        for( int i=0; i < spec.stars; i++ ) {
+            a = getVal(a, &v);
+            sv[i] = (int)v;
+        }
+#define XP(...) (spec.stars == 0 ? xprintf(b, efmt, __VA_ARGS__) :        \
+                 spec.stars == 1 ? xprintf(b, efmt, sv[0], __VA_ARGS__) : \
+                 xprintf(b, efmt, sv[0], sv[1], __VA_ARGS__))
+        switch(c) {
+        case 'c': case 'd': case 'u': case 'x': case 'X': {
+            a = getVal(a, &v);
+            if( spec.lng )
+                XP(v);
+            else
+                XP((int)v);
+            break;
+        }
+        case 'p': {
+            a = getVal(a, &v);
+            XP((void*)(ptrdiff_t)v);
+            break;
+        }
+        case 'f': case 'g': {
+            double d;
+            a = getVal(a, &v);
+            memcpy(&d, &v, 8);
+            XP(d);
+            break;
+        }
+        case 's': {
+            const void* d;
+            int n;
+            a = getData(a, &d, &n);
+            XP((const char*)d);
+            break;
+        }
+        case 'H': case 'B': {
+            const void* d;
+            int n;
+            a = getVal(a, &v);
+            a = getData(a, &d, &n);
+            XP((int)v, (const u1_t*)d);
+            break;
+        }
+        case 'M': case 'E': case 'T': {
+            a = getVal(a, &v);
+            XP(v);
+            break;
+        }
+        case 'F': {
+            a = getVal(a, &v);
+            XP((unsigned)v);
+            break;
+        }
+        case 'R': {
+            a = getVal(a, &v);
+            XP((int)v);
+            break;
+        }
+        }
+#undef XP
+    }
+}
+
+// Reserve space for a record of size n (multiple of 8) - NULL if ring is full.
+static logrec_t* ringReserve (logring_t* ring, int n) {
+    u4_t head = ring->head;
+    u4_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    if( head < tail )
+        return head + n < tail ? (logrec_t*)&ring->buf[head] : NULL;
+    // Never let head catch up with tail - would look like an empty ring
+    if( head + n <= ring->size - (tail == 0 ? 8 : 0) )
+        return (logrec_t*)&ring->buf[head];
+    if( n >= tail )
+        return NULL;
+    ((logrec_t*)&ring->buf[head])->len = 0;  // wrap marker
+    return (logrec_t*)&ring->buf[0];
+}
+
+// Returns number of bytes pending in the ring.
+static int ringCommit (logring_t* ring, logrec_t* r, int n) {
+    r->len = n;
+    u4_t head = (u1_t*)r - ring->buf + n;
+    __atomic_store_n(&ring->head, head == ring->size ? 0 : head, __ATOMIC_RELEASE);
+    u4_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    return (head - tail + ring->size) % ring->size;
+}
+
+int log_ringFmt (logring_t* ring, u1_t mod_level, const char* fmt, va_list args) {
+    union { logrec_t r; u1_t b[LOGREC_MAX]; } rec;
+    va_list ap;
+    va_copy(ap, args);
+    int n = captureRec(&rec.r, mod_level, fmt, ap);
+    va_end(ap);
+    if( n == 0 )
+        return 0;
+    n = (n+7) & ~7;
+    logrec_t* r = ringReserve(ring, n);
+    if( r == NULL )
+        return -1;
+    memcpy(r, &rec, n);
+    return ringCommit(ring, r, n);
+}
+
+int log_ringText (logring_t* ring, const char* line, int len) {
+    len = min(len, ring->size/8);
+    int n = (sizeof(logrec_t) + len + 7) & ~7;
+    logrec_t* r = ringReserve(ring, n);
+    if( r == NULL )
+        return -1;
+    r->kind = LOGREC_TEXT;
+    r->textlen = len;
+    memcpy(r+1, line, len);
+    return ringCommit(ring, r, n);
+}
+
+int log_ringDrain (logring_t* ring, char* buf, int bufsize) {
+    int pos = 0;
+    while(1) {
+        u4_t tail = ring->tail;
+        if( tail == __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) )
+            break;
+        const logrec_t* r = (const logrec_t*)&ring->buf[tail];
+        if( r->len == 0 ) {
+            __atomic_store_n(&ring->tail, 0, __ATOMIC_RELEASE);
+            continue;
+        }
+        if( r->kind == LOGREC_TEXT ) {
+            if( pos + r->textlen > bufsize && pos > 0 )
+                break;
+            int n = min(r->textlen, bufsize-pos);
+            memcpy(buf+pos, r+1, n);
+            pos += n;
+        } else {
+            if( pos + LOGLINE_LEN > bufsize )
+                break;
+            dbuf_t b = { .buf=buf+pos, .bufsize=LOGLINE_LEN, .pos=0 };
+            formatRec(&b, r);
+            xeol(&b);
+            xeos(&b);
+            pos += b.pos;
+        }
+        tail += r->len;
+        __atomic_store_n(&ring->tail, tail == ring->size ? 0 : tail, __ATOMIC_RELEASE);
+    }
+    return pos;
+}
+
+void log_startRing () {
+    ringUp = 1;
+}
+
+int log_addText (const char* line, int len) {
+    int fill = log_ringText(&logring, line, len);
+    if( fill < 0 )
+        return 0;
+    sys_wakeLog(fill);
+    return 1;
+}
+
+int log_drainRing (char* buf, int bufsize) {
+    return log_ringDrain(&logring, buf, bufsize);
+}
+
 int log_str2level (const char* level) {
     if( level[0] >= '0' && level[0] <='7' ) {
         return (level[0]-'0') | MOD_ALL;
@@ -105,6 +502,7 @@ int log_str2level (const char* level) {
     return -1;
 }
 
+// Comma separated list of [MOD:]LEVEL[/RATE]
 str_t log_parseLevels (const char* levels) {
     do {
         int l = log_str2level(levels);
@@ -112,6 +510,14 @@ str_t log_parseLevels (const char* levels) {
             return levels;
         log_setLevel(l);
         str_t s = strchr(levels, ',');
+        str_t r = strchr(levels, '/');
+        if( r != NULL && (s == NULL || r < s) ) {
+            r += 1;
+            sL_t rate = rt_readDec(&r);
+            if( rate < 0 || rate > 0xFFFF || (r[0] != 0 && r[0] != ',') )
+                return levels;
+            log_setRate(l, rate);
+        }
         if( s == NULL )
             return NULL;
         levels = s+1;
@@ -143,9 +549,63 @@ int log_shallLog (u1_t mod_level) {
     return (mod_level&7) >= logLevels[(mod_level & MOD_ALL) >> 3];
 }
 
+void log_setRate (int level, int rate) {
+    int mod = level & MOD_ALL;
+    if( mod == MOD_ALL ) {
+        for( int m=0; m<32; m++ )
+            logRates[m] = rate;
+    } else {
+        logRates[mod>>3] = rate;
+    }
+}
+
+static void log_summary (tmr_t* tmr) {
+    logsite_t* site;
+    while( (site = suppressedSites) != NULL ) {
+        suppressedSites = site->next;
+        site->next = NULL;
+        log_msg(site->mod_level, "Suppressed %u similar messages: %.48s", site->suppressed, site->fmt);
+        site->suppressed = 0;
+    }
+}
+
+// Token bucket per LOG call site - allows bursts of up to rate messages
+// and rate messages per second on average.
+int log_rateOk (logsite_t* site, u1_t mod_level, const char* fmt) {
+    int rate = logRates[(mod_level & MOD_ALL) >> 3];
+    if( rate == 0 )
+        return 1;
+    ustime_t intv = rt_seconds(1) / rate;
+    ustime_t now = rt_getTime();
+    if( site->tat < now )
+        site->tat = now;
+    if( site->tat - now <= rt_seconds(1) - intv ) {
+        site->tat += intv;
+        return 1;
+    }
+    if( site->suppressed++ == 0 ) {
+        site->fmt = fmt;
+        site->mod_level = mod_level;
+        if( suppressedSites == NULL ) {
+            rt_iniTimer(&summaryTmr, log_summary);
+            rt_setTimer(&summaryTmr, rt_seconds_ahead(LOGRATE_SUMMARY));
+        }
+        site->next = suppressedSites;
+        suppressedSites = site;
+    }
+    return 0;
+}
+
 void log_vmsg (u1_t mod_level, const char* fmt, va_list args) {
     if( !log_shallLog(mod_level) )
         return;
+    if( ringUp ) {
+        int fill = log_ringFmt(&logring, mod_level, fmt, args);
+        if( fill > 0 )
+            sys_wakeLog(fill);
+        if( fill != 0 )
+            return;   // queued or ring full - dropped
+    }
     int n = log_header(mod_level);
     logbuf.pos = n;
     vxprintf(&logbuf, fmt, args);
@@ -28,8 +28,6 @@
 
 #include "s2conf.h"
 #include "uj.h"
-#include <time.h>
-#include <sys/time.h>
 
 #define MHDR_FTYPE  0xE0
 #define MHDR_RFU    0x1C
@@ -83,16 +81,206 @@
 uL_t* s2e_joineuiFilter;
 u4_t  s2e_netidFilter[4] = { 0xffFFffFF, 0xffFFffFF, 0xffFFffFF, 0xffFFffFF };
 
-void bin2hex(char* dst, const u1_t* src, int len) {
-    for (int i = 0; i < len; i++)
-        sprintf(dst + i * 2, "%02X", src[i]);
-    dst[len * 2] = '\0';
+// JoinEUI/NetID filters for a well-formed join request/rejoin or data frame.
+// The reason a frame is filtered is written to lbuf (may be NULL).
+static int passesFilters (const u1_t* frame, int ftype, dbuf_t* lbuf) {
+    if( ftype == FRMTYPE_JREQ || ftype == FRMTYPE_REJOIN ) {
+        if( s2e_joineuiFilter[0] == 0 )
+            return 1;
+        uL_t joineui = rt_rlsbf8(&frame[OFF_joineui]);
+        uL_t* f = s2e_joineuiFilter-2;
+        while( *(f += 2) ) {
+            if( joineui >= f[0] && joineui <= f[1] )
+                return 1;
+        }
+        xprintf(lbuf, "Join EUI %E filtered", joineui);
+        return 0;
+    }
+    u4_t devaddr = rt_rlsbf4(&frame[OFF_devaddr]);
+    u1_t netid = devaddr >> (32-7);
+    if( ((1 << (netid & 0x1F)) & s2e_netidFilter[netid>>5]) == 0 ) {
+        xprintf(lbuf, "DevAddr=%X with NetID=%d filtered", devaddr, netid);
+        return 0;
+    }
+    return 1;
+}
+
+// Apply JoinEUI/NetID filters without decoding the frame into JSON.
+// Used for binary uplinks where the LNS parses the PHYPayload itself.
+// Frames not looking like LoRaWAN are passed through as in s2e_parse_lora_frame.
+int s2e_filterLoraFrame (const u1_t* frame, int len) {
+    if( len == 0 )
+        return 0;
+    int ftype = frame[OFF_mhdr] & MHDR_FTYPE;
+    if( (len < OFF_df_minlen && ftype != FRMTYPE_PROP) || (frame[OFF_mhdr] & (MHDR_RFU|MHDR_MAJOR)) != MAJOR_V1 )
+        return 1;
+    if( ftype == FRMTYPE_JREQ || ftype == FRMTYPE_REJOIN ) {
+        if( len != OFF_jreq_len )
+            return 0;
+    }
+    else if( (frame[OFF_fctrl] & 0xF) + OFF_fopts > len-4 ) {
+        return 0;
+    }
+    char msg[64];
+    dbuf_t lbuf = dbuf_ini(msg);
+    if( !passesFilters(frame, ftype, &lbuf) ) {
+        LOG(MOD_S2E|DEBUG, "%.*s", lbuf.pos, lbuf.buf);
+        return 0;
+    }
+    return 1;
+}
+
+// --------------------------------------------------------------------------------
+// Sensor frames (not LoRaWAN)
+//   0x01 DevEUI(8,msbf) 0x41 FCnt(4,msbf) followed by tagged values
+// Each tag is described by an entry in sftags[]. Fixed size values directly
+// follow the tag byte, variable size values (size=0) are preceded by a length byte.
+// Bounds are checked once in sf_decode - decoders can trust vlen.
+// Tags without a decoder are status values. A run of consecutive status values
+// is reported in table order once the run ends.
+// The JSON produced is consumed by existing LNS back ends - keep it stable.
+// --------------------------------------------------------------------------------
+
+enum { SF_HDRLEN = 14 };
+
+typedef struct sftag sftag_t;
+typedef void (*sfdec_t) (ujbuf_t* buf, const u1_t* v, int vlen, dbuf_t* lbuf);
+
+struct sftag {
+    u1_t    tag;
+    u1_t    size;     // value length - 0 if variable
+    u1_t    minlen;   // min length of a variable size value
+    str_t   key;
+    sfdec_t dec;      // NULL: status value - unsigned integer, most significant byte first
+};
+
+static const char HEXDIGITS[] = "0123456789ABCDEF";
+
+static u4_t sf_rmsbf (const u1_t* p, int n) {
+    u4_t v = 0;
+    while( n-- > 0 )
+        v = (v<<8) | *p++;
+    return v;
+}
+
+// GNSS scan: timestamp(4,lsbf) status(4,msbf) raw GNSS data
+static void sf_gnss (ujbuf_t* buf, const u1_t* v, int vlen, dbuf_t* lbuf) {
+    u4_t ts = rt_rlsbf4(v);
+    u4_t status = sf_rmsbf(v+4, 4);
+    uj_encKVn(buf,
+              "GNSS_TS",     'i', (int)ts,
+              "GNSS_Status", 'i', (int)status,
+              "GNSS",        'H', vlen-8, v+8,
+              NULL);
+    xprintf(lbuf, " GNSS ts=%u status=0x%08X len=%d", ts, status, vlen-8);
+}
+
+// WiFi scan: timestamp(4,lsbf) followed by 8 byte entries - byte 1 is not part of the MAC.
+// MACs are reported as a string holding a JSON array.
+static void sf_wifi (ujbuf_t* buf, const u1_t* v, int vlen, dbuf_t* lbuf) {
+    u4_t ts = rt_rlsbf4(v);
+    int n = (vlen-4) / 8;
+    char macs[2 + 255/8*(2+7*3)];
+    char* p = macs;
+    *p++ = '[';
+    for( int i=0; i<n; i++ ) {
+        const u1_t* e = v + 4 + i*8;
+        if( i > 0 )
+            *p++ = ',';
+        *p++ = '"';
+        for( int j=0; j<8; j++ ) {
+            if( j == 1 )
+                continue;
+            *p++ = HEXDIGITS[e[j]>>4];
+            *p++ = HEXDIGITS[e[j]&0xF];
+            *p++ = ':';
+        }
+        p[-1] = '"';
+    }
+    *p++ = ']';
+    *p = 0;
+    uj_encKVn(buf,
+              "WiFi_TS",   'i', (int)ts,
+              "WiFi_MACs", 's', macs,
+              NULL);
+    xprintf(lbuf, " WiFi ts=%u macs=%d", ts, n);
+}
+
+static const sftag_t sftags[] = {
+    { 0x10, 2, 0, "Batt",    NULL },
+    { 0x11, 4, 0, "Ener",    NULL },
+    { 0x12, 4, 0, "Charge ", NULL },
+    { 0x30, 1, 0, "Flags",   NULL },
+    { 0x40, 3, 0, "Resets",  NULL },
+    { 0x50, 1, 0, "Temp",    NULL },
+    { 0x61, 0, 8, "GNSS",    sf_gnss },
+    { 0x62, 0, 4, "WiFi",    sf_wifi },
+};
+
+static int sf_isSensorFrame (const u1_t* frame, int len) {
+    return len >= SF_HDRLEN && frame[0] == 0x01 && frame[9] == 0x41;
+}
+
+static void sf_flushStatus (ujbuf_t* buf, const u4_t* stv, u2_t* stmask, dbuf_t* lbuf) {
+    for( int i=0; *stmask; i++ ) {
+        if( (*stmask & (1<<i)) == 0 )
+            continue;
+        *stmask &= ~(1<<i);
+        uj_encKV(buf, sftags[i].key, 'i', (int)stv[i]);
+        xprintf(lbuf, " %s=%u", sftags[i].key, stv[i]);
+    }
+}
+
+static int sf_decode (ujbuf_t* buf, const u1_t* frame, int len, dbuf_t* lbuf) {
+    uL_t deveui = ((uL_t)sf_rmsbf(&frame[1], 4) << 32) | sf_rmsbf(&frame[5], 4);
+    u4_t fcnt = sf_rmsbf(&frame[10], 4);
+    uj_encKVn(buf,
+              "DevEUI",  'E', deveui,
+              "FCnt",    'i', (int)fcnt,
+              "payload", 'H', len, frame,
+              "msgtype", 's', "lora",
+              NULL);
+    xprintf(lbuf, "Sensor frame DevEUI=%:E FCnt=%u", deveui, fcnt);
+
+    u4_t stv[SIZE_ARRAY(sftags)];
+    u2_t stmask = 0;
+    int off = SF_HDRLEN;
+    while( off < len ) {
+        const sftag_t* t = NULL;
+        for( int i=0; i < SIZE_ARRAY(sftags); i++ ) {
+            if( sftags[i].tag == frame[off] ) {
+                t = &sftags[i];
+                break;
+            }
+        }
+        if( t == NULL ) {
+            // Length of an unknown value is not known - cannot continue
+            xprintf(lbuf, " - unknown tag 0x%02X at %d", frame[off], off);
+            break;
+        }
+        int voff = off+1;
+        int vlen = t->size;
+        if( vlen == 0 )
+            vlen = voff < len ? frame[voff++] : -1;
+        if( vlen < t->minlen || voff + vlen > len ) {
+            xprintf(lbuf, " - %s value exceeds frame (%d bytes at %d)", t->key, vlen, voff);
+            return 0;
+        }
+        if( t->dec == NULL ) {
+            stv[t - sftags] = sf_rmsbf(&frame[voff], vlen);
+            stmask |= 1 << (t - sftags);
+        } else {
+            sf_flushStatus(buf, stv, &stmask, lbuf);
+            t->dec(buf, &frame[voff], vlen, lbuf);
+        }
+        off = voff + vlen;
+    }
+    sf_flushStatus(buf, stv, &stmask, lbuf);
+    return 1;
 }
 
-int s2e_parse_lora_frame (ujbuf_t* buf, const u1_t* frame , int len, dbuf_t* lbuf, bool* is_lorawan) {
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
 
+int s2e_parse_lora_frame (ujbuf_t* buf, const u1_t* frame , int len, dbuf_t* lbuf, bool* is_lorawan) {
     if( len == 0 ) {
     badframe:
         LOG(MOD_S2E|DEBUG, "Not a frame: %16.4H", len, frame);
@@ -101,188 +289,9 @@ int s2e_parse_lora_frame (ujbuf_t* buf, const u1_t* frame , int len, dbuf_t* lbu
     int ftype = frame[OFF_mhdr] & MHDR_FTYPE;
     // ------------------ TRAMAS NO LORAWAN ---------------------
     // ------------------ Tramas con encabezado ---------------------
-    if (len >= 14 && frame[0] == 0x01 && frame[9] == 0x41) {
-        uL_t deveui =
-            ((uL_t)frame[1] << 56) | ((uL_t)frame[2] << 48) | ((uL_t)frame[3] << 40) | ((uL_t)frame[4] << 32) |
-            ((uL_t)frame[5] << 24) | ((uL_t)frame[6] << 16) | ((uL_t)frame[7] << 8)  | (uL_t)frame[8];
-
-        // FCnt (4 bytes big-endian)
-        u4_t fcnt =
-            ((u4_t)frame[10] << 24) | ((u4_t)frame[11] << 16) | ((u4_t)frame[12] << 8) | (u4_t)frame[13];
-
-        
-        uj_encKV(buf, "DevEUI", 'E', deveui);
-        uj_encKV(buf, "FCnt", 'i', fcnt);
-        uj_encKV(buf, "payload", 'H', len, frame);
-        uj_encKV(buf, "msgtype", 's', "lora");
-        u1_t off    = 14;
-
-        while (off < len) {
-            u1_t code = frame[off];
-
-            if (code == 0x61 && off + 2 < len) { // GNSS
-                u1_t size = frame[off + 1];
-                if (off + 2 + size > len) {
-                    xprintf(lbuf, "Error: tamaño de GNSS fuera de rango");
-                    return 0;
-                }
-
-                // Timestamp (little endian)
-                u4_t ts = frame[off + 2] | (frame[off + 3] << 8) | (frame[off + 4] << 16) | (frame[off + 5] << 24);
-                u4_t status = (frame[off + 6] << 24) | (frame[off + 7] << 16) | (frame[off + 8] << 8) | frame[off + 9];
-                u1_t* gnss_payload = &frame[off + 10];
-                u1_t gnss_len = size - 8;   
-
-                uj_encKVn(buf,
-                    "GNSS_TS",     'i', ts,
-                    "GNSS_Status", 'i', status,
-                    "GNSS",        'H', gnss_len, gnss_payload,
-                    NULL
-                );
-
-                xprintf(lbuf, "GNSS: size:%d ts=%u status=0x%08X gnss_len=%d payload=", size, ts, status, gnss_len);
-                for (int j = 0; j < gnss_len; j++) {
-                    xprintf(lbuf, "%02X", gnss_payload[j]);
-                }
-                xprintf(lbuf, "\n");
-
-
-                off += 2 + size;
-                *is_lorawan = false;
-                
-            }
-
-            else if (code == 0x62 && off + 2 < len) { // WiFi
-                u1_t size = frame[off + 1];
-                if (off + 2 + size > len) {
-                    xprintf(lbuf, "Error: tamaño de WiFi fuera de rango");
-                    return 0;
-                }
-
-                u4_t ts = frame[off + 2] | (frame[off + 3] << 8) | (frame[off + 4] << 16) | (frame[off + 5] << 24);
-                u1_t* balizas = &frame[off + 6];
-                u1_t mac_count = (size - 4) / 8;
-
-                // Buffer temporal para MACs en formato JSON
-                char macs_buf[512] = {0};
-                char* p = macs_buf;
-                *p++ = '[';
-
-                for (u1_t i = 0; i < mac_count; i++) {
-                    u1_t* mac = &balizas[i * 8];
-                    u1_t clean_mac[7] = {
-                        mac[0], mac[2], mac[3], mac[4], mac[5], mac[6], mac[7]
-                    };
-
-                    if (i > 0) *p++ = ',';
-                    *p++ = '"';
-                    for (int j = 0; j < 7; j++) {
-                        sprintf(p, "%02X", clean_mac[j]);
-                        p += 2;
-                        if (j < 6) *p++ = ':';  // separador de bytes
-                    }
-                    *p++ = '"';
-                }
-                *p++ = ']';
-                *p = '\0';
-
-                uj_encKVn(buf,
-                    "WiFi_TS",    'i', ts,
-                    "WiFi_MACs",  's', macs_buf,
-                    NULL
-                );
-
-                xprintf(lbuf, "WiFi: ts=%u macs=%u\n", ts, mac_count);
-                for (u1_t i = 0; i < mac_count; i++) {
-                    u1_t* mac = &balizas[i * 8];
-                    u1_t clean_mac[7] = {
-                        mac[0], mac[2], mac[3], mac[4], mac[5], mac[6], mac[7]
-                    };
-                    char mac_str[15 + 1];
-                    bin2hex(mac_str, clean_mac, 7);
-                    xprintf(lbuf, "  MAC[%u]: %s\n", i, mac_str);
-                }
-                off += 2 + size;
-            } else { // Si no es GNSS ni WiFi, entonces es un estado
-                u2_t batt = 0;
-                u4_t energy = 0;
-                u4_t carga = 0;
-                u1_t flags = 0;
-                u4_t resets = 0;
-                u1_t temp = 0;
-
-                bool has_batt = false;
-                bool has_energy = false;
-                bool has_carga = false;
-                bool has_flags = false;
-                bool has_resets = false;
-                bool has_temp = false;
-                bool done = false;
-            
-                while (off < len && !done) {
-                    switch (frame[off]) {
-                        case 0x10:  // Batería (2 bytes big-endian)
-                            batt = (frame[off + 1] << 8) | frame[off + 2];
-                            has_batt = true;
-                            off += 3;
-                            break;
-                        case 0x11:  // Energía (4 bytes big-endian)
-                            energy = (frame[off + 1] << 24) | (frame[off + 2] << 16) | (frame[off + 3] << 8) | frame[off + 4];
-                            has_energy = true;
-                            off += 5;
-                            break;
-                        case 0x12:  // Carga (4 bytes big-endian)
-                            carga = (frame[off + 1] << 24) | (frame[off + 2] << 16) | (frame[off + 3] << 8) | frame[off + 4];
-                            has_carga = true;
-                            off += 5;
-                            break;
-                        case 0x30:  // Flags (1 byte
-                            flags = frame[off + 1];
-                            has_flags = true;
-                            off += 2;
-                            break;
-                        case 0x40:  // Resets (3 bytes big-endian)
-                            resets = (frame[off + 1] << 16) | (frame[off + 2] << 8) | frame[off + 3];
-                            has_resets = true;
-                            off += 4;
-                            break;
-                        case 0x50:  // Temperatura (1 byte)
-                            temp = frame[off + 1];
-                            has_temp = true;
-                            off += 2;
-                            break;
-                        default:
-                            done = true; // Salir del bucle si se encuentra un código desconocido
-                    }
-                }
-                u1_t lens = 0;
-                // Armar el objeto JSON dinámicamente
-                
-                if (has_batt)   {uj_encKV(buf, "Batt",          'i', batt);lens += 3;}
-                if (has_energy) {uj_encKV(buf, "Ener",        'i', energy);lens += 5;}
-                if (has_carga)  {uj_encKV(buf, "Charge ",      'i', carga);lens += 5;}
-                if (has_flags)  {uj_encKV(buf, "Flags",        'i', flags);lens += 2;}
-                if (has_resets) {uj_encKV(buf, "Resets",      'i', resets);lens += 4;}
-                if (has_temp)   {uj_encKV(buf, "Temp",          'i', temp);lens += 2;}
-                uj_encKVn(buf, NULL);
-
-                // Convertir payload binario a string hexadecimal para mostrarlo
-                char hex_payload[2 * len + 1];
-                for (int i = 0; i < len; i++) {
-                    sprintf(&hex_payload[i * 2], "%02X", frame[i]);
-                }
-                hex_payload[2 * len] = '\0';
-
-                // Imprimir log con payload incluido
-                xprintf(lbuf, "FRAME LORA: DevEUI=%:E FCnt=%u Batt=%u Ener=%u Charge=%u Flags=0x%02X Resets=%u Temp=%d\n", 
-                        deveui, fcnt, batt, energy, carga, flags, resets, temp);
-              
-
-                *is_lorawan = false;
-                
-            }
-        }
-        return 1;
+    if( sf_isSensorFrame(frame, len) ) {
+        *is_lorawan = false;
+        return sf_decode(buf, frame, len, lbuf);
     }
    
 
@@ -304,19 +313,9 @@ int s2e_parse_lora_frame (ujbuf_t* buf, const u1_t* frame , int len, dbuf_t* lbu
     if( ftype == FRMTYPE_JREQ || ftype == FRMTYPE_REJOIN ) {
         if( len != OFF_jreq_len)
             goto badframe;
-        uL_t joineui = rt_rlsbf8(&frame[OFF_joineui]);
-        
-        if( s2e_joineuiFilter[0] != 0 ) {
-            uL_t* f = s2e_joineuiFilter-2;
-            while( *(f += 2) ) {
-                if( joineui >= f[0] && joineui <= f[1] )
-                    goto out1; 
-            }
-            
-            xprintf(lbuf, "Join EUI %E filtered", joineui);
+        if( !passesFilters(frame, ftype, lbuf) )
             return 0;
-          out1:;
-        }
+        uL_t joineui = rt_rlsbf8(&frame[OFF_joineui]);
         // ---------------------- TRAMAS JOIN ---------------------
         str_t msgtype = (ftype == FRMTYPE_JREQ ? "jreq" : "rejoin");
         u1_t  mhdr = frame[OFF_mhdr];
@@ -340,13 +339,8 @@ int s2e_parse_lora_frame (ujbuf_t* buf, const u1_t* frame , int len, dbuf_t* lbu
     u1_t portoff = foptslen + OFF_fopts;
     if( portoff > len-4  )
         goto badframe;
-    u4_t devaddr = rt_rlsbf4(&frame[OFF_devaddr]);
-    u1_t netid = devaddr >> (32-7);
-    if( ((1 << (netid & 0x1F)) & s2e_netidFilter[netid>>5]) == 0 ) {
-        
-        xprintf(lbuf, "DevAddr=%X with NetID=%d filtered", devaddr, netid);
+    if( !passesFilters(frame, ftype, lbuf) )
         return 0;
-    }
     //--------------------- TRAMAS LORAWAN ---------------------
     /*u1_t  mhdr  = frame[OFF_mhdr];
     u1_t  fctrl = frame[OFF_fctrl];
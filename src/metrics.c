@@ -0,0 +1,148 @@
+/*
+ * --- Revised 3-Clause BSD License ---
+ * Copyright Semtech Corporation 2022. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright notice,
+ *       this list of conditions and the following disclaimer in the documentation
+ *       and/or other materials provided with the distribution.
+ *     * Neither the name of the Semtech corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SEMTECH CORPORATION. BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "s2conf.h"
+#include "tc.h"
+#include "metrics.h"
+
+uL_t metrics_cnt[MET_NCOUNTERS];
+
+static const struct {
+    str_t name;
+    str_t help;
+} COUNTERS[MET_NCOUNTERS] = {
+    [MET_RX_FRAMES   ] = { "rx_frames",      "Frames accepted into RX queue" },
+    [MET_RX_CRCERR   ] = { "rx_crc_errors",  "Frames received with broken CRC" },
+    [MET_RX_DROPPED  ] = { "rx_dropped",     "Frames dropped - out of space or not mappable" },
+    [MET_RX_MIRROR   ] = { "rx_mirrors",     "Mirror frames suppressed" },
+    [MET_UPDF_SENT   ] = { "updf_sent",      "Uplink frames sent to LNS" },
+    [MET_UPDF_NOBUF  ] = { "updf_nobuf",     "Uplink flushes deferred for lack of buffer space" },
+    [MET_TX_STARTED  ] = { "tx_started",     "Frames handed to the radio" },
+    [MET_TX_LATE     ] = { "tx_late",        "Frames which missed their TX start" },
+    [MET_TX_NODC     ] = { "tx_nodc",        "Frames blocked by duty cycle" },
+    [MET_TX_COLLISION] = { "tx_collisions",  "Frames hindered or displaced by overlapping frames" },
+    [MET_TX_NOCA     ] = { "tx_noca",        "Frames not sent because channel was busy" },
+    [MET_TX_FAIL     ] = { "tx_failed",      "Frames the radio layer failed to send" },
+    [MET_TX_DROPPED  ] = { "tx_dropped",     "Frames dropped without alternative TX time or antenna" },
+    [MET_TS_UPDATES  ] = { "timesync_updates",  "MCU/SX130X time syncs processed" },
+    [MET_TS_REJECTED ] = { "timesync_rejected", "MCU/SX130X time syncs rejected for bad quality" },
+    [MET_WS_MSGS_RX  ] = { "ws_msgs_rx",     "Websocket messages received" },
+    [MET_WS_MSGS_TX  ] = { "ws_msgs_tx",     "Websocket messages sent" },
+    [MET_WS_BYTES_RX ] = { "ws_bytes_rx",    "Websocket payload bytes received" },
+    [MET_WS_BYTES_TX ] = { "ws_bytes_tx",    "Websocket payload bytes sent" },
+};
+
+static const struct {
+    str_t name;
+    str_t help;
+    int   scale;    // divide by this for exported unit
+    sL_t  bounds[MET_HBUCKETS];
+} HISTS[MET_NHISTS] = {
+    [MET_H_TXLEAD ] = { "tx_lead_seconds", "TX lead time when handing frame to radio", 1000000,
+                        { 5000, 10000, 15000, 20000, 30000, 50000, 100000, 200000 } },
+    [MET_H_UPDFLAT] = { "updf_latency_seconds", "Delay from radio RX to sending uplink", 1000000,
+                        { 1000, 5000, 10000, 20000, 50000, 100000, 500000, 1000000 } },
+    [MET_H_TSQUAL ] = { "timesync_quality", "MCU/SX130X time sync quality (lower is better)", 1,
+                        { 10, 20, 50, 100, 200, 500, 1000, 5000 } },
+};
+
+static struct {
+    uL_t buckets[MET_HBUCKETS+1];   // last is +Inf
+    sL_t sum;
+} hists[MET_NHISTS];
+
+
+void metric_observe (int hist, sL_t value) {
+    const sL_t* bounds = HISTS[hist].bounds;
+    int i = 0;
+    while( i < MET_HBUCKETS && value > bounds[i] )
+        i++;
+    hists[hist].buckets[i] += 1;
+    hists[hist].sum += value;
+}
+
+
+static void renderValue (dbuf_t* b, str_t name, str_t type, str_t help, sL_t value) {
+    xprintf(b, "# HELP station_%s %s\n# TYPE station_%s %s\nstation_%s %ld\n", name, help, name, type, name, value);
+}
+
+int metrics_render (dbuf_t* b) {
+    for( int m=0; m < MET_NCOUNTERS; m++ ) {
+        xprintf(b, "# HELP station_%s_total %s\n# TYPE station_%s_total counter\nstation_%s_total %lu\n",
+                COUNTERS[m].name, COUNTERS[m].help, COUNTERS[m].name, COUNTERS[m].name, metrics_cnt[m]);
+    }
+    for( int h=0; h < MET_NHISTS; h++ ) {
+        str_t name = HISTS[h].name;
+        double scale = HISTS[h].scale;
+        xprintf(b, "# HELP station_%s %s\n# TYPE station_%s histogram\n", name, HISTS[h].help, name);
+        uL_t cnt = 0;
+        for( int i=0; i <= MET_HBUCKETS; i++ ) {
+            cnt += hists[h].buckets[i];
+            if( i < MET_HBUCKETS )
+                xprintf(b, "station_%s_bucket{le=\"%g\"} %lu\n", name, HISTS[h].bounds[i]/scale, cnt);
+            else
+                xprintf(b, "station_%s_bucket{le=\"+Inf\"} %lu\n", name, cnt);
+        }
+        xprintf(b, "station_%s_sum %g\nstation_%s_count %lu\n", name, hists[h].sum/scale, name, cnt);
+    }
+    // Gauges - sampled now
+    if( TC ) {
+        s2ctx_t* s2ctx = &TC->s2ctx;
+        int txfree = 0;
+        for( txidx_t i = s2ctx->txq.freeJobs; i != TXIDX_END; i = s2ctx->txq.txjobs[i].next )
+            txfree += 1;
+        renderValue(b, "txq_jobs", "gauge", "TX jobs queued", MAX_TXJOBS - txfree);
+        renderValue(b, "rxq_jobs", "gauge", "RX frames waiting to be sent", s2ctx->rxq.next - s2ctx->rxq.first);
+        u2_t rtts[3];
+        if( ws_getRtt(&TC->ws, rtts) > 0 )
+            renderValue(b, "ws_rtt_q90_ms", "gauge", "90% quantile of LNS round trip time", rtts[1]);
+        // Write statistics of the current LNS connection - reset on reconnect
+        ws_t* ws = &TC->ws;
+        renderValue(b, "ws_flushes_total", "counter", "Batches of websocket data handed to the socket", ws->wflushes);
+        renderValue(b, "ws_frames_total",  "counter", "Websocket frames sent", ws->wframes);
+        renderValue(b, "ws_records_total", "counter", "TLS records (or socket writes w/o TLS) sent", ws->wrecords);
+        renderValue(b, "ws_wire_bytes_total", "counter", "Bytes written to the TLS layer (or socket) including WS headers", ws->wbytes);
+        // Duty cycle - only ledgers with airtime in the current window
+        xprintf(b, "# HELP station_dc_usage_permille Duty cycle budget used within DC_WINDOW\n"
+                "# TYPE station_dc_usage_permille gauge\n");
+        static const char* BANDS[DC_NUM_BANDS] = { "deci", "centi", "milli" };
+        for( int u=0; u < MAX_TXUNITS; u++ ) {
+            for( int band=0; band < DC_NUM_BANDS; band++ ) {
+                int usage = s2e_dcUsage(s2ctx, u, -1, band);
+                if( usage > 0 )
+                    xprintf(b, "station_dc_usage_permille{txunit=\"%d\",band=\"%s\"} %d\n", u, BANDS[band], usage);
+            }
+            for( int ch=0; ch <= MAX_DNCHNLS; ch++ ) {
+                int usage = s2e_dcUsage(s2ctx, u, ch, -1);
+                if( usage > 0 )
+                    xprintf(b, "station_dc_usage_permille{txunit=\"%d\",dnchnl=\"%d\"} %d\n", u, ch, usage);
+            }
+        }
+    }
+    return xeos(b);
+}
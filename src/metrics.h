@@ -0,0 +1,76 @@
+/*
+ * --- Revised 3-Clause BSD License ---
+ * Copyright Semtech Corporation 2022. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright notice,
+ *       this list of conditions and the following disclaimer in the documentation
+ *       and/or other materials provided with the distribution.
+ *     * Neither the name of the Semtech corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SEMTECH CORPORATION. BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _metrics_h_
+#define _metrics_h_
+
+#include "rt.h"
+
+// Counters - plain integers updated from the main loop, no locking.
+// Processes other than the station main process (e.g. RAL slaves) have their own copy.
+enum {
+    MET_RX_FRAMES,      // frames accepted into rxq
+    MET_RX_CRCERR,      // frames with broken CRC
+    MET_RX_DROPPED,     // frames dropped - out of space, too large, illegal DR
+    MET_RX_MIRROR,      // mirror frames suppressed
+    MET_UPDF_SENT,      // uplink frames sent to LNS
+    MET_UPDF_NOBUF,     // uplink flush deferred - no websocket buffer space
+    MET_TX_STARTED,     // frames handed to the radio
+    MET_TX_LATE,        // TX start missed
+    MET_TX_NODC,        // no duty cycle budget
+    MET_TX_COLLISION,   // hindered by/displaced due to overlapping frames
+    MET_TX_NOCA,        // channel busy (LBT)
+    MET_TX_FAIL,        // radio layer failed
+    MET_TX_DROPPED,     // no alternative TX time/antenna left
+    MET_TS_UPDATES,     // MCU/SX130X time syncs processed
+    MET_TS_REJECTED,    // time syncs rejected due to bad quality
+    MET_WS_MSGS_RX,
+    MET_WS_MSGS_TX,
+    MET_WS_BYTES_RX,
+    MET_WS_BYTES_TX,
+    MET_NCOUNTERS
+};
+
+// Histograms with fixed buckets
+enum {
+    MET_H_TXLEAD,       // time between handing a frame to the radio and its TX start
+    MET_H_UPDFLAT,      // time between frame retrieval from the radio and sending it to LNS
+    MET_H_TSQUAL,       // MCU/SX130X time sync quality
+    MET_NHISTS
+};
+enum { MET_HBUCKETS = 8 };
+
+extern uL_t metrics_cnt[MET_NCOUNTERS];
+
+#define metric_inc(m)    (metrics_cnt[m] += 1)
+#define metric_add(m,v)  (metrics_cnt[m] += (v))
+
+void metric_observe (int hist, sL_t value);
+int  metrics_render (dbuf_t* b);  // Prometheus text format - 0 if b too small
+
+#endif // _metrics_h_
@@ -27,6 +27,10 @@
  */
 
 
+#include <errno.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
 #include "s2conf.h"
 #include "sys.h"
 #include "uj.h"
@@ -35,6 +39,7 @@
 #include "httpd.h"
 #include "tls.h"
 #include "kwcrc.h"
+#include "metrics.h"
 
 str_t const SUFFIX2CT[] = {
     "txt",  "text/plain",
@@ -330,11 +335,10 @@ enum { WSHDR_FIN    = 0x80,
 };
 
 
-// Write data between wpos..wend
-static int writeData (conn_t* conn) {
+static int writeBuf (conn_t* conn, u1_t* buf, doff_t* pos, doff_t end) {
     int ret;
-    while( conn->wpos < conn->wend ) {
-        if( (ret = tls_write(&conn->netctx, conn->tlsctx, conn->wbuf + conn->wpos, conn->wend - conn->wpos) ) <= 0 ) {
+    while( *pos < end ) {
+        if( (ret = tls_write(&conn->netctx, conn->tlsctx, buf + *pos, end - *pos) ) <= 0 ) {
             if( ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE ) {
                 log_mbedError(MOD_AIO|ERROR, ret, "[%d] Send failed", conn->netctx.fd);
                 return IO_ERROR;
@@ -342,11 +346,22 @@ static int writeData (conn_t* conn) {
             return IO_WRPEND;
         }
         LOG(MOD_AIO|XDEBUG, "[%d] socket write bytes=%d", conn->netctx.fd, ret);
-        conn->wpos += ret;
+        *pos += ret;
+        conn->wrecords += 1;
+        conn->wbytes += ret;
     }
     return IO_WRDONE;
 }
 
+// Write data between cpos..cend (coalesced frames) and wpos..wend
+static int writeData (conn_t* conn) {
+    int e = writeBuf(conn, conn->cbuf, &conn->cpos, conn->cend);
+    if( e != IO_WRDONE )
+        return e;
+    conn->cpos = conn->cend = 0;
+    return writeBuf(conn, conn->wbuf, &conn->wpos, conn->wend);
+}
+
 
 enum { WS_FRAME, HTTP_HDR, HTTP_BODY };
 // Fill in data from rpos..rbufsize
@@ -445,6 +460,221 @@ void conn_evcb_nil (conn_t* conn, int ev) {
 }
 
 
+// --------------------------------------------------------------------------------
+//
+// Asynchronous TCP connect
+//
+// Names are resolved on a helper thread (sys_resolve). Connect attempts are
+// non-blocking and completion is signaled by AIO write readiness. Addresses
+// are tried with interleaved address families and if an attempt does not
+// complete within TCP_CONNECT_STAGGER the next address is raced against it
+// (happy eyeballs, RFC 8305). The first attempt to complete wins.
+//
+// --------------------------------------------------------------------------------
+
+#define MAX_CONNECT_ADDRS    16
+#define MAX_CONNECT_ATTEMPTS  4
+
+struct connector;
+
+typedef struct connattempt {
+    struct connector* ctor;
+    aio_t*            aio;      // NULL if slot unused
+    ustime_t          started;
+} connattempt_t;
+
+typedef struct connector {
+    conn_t*          conn;
+    connectcb_t      donefn;
+    void*            resjob;    // pending name resolution
+    struct addrinfo* res;
+    struct addrinfo* addrs[MAX_CONNECT_ADDRS];  // interleaved by address family
+    u1_t             naddrs;
+    u1_t             nextAddr;
+    u1_t             active;    // attempts in progress
+    ustime_t         lastStart;
+    tmr_t            tmr;
+    connattempt_t    attempts[MAX_CONNECT_ATTEMPTS];
+} connector_t;
+
+static void connector_check (connector_t* ctor);
+
+
+static void connector_closeAttempt (connattempt_t* att) {
+    if( att->aio == NULL )
+        return;
+    aio_close(att->aio);
+    att->aio = NULL;
+    att->ctor->active -= 1;
+}
+
+
+static void connector_free (connector_t* ctor) {
+    sys_cancelResolve(ctor->resjob);
+    for( int i=0; i < MAX_CONNECT_ATTEMPTS; i++ )
+        connector_closeAttempt(&ctor->attempts[i]);
+    if( ctor->res )
+        freeaddrinfo(ctor->res);
+    rt_clrTimer(&ctor->tmr);
+    ctor->conn->connector = NULL;
+    rt_free(ctor);
+}
+
+
+static void connector_done (connector_t* ctor, int fd) {
+    conn_t* conn = ctor->conn;
+    connectcb_t donefn = ctor->donefn;
+    connector_free(ctor);
+    donefn(conn, fd);
+}
+
+
+static void connector_attempt_w (aio_t* aio) {
+    connattempt_t* att = aio->ctx;
+    connector_t* ctor = att->ctor;
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if( getsockopt(aio->fd, SOL_SOCKET, SO_ERROR, &err, &len) == -1 )
+        err = errno;
+    if( err == EINPROGRESS )
+        return;
+    if( err != 0 ) {
+        LOG(MOD_AIO|VERBOSE, "[%d] TCP connect attempt failed: %s", aio->fd, strerror(err));
+        connector_closeAttempt(att);
+        connector_check(ctor);
+        return;
+    }
+    // Winner - detach socket from attempt since aio_close closes the fd
+    int fd = dup(aio->fd);
+    if( fd == -1 ) {
+        LOG(MOD_AIO|ERROR, "[%d] Failed to take over connected socket: %s", aio->fd, strerror(errno));
+        connector_closeAttempt(att);
+        connector_check(ctor);
+        return;
+    }
+    LOG(MOD_AIO|DEBUG, "[%d] TCP connected after %~T", fd, rt_getTime() - att->started);
+    connector_done(ctor, fd);
+}
+
+
+// Start a connect attempt to the next address - returns 0 if none left
+static int connector_start (connector_t* ctor) {
+    connattempt_t* att = NULL;
+    for( int i=0; i < MAX_CONNECT_ATTEMPTS; i++ ) {
+        if( ctor->attempts[i].aio == NULL ) {
+            att = &ctor->attempts[i];
+            break;
+        }
+    }
+    if( att == NULL )
+        return 0;
+    while( ctor->nextAddr < ctor->naddrs ) {
+        struct addrinfo* ai = ctor->addrs[ctor->nextAddr++];
+        int fd = socket(ai->ai_family, ai->ai_socktype|SOCK_NONBLOCK|SOCK_CLOEXEC, ai->ai_protocol);
+        if( fd == -1 ) {
+            LOG(MOD_AIO|VERBOSE, "Failed to create socket (family=%d): %s", ai->ai_family, strerror(errno));
+            continue;
+        }
+        if( connect(fd, ai->ai_addr, ai->ai_addrlen) == -1 && errno != EINPROGRESS ) {
+            LOG(MOD_AIO|VERBOSE, "[%d] TCP connect failed: %s", fd, strerror(errno));
+            close(fd);
+            continue;
+        }
+        att->ctor = ctor;
+        att->started = ctor->lastStart = rt_getTime();
+        att->aio = aio_open(att, fd, NULL, connector_attempt_w);
+        ctor->active += 1;
+        return 1;
+    }
+    return 0;
+}
+
+
+// Expire stale attempts, start more if due and decide when to look again
+static void connector_check (connector_t* ctor) {
+    ustime_t now = rt_getTime();
+    for( int i=0; i < MAX_CONNECT_ATTEMPTS; i++ ) {
+        connattempt_t* att = &ctor->attempts[i];
+        if( att->aio && now - att->started >= TCP_CONNECT_TIMEOUT ) {
+            LOG(MOD_AIO|VERBOSE, "[%d] TCP connect attempt timed out", att->aio->fd);
+            connector_closeAttempt(att);
+        }
+    }
+    if( ctor->active == 0 || now - ctor->lastStart >= TCP_CONNECT_STAGGER )
+        connector_start(ctor);
+    if( ctor->active == 0 ) {
+        LOG(MOD_AIO|ERROR, "TCP connect failed - no more addresses to try");
+        connector_done(ctor, -1);
+        return;
+    }
+    ustime_t next = USTIME_MAX;
+    for( int i=0; i < MAX_CONNECT_ATTEMPTS; i++ ) {
+        if( ctor->attempts[i].aio )
+            next = min(next, ctor->attempts[i].started + TCP_CONNECT_TIMEOUT);
+    }
+    if( ctor->nextAddr < ctor->naddrs && ctor->active < MAX_CONNECT_ATTEMPTS )
+        next = min(next, ctor->lastStart + TCP_CONNECT_STAGGER);
+    rt_setTimer(&ctor->tmr, next);
+}
+
+
+static void connector_timeout (tmr_t* tmr) {
+    connector_check(memberof(connector_t, tmr, tmr));
+}
+
+
+static void connector_resolved (void* ctx, struct addrinfo* res, int err) {
+    connector_t* ctor = ctx;
+    ctor->resjob = NULL;
+    if( err != 0 ) {
+        LOG(MOD_AIO|ERROR, "Failed to resolve '%s': %s", ctor->conn->host, gai_strerror(err));
+        connector_done(ctor, -1);
+        return;
+    }
+    ctor->res = res;
+    // Alternate address families starting with the one preferred by the resolver
+    struct addrinfo* pref[MAX_CONNECT_ADDRS];
+    struct addrinfo* other[MAX_CONNECT_ADDRS];
+    int np = 0, no = 0;
+    for( struct addrinfo* ai = res; ai; ai = ai->ai_next ) {
+        if( ai->ai_family == res->ai_family ) {
+            if( np < MAX_CONNECT_ADDRS ) pref[np++] = ai;
+        } else {
+            if( no < MAX_CONNECT_ADDRS ) other[no++] = ai;
+        }
+    }
+    for( int i=0; ctor->naddrs < MAX_CONNECT_ADDRS && (i < np || i < no); i++ ) {
+        if( i < np ) ctor->addrs[ctor->naddrs++] = pref[i];
+        if( i < no && ctor->naddrs < MAX_CONNECT_ADDRS ) ctor->addrs[ctor->naddrs++] = other[i];
+    }
+    connector_check(ctor);
+}
+
+
+// Resolve host and connect - donefn is called with the connected non-blocking socket or -1.
+// Returns 0 if resolving could not be started.
+static int conn_connect (conn_t* conn, connectcb_t donefn) {
+    assert(conn->connector == NULL);
+    connector_t* ctor = rt_malloc(connector_t);
+    ctor->conn = conn;
+    ctor->donefn = donefn;
+    rt_iniTimer(&ctor->tmr, connector_timeout);
+    conn->connector = ctor;
+    if( (ctor->resjob = sys_resolve(conn->host, conn->port, connector_resolved, ctor)) == NULL ) {
+        connector_free(ctor);
+        return 0;
+    }
+    return 1;
+}
+
+
+// Abandon pending connect - donefn is not called
+static void conn_stopConnect (conn_t* conn) {
+    if( conn->connector )
+        connector_free(conn->connector);
+}
+
+
 static void triggerWsClosedEv(tmr_t* tmr) {
     ws_t* conn = tmr2ws(tmr);
     evcb_t evcb = conn->evcb;
@@ -455,23 +685,30 @@ static void triggerWsClosedEv(tmr_t* tmr) {
 
 void ws_shutdown (ws_t* conn) {
     LOG(MOD_AIO|DEBUG, "[%d] WS connection shutdown...", conn->netctx.fd);
+    conn_stopConnect(conn);
     mbedtls_net_free(&conn->netctx);
     rt_free(conn->rbuf);
     rt_free(conn->wbuf);
+    rt_free(conn->cbuf);
     conn->rbuf = NULL;
     conn->wbuf = NULL;
+    conn->cbuf = NULL;
+    conn->cpos = conn->cend = 0;
     rt_free((void*)conn->authtoken);
     conn->authtoken = NULL;
     tls_freeSession(conn->tlsctx); conn->tlsctx = NULL;
     tls_freeConf(conn->tlsconf); conn->tlsconf = NULL;
     aio_close(conn->aio);
     rt_clrTimer(&conn->tmr);
+    rt_clrTimer(&conn->pingtmr);
     conn->aio = NULL;
     conn->state = WS_CLOSED;
     rt_yieldTo(&conn->tmr, triggerWsClosedEv);
 }
 
 
+static int ws_frameHeader (u1_t* p, u1_t ftype, u2_t dlen);
+
 static void ws_closing_w (aio_t* aio) {
     ws_t* conn = (ws_t*)aio->ctx;
     assert(conn->state >= WS_CLOSING_DRAINC);
@@ -486,14 +723,11 @@ static void ws_closing_w (aio_t* aio) {
         return;
     assert(e==IO_WRDONE);
     if( conn->state == WS_CLOSING_DRAINC || conn->state == WS_CLOSING_DRAINS ) {
-        conn->wpos = 0;
+        u1_t* p = conn->wbuf + 6;
+        conn->wpos = 6 - ws_frameHeader(p, WSHDR_CLOSE, 2);
         conn->wend = conn->wfill = 8;
-        u1_t* p = conn->wbuf;
-        p[0] = WSHDR_FIN | WSHDR_CLOSE;
-        p[1] = 2 | WSHDR_MASK;
-        p[2] = p[3] = p[4] = p[5] = 0;
-        p[6] = conn->creason>>8;
-        p[7] = conn->creason;
+        p[0] = (conn->creason>>8) ^ 1;  // masked like all other frames
+        p[1] = conn->creason ^ 1;
         conn->state += WS_CLOSING_SENDCLOSE - WS_CLOSING_DRAINC;
         LOG(MOD_AIO|DEBUG, "%s close - reason=%d",
             conn->state == WS_CLOSING_DRAINC ? "Initiating" : "Echoing", conn->creason);
@@ -508,13 +742,77 @@ static void ws_closing_w (aio_t* aio) {
 }
 
 
+// Fill in WS header for a frame with dlen bytes of data ending at p.
+// Returns length of header.
+static int ws_frameHeader (u1_t* p, u1_t ftype, u2_t dlen) {
+    if( dlen < WSHDR_LEN2 ) {
+        p[-6] = WSHDR_FIN|ftype;
+        p[-5] = dlen | WSHDR_MASK;
+        p[-4] = p[-3] = p[-2] = p[-1] = 1;  // Masking value
+        return 6;
+    }
+    p[-8] = WSHDR_FIN|ftype;
+    p[-7] = WSHDR_LEN2 | WSHDR_MASK;
+    p[-6] = dlen>>8;
+    p[-5] = dlen;
+    p[-4] = p[-3] = p[-2] = p[-1] = 1;  // Masking value
+    return 8;
+}
+
+// Copy as many queued frames as fit into cbuf so they leave in one TLS record.
+// Headers of in-place frames overlay the tail of the preceding frame - therefore
+// only one frame can be written at a time directly from wbuf.
+// Returns 0 if less than two frames are pending - caller sends in place.
+static int ws_coalesce (ws_t* conn) {
+    if( conn->cbuf == NULL )
+        return 0;
+    u1_t* wbuf = conn->wbuf;
+    int limit = min(WS_COALESCE_SIZE, conn->wbufsize);
+    int total = 0, nframes = 0;
+    doff_t wend = conn->wend;
+    while( wend < conn->wfill ) {
+        u2_t dlen = rt_rmsbf2(wbuf + wend);
+        int n = (dlen < WSHDR_LEN2 ? 6 : 8) + dlen;
+        if( total + n > limit )
+            break;
+        total += n;
+        nframes += 1;
+        wend += WSHDR_INTRA + dlen;
+    }
+    if( nframes < 2 )
+        return 0;
+    u1_t* cbuf = conn->cbuf;
+    doff_t cend = 0;
+    wend = conn->wend;
+    for( int k=0; k < nframes; k++ ) {
+        u2_t dlen = rt_rmsbf2(wbuf + wend);
+        u1_t ftype = wbuf[wend+2];  // WSHDR_TEXT | WSHDR_BINARY | WSHDR_PING | WSHDR_PONG
+        wend += WSHDR_INTRA;
+        cend += (dlen < WSHDR_LEN2 ? 6 : 8);
+        ws_frameHeader(cbuf + cend, ftype, dlen);
+        for( int i=0; i<dlen; i++ )
+            cbuf[cend+i] = wbuf[wend+i] ^ 1;
+        cend += dlen;
+        wend += dlen;
+    }
+    assert(cend == total);
+    conn->cpos = 0;
+    conn->cend = cend;
+    conn->wpos = conn->wend = wend;
+    conn->wframes += nframes;
+    LOG(MOD_AIO|XDEBUG, "[%d] Coalesced %d frames (%d bytes) - flushes=%u frames=%u records=%u bytes=%lu",
+        conn->netctx.fd, nframes, cend, conn->wflushes, conn->wframes, conn->wrecords, conn->wbytes);
+    return 1;
+}
+
+
 static void ws_connected_w (aio_t* aio) {
     ws_t* conn = (ws_t*)aio->ctx;
     assert(conn->state == WS_CONNECTED);
     // LOG(MOD_AIO|XDEBUG, "[%d] ws_connected_w state=%d", conn->netctx.fd, conn->state);
     int e;
   again:
-    if( conn->wpos < conn->wend ) {
+    if( conn->cpos < conn->cend || conn->wpos < conn->wend ) {
         if( (e = writeData(conn)) == IO_ERROR ) {
             ws_shutdown(conn);
             return;
@@ -531,33 +829,38 @@ static void ws_connected_w (aio_t* aio) {
         aio_set_wrfn(conn->aio, NULL);
         return;
     }
-    // Setup next frame
+    conn->wflushes += 1;
+    if( ws_coalesce(conn) )
+        goto again;
+    // Setup next frame - write in place
+    conn->wframes += 1;
     u1_t* wbuf = conn->wbuf;
     u2_t dlen = rt_rmsbf2(wbuf + wend);
-    u1_t ftype = wbuf[wend+2];  // WSHDR_TEXT | WSHDR_BINARY
+    u1_t ftype = wbuf[wend+2];  // WSHDR_TEXT | WSHDR_BINARY | WSHDR_PING | WSHDR_PONG
     wend += WSHDR_INTRA;
-    if( dlen < WSHDR_LEN2 ) {
-        // short WS header
-        wbuf[wend-6] = WSHDR_FIN|ftype;
-        wbuf[wend-5] = dlen | WSHDR_MASK;
-        conn->wpos = wend-6;
-    } else {
-        // medium WS head (note we have WSHDR_WRESV reserve at the start of wbuf)
-        wbuf[wend-8] = WSHDR_FIN|ftype;
-        wbuf[wend-7] = WSHDR_LEN2 | WSHDR_MASK;
-        wbuf[wend-6] = dlen>>8;
-        wbuf[wend-5] = dlen;
-        conn->wpos = wend-8;
-    }
+    // Short or medium WS header (note we have WSHDR_RESV_W reserve at the start of wbuf)
+    conn->wpos = wend - ws_frameHeader(wbuf + wend, ftype, dlen);
     conn->wend = wend + dlen;
-    // Masking value - 0
-    wbuf[wend-4] =  wbuf[wend-3] = wbuf[wend-2] = wbuf[wend-1] = 1;
     for( int i=0; i<dlen; i++ )
         wbuf[wend+i] ^= 1;
     goto again;
 }
 
 
+// Queue a data, PING or PONG frame of type ftype. Only the intra header is written
+// here - ws_connected_w/ws_coalesce turn it into a WS header via ws_frameHeader.
+static void ws_queueFrame (ws_t* conn, dbuf_t* b, u1_t ftype) {
+    int n = b->pos;
+    b->buf[0-WSHDR_INTRA] = n>>8;
+    b->buf[1-WSHDR_INTRA] = n;
+    b->buf[2-WSHDR_INTRA] = ftype;
+    conn->wfill += n+WSHDR_INTRA;
+    b->buf = NULL;
+    b->pos = b->bufsize = 0;
+    aio_set_wrfn(conn->aio, ws_connected_w);
+}
+
+
 static void ws_connected_r (aio_t* aio) {
     ws_t* conn = (ws_t*)aio->ctx;
     assert(conn->state >= WS_CONNECTED);  // also called during close
@@ -582,17 +885,21 @@ static void ws_connected_r (aio_t* aio) {
             LOG(MOD_AIO|WARNING, "[%d] Cannot respond to PING message of length %d", conn->netctx.fd, plen);
             break;
         }
-        wbuf.buf[0-WSHDR_INTRA] = plen>>8;
-        wbuf.buf[1-WSHDR_INTRA] = plen;
-        wbuf.buf[2-WSHDR_INTRA] = WSHDR_PONG;
-        conn->wfill += plen+WSHDR_INTRA;
         memcpy(wbuf.buf, p, plen);
-        aio_set_wrfn(conn->aio, ws_connected_w);
+        wbuf.pos = plen;
+        ws_queueFrame(conn, &wbuf, WSHDR_PONG);
         LOG(MOD_AIO|XDEBUG, "[%d|WS] > PONG", conn->netctx.fd);
         break;
     }
     case WSHDR_PONG: {
-        LOG(MOD_AIO|XDEBUG, "[%d|WS] Ignoring incoming WS PONG", conn->netctx.fd);
+        int plen = conn->rend-conn->rbeg;
+        if( plen != 8 ) {
+            LOG(MOD_AIO|XDEBUG, "[%d|WS] Ignoring incoming WS PONG", conn->netctx.fd);
+            break;
+        }
+        ustime_t rtt = rt_getTime() - (ustime_t)rt_rlsbf8(p);
+        LOG(MOD_AIO|XDEBUG, "[%d|WS] < PONG rtt=%~T", conn->netctx.fd, rtt);
+        ws_addRtt(conn, rtt);
         break;
     }
     case WSHDR_TEXT: {
@@ -602,12 +909,16 @@ static void ws_connected_r (aio_t* aio) {
             LOG(MOD_AIO|XDEBUG, "[%d|WS] %c %.*s", conn->netctx.fd, offset ? '.' : '<', min((LOGLINE_LEN-50),plen-offset), p+offset);
             offset += (LOGLINE_LEN-50);
         }
+        metric_inc(MET_WS_MSGS_RX);
+        metric_add(MET_WS_BYTES_RX, plen);
         conn->evcb(conn, WSEV_TEXTRCVD);
         if( conn->aio == NULL )
             return;
         break;
     }
     case WSHDR_BINARY: {
+        metric_inc(MET_WS_MSGS_RX);
+        metric_add(MET_WS_BYTES_RX, conn->rend - conn->rbeg);
         conn->evcb(conn, WSEV_BINARYRCVD);
         if( conn->aio == NULL )
             return;
@@ -652,6 +963,7 @@ void ws_close (ws_t* conn, int reason) {
 
 
 static void ws_connecting (aio_t* aio);
+static void ws_pingtimeout (tmr_t* tmr);
 
 static void ws_handshaking (aio_t* aio) {
     ws_t* conn = (ws_t*)aio->ctx;
@@ -666,6 +978,8 @@ static void ws_handshaking (aio_t* aio) {
             assert(conn->rbuf == NULL && conn->wbuf == NULL);
             conn->rbuf = rt_mallocN(u1_t, conn->rbufsize);
             conn->wbuf = rt_mallocN(u1_t, conn->wbufsize);
+            conn->cbuf = rt_mallocN(u1_t, min(WS_COALESCE_SIZE, conn->wbufsize));
+            conn->cpos = conn->cend = 0;
 
             conn->wpos = 0;
             conn->wend = snprintf
@@ -760,6 +1074,8 @@ static void ws_connecting (aio_t* aio) {
         aio_set_rdfn(conn->aio, ws_connected_r);
         aio_set_wrfn(conn->aio, NULL);
         conn->state = WS_CONNECTED;
+        if( WS_PING_INTV > 0 )
+            rt_setTimer(&conn->pingtmr, rt_micros_ahead(WS_PING_INTV));
         conn->evcb(conn, WSEV_CONNECTED);
         conn->rbeg = conn->rend; // signal lower level that we consumed this frame
         if( conn->aio )
@@ -817,14 +1133,9 @@ dbuf_t ws_getSendbuf (ws_t* conn, int minsize) {
 void ws_sendData (ws_t* conn, dbuf_t* b, int binaryData) {
     if( conn->state != WS_CONNECTED )
         return;
-    int n = b->pos;
-    b->buf[0-WSHDR_INTRA] = n>>8;
-    b->buf[1-WSHDR_INTRA] = n;
-    b->buf[2-WSHDR_INTRA] = binaryData ? WSHDR_BINARY : WSHDR_TEXT;
-    conn->wfill += n+WSHDR_INTRA;
-    b->buf = NULL;
-    b->pos = b->bufsize = 0;
-    aio_set_wrfn(conn->aio, ws_connected_w);
+    metric_inc(MET_WS_MSGS_TX);
+    metric_add(MET_WS_BYTES_TX, b->pos);
+    ws_queueFrame(conn, b, binaryData ? WSHDR_BINARY : WSHDR_TEXT);
 }
 
 
@@ -866,6 +1177,7 @@ void ws_ini (ws_t* conn, int rbufsize, int wbufsize) {
     memset(conn, 0, sizeof(*conn));
     mbedtls_net_init(&conn->netctx);
     rt_iniTimer(&conn->tmr, NULL);
+    rt_iniTimer(&conn->pingtmr, ws_pingtimeout);
     conn->state = WS_CLOSED;
     conn->evcb = conn_evcb_nil;
     conn->rbufsize = rbufsize;
@@ -874,10 +1186,14 @@ void ws_ini (ws_t* conn, int rbufsize, int wbufsize) {
 
 
 void ws_free (ws_t* conn) {
+    conn_stopConnect(conn);
     rt_free(conn->rbuf);
     rt_free(conn->wbuf);
+    rt_free(conn->cbuf);
     conn->rbuf = NULL;
     conn->wbuf = NULL;
+    conn->cbuf = NULL;
+    conn->cpos = conn->cend = 0;
     rt_free(conn->host);
     rt_free(conn->port);
     rt_free(conn->uripath);
@@ -887,6 +1203,7 @@ void ws_free (ws_t* conn) {
     rt_free((void*)conn->authtoken);
     conn->authtoken = NULL;
     rt_clrTimer(&conn->tmr);
+    rt_clrTimer(&conn->pingtmr);
     aio_close(conn->aio);
     conn->aio = NULL;
     mbedtls_net_free(&conn->netctx);
@@ -895,6 +1212,22 @@ void ws_free (ws_t* conn) {
 }
 
 
+static void ws_tcpConnected (conn_t* conn, int fd) {
+    if( fd < 0 ) {
+        ws_shutdown(conn);
+        return;
+    }
+    conn->netctx.fd = fd;
+    sys_keepAlive(conn->netctx.fd);
+    if( conn->tlsctx )
+        mbedtls_ssl_set_bio(conn->tlsctx, &conn->netctx, mbedtls_net_send, mbedtls_net_recv, NULL);
+
+    conn->aio = aio_open(conn, conn->netctx.fd, NULL, NULL);
+    conn->state = WS_TLS_HANDSHAKE;
+    ws_handshaking(conn->aio);
+}
+
+
 int ws_connect (ws_t* conn, char* host, char* port, char* uripath) {
     if( conn->state != WS_CLOSED )
         return 0;  // forgot to ws_close?
@@ -902,34 +1235,67 @@ int ws_connect (ws_t* conn, char* host, char* port, char* uripath) {
     mbedtls_net_free(&conn->netctx);
     mbedtls_net_init(&conn->netctx);
 
-    int ret;
-    if( (ret = mbedtls_net_connect(&conn->netctx, host, port, MBEDTLS_NET_PROTO_TCP)) != 0 ) {
-        log_mbedError(MOD_AIO|ERROR, ret, "[%d] WS connect failed", conn->netctx.fd);
-        ws_shutdown(conn);
-        return 0;
-    }
-    if( (ret = mbedtls_net_set_nonblock(&conn->netctx)) != 0 ) {
-        log_mbedError(MOD_AIO|ERROR, ret, "[%d] Non blocking failed", conn->netctx.fd);
-        ws_shutdown(conn);
-        return 0;
-    }
-    sys_keepAlive(conn->netctx.fd);
-    if( conn->tlsctx )
-        mbedtls_ssl_set_bio(conn->tlsctx, &conn->netctx, mbedtls_net_send, mbedtls_net_recv, NULL);
-
+    rt_free(conn->host);
+    rt_free(conn->port);
+    rt_free(conn->uripath);
     conn->host = rt_strdup(host);
     conn->port = rt_strdup(port);
     conn->uripath = rt_strdup(uripath);
-    conn->aio = aio_open(conn, conn->netctx.fd, NULL, NULL);
-    conn->state = WS_TLS_HANDSHAKE;
-    ws_handshaking(conn->aio);
+    conn->state = WS_TCP_CONNECTING;
+    if( !conn_connect(conn, ws_tcpConnected) ) {
+        ws_shutdown(conn);
+        return 0;
+    }
     return 1;
 }
 
 
+static int cmp_u2 (const void* a, const void* b) {
+    return *(const u2_t*)a - *(const u2_t*)b;
+}
+
+void ws_addRtt (ws_t* conn, ustime_t rtt) {
+    if( rtt < 0 )
+        return;
+    conn->rtts[conn->rttIdx] = min(rtt/1000, 0xFFFF);
+    conn->rttIdx = (conn->rttIdx + 1) % RTT_SAMPLES;
+    if( conn->rttCnt < RTT_SAMPLES )
+        conn->rttCnt += 1;
+    if( conn->rttIdx == 0 ) {
+        u2_t q[3];
+        ws_getRtt(conn, q);
+        LOG(MOD_AIO|INFO, "[%d] Round trip stats: q80=%dms q90=%dms q95=%dms", conn->netctx.fd, q[0], q[1], q[2]);
+    }
+}
+
 int ws_getRtt (ws_t* conn, u2_t* q_80_90_95) {
-    q_80_90_95[0] = q_80_90_95[1] = q_80_90_95[2] = 0;
-    return 0; // no data XXX:TBD
+    int n = conn->rttCnt;
+    if( n == 0 ) {
+        q_80_90_95[0] = q_80_90_95[1] = q_80_90_95[2] = 0;
+        return 0; // no data
+    }
+    u2_t sorted[RTT_SAMPLES];
+    memcpy(sorted, conn->rtts, n*sizeof(sorted[0]));
+    qsort(sorted, n, sizeof(sorted[0]), cmp_u2);
+    q_80_90_95[0] = sorted[(n*80)/100];
+    q_80_90_95[1] = sorted[(n*90)/100];
+    q_80_90_95[2] = sorted[(n*95)/100];
+    return n;
+}
+
+// Periodic PING - payload is the local send time, echoed back by PONG
+static void ws_pingtimeout (tmr_t* tmr) {
+    ws_t* conn = memberof(ws_t, tmr, pingtmr);
+    if( conn->state != WS_CONNECTED || WS_PING_INTV <= 0 )
+        return;
+    rt_setTimer(tmr, rt_micros_ahead(WS_PING_INTV));
+    dbuf_t wbuf = ws_getSendbuf(conn, 8);
+    if( wbuf.buf == NULL )
+        return;  // busy - try with next PING
+    rt_wlsbf8((u1_t*)wbuf.buf, rt_getTime());
+    wbuf.pos = 8;
+    ws_queueFrame(conn, &wbuf, WSHDR_PING);
+    LOG(MOD_AIO|XDEBUG, "[%d|WS] > PING", conn->netctx.fd);
 }
 
 
@@ -1051,6 +1417,7 @@ void http_free (http_t* conn) {
 
 static void _http_close (http_t* conn, tmrcb_t trigCloseEv) {
     rt_clrTimer(&conn->c.tmr);
+    conn_stopConnect(&conn->c);
     LOG(MOD_AIO|DEBUG, "[%d] HTTP connection shutdown...", conn->c.netctx.fd);
     mbedtls_net_free(&conn->c.netctx);
     tls_freeSession(conn->c.tlsctx); conn->c.tlsctx = NULL;
@@ -1071,36 +1438,44 @@ void http_close (http_t* conn) {
 }
 
 
-int http_connect (http_t* conn, char* host, char* port) {
-    if( conn->c.state != HTTP_CLOSED )
-        return 0;  // forgot to http_close?
-    rt_clrTimer(&conn->c.tmr);
-    mbedtls_net_free(&conn->c.netctx);
-    mbedtls_net_init(&conn->c.netctx);
-
-    int ret;
-    if( (ret = mbedtls_net_connect(&conn->c.netctx, host, port, MBEDTLS_NET_PROTO_TCP)) != 0 ) {
-        log_mbedError(MOD_AIO|ERROR, ret, "[%d] HTTP connect failed", conn->c.netctx.fd);
-        http_close(conn);
-        return 0;
-    }
-    if( (ret = mbedtls_net_set_nonblock(&conn->c.netctx)) != 0 ) {
-        log_mbedError(MOD_AIO|ERROR, ret, "[%d] Non blocking failed", conn->c.netctx.fd);
+static void http_tcpConnected (conn_t* _conn, int fd) {
+    http_t* conn = conn2http(_conn);
+    if( fd < 0 ) {
         http_close(conn);
-        return 0;
+        return;
     }
+    conn->c.netctx.fd = fd;
     sys_keepAlive(conn->c.netctx.fd);
     if( conn->c.tlsctx )
         mbedtls_ssl_set_bio(conn->c.tlsctx, &conn->c.netctx, mbedtls_net_send, mbedtls_net_recv, NULL);
 
     conn->c.aio = aio_open(conn, conn->c.netctx.fd, NULL, NULL);
+    conn->c.state = HTTP_CONNECTED;
+    rt_yieldTo(&conn->c.tmr, triggerHttpConnectedEv);
+}
+
+
+int http_connect (http_t* conn, char* host, char* port) {
+    if( conn->c.state != HTTP_CLOSED )
+        return 0;  // forgot to http_close?
+    rt_clrTimer(&conn->c.tmr);
+    mbedtls_net_free(&conn->c.netctx);
+    mbedtls_net_init(&conn->c.netctx);
+
+    // host/port may live in the connection buffer - copy before it gets overwritten
+    rt_free(conn->c.host);
+    rt_free(conn->c.port);
+    conn->c.host = rt_strdup(host);
+    conn->c.port = rt_strdup(port);
     // NOTE: the first wfill bytes are reserved for host:port
     // We might need this to build Host header line.
-    int n = snprintf((char*)conn->c.wbuf, conn->c.wbufsize, "%s:%s", host, port);
+    int n = snprintf((char*)conn->c.wbuf, conn->c.wbufsize, "%s:%s", conn->c.host, conn->c.port);
     conn->c.wfill = conn->c.rbeg = conn->c.rend = n+1;
-    conn->c.state = HTTP_CONNECTED;
-
-    rt_yieldTo(&conn->c.tmr, triggerHttpConnectedEv);
+    conn->c.state = HTTP_CONNECTING;
+    if( !conn_connect(&conn->c, http_tcpConnected) ) {
+        http_close(conn);
+        return 0;
+    }
     return 1;
 }
 
@@ -1465,8 +1840,26 @@ static str_t validateAuthToken (str_t s) {
 }
 
 
-int conn_setup_tls (conn_t* conn, int cred_cat, int cred_set, const char* servername) {
+// Parsed credentials per category/set - shared by all connections using them.
+// Rebuilt if the CRC over the credential files changes.
+static struct credcache {
+    tlsconf_t* tlsconf;
+    str_t      authtoken;
+    u4_t       crc;
+} credcache[SYS_CRED_MAX][SYS_CRED_NSETS];
+
+
+static void dropCreds (struct credcache* cc) {
+    tls_freeConf(cc->tlsconf);  // connections still using it hold their own reference
+    rt_free((void*)cc->authtoken);
+    cc->tlsconf = NULL;
+    cc->authtoken = NULL;
+}
+
+
+static int loadCreds (struct credcache* cc, int cred_cat, int cred_set) {
     tlsconf_t* tlsconf = tls_makeConf();
+    str_t authtoken = NULL;
     str_t elems[SYS_CRED_NELEMS];
     int elemslen[SYS_CRED_NELEMS];
     int auth = sys_cred(cred_cat, cred_set, elems, elemslen);    // get pointers to files or cert data
@@ -1481,14 +1874,18 @@ int conn_setup_tls (conn_t* conn, int cred_cat, int cred_set, const char* server
     }
     if( auth == SYS_AUTH_TOKEN ) {
         errmsg = "%s%s has no cert configured - running server auth and client auth with token";
-        dbuf_t dbuf = sys_readFile(elems[SYS_CRED_MYKEY]);
-        if( dbuf.buf == NULL ) {
-            errmsg = "%s%s has unreadable client auth token";
-            goto errexit;
+        if( elemslen[SYS_CRED_MYKEY] > 0 ) {
+            authtoken = validateAuthToken(elems[SYS_CRED_MYKEY]);
+        } else {
+            dbuf_t dbuf = sys_readFile(elems[SYS_CRED_MYKEY]);
+            if( dbuf.buf == NULL ) {
+                errmsg = "%s%s has unreadable client auth token";
+                goto errexit;
+            }
+            authtoken = validateAuthToken(dbuf.buf);
+            rt_free(dbuf.buf);
         }
-        conn->authtoken = validateAuthToken(dbuf.buf);
-        rt_free(dbuf.buf);
-        if( !conn->authtoken ) {
+        if( !authtoken ) {
             errmsg = "%s%s contains malformed auth token - expecting: {header: value{\\r\\n|\\n}}*";
             goto errexit;
         }
@@ -1503,9 +1900,8 @@ int conn_setup_tls (conn_t* conn, int cred_cat, int cred_set, const char* server
         errmsg = "%s%s key/cert rejected by MBedTLS";
         goto errexit;
     }
-    assert(conn->tlsconf==NULL && conn->tlsctx==NULL);
-    conn->tlsconf = tlsconf;
-    conn->tlsctx = tls_makeSession(tlsconf, servername);
+    cc->tlsconf = tlsconf;
+    cc->authtoken = authtoken;
     return 1;
  errexit:
     LOG(MOD_AIO|ERROR, errmsg, sys_credcat2str(cred_cat), sys_credset2str(cred_set));
@@ -1513,3 +1909,23 @@ int conn_setup_tls (conn_t* conn, int cred_cat, int cred_set, const char* server
     return 0;
 }
 
+
+int conn_setup_tls (conn_t* conn, int cred_cat, int cred_set, const char* servername) {
+    struct credcache* cc = &credcache[cred_cat][cred_set];
+    u4_t crc = sys_crcCred(cred_cat, cred_set);
+    if( cc->tlsconf == NULL || cc->crc != crc ) {
+        dropCreds(cc);
+        if( !loadCreds(cc, cred_cat, cred_set) )
+            return 0;
+        cc->crc = crc;
+    } else {
+        LOG(MOD_AIO|DEBUG, "%s%s reusing parsed credentials", sys_credcat2str(cred_cat), sys_credset2str(cred_set));
+    }
+    assert(conn->tlsconf==NULL && conn->tlsctx==NULL);
+    if( cc->authtoken )
+        conn->authtoken = rt_strdup(cc->authtoken);
+    conn->tlsconf = tls_refConf(cc->tlsconf);
+    conn->tlsctx = tls_makeSession(conn->tlsconf, servername);
+    return 1;
+}
+
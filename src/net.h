@@ -31,10 +31,13 @@
 
 #include "mbedtls/net_sockets.h"
 #include "rt.h"
+#include "s2conf.h"
 #include "tls.h"
 
 struct conn;
+struct connector;
 typedef void (*evcb_t)(struct conn*, int ev);
+typedef void (*connectcb_t)(struct conn*, int fd);
 typedef mbedtls_net_context netctx_t;
 
 typedef struct conn {
@@ -52,6 +55,19 @@ typedef struct conn {
     doff_t   wpos;     // socket reads data from here and sends it
     doff_t   wend;     // end of WS frame, after that 2 bytes frame length + frame data
     doff_t   wfill;    // local producers fill in data here
+    u1_t*    cbuf;     // several WS frames coalesced into one write (NULL if not used)
+    doff_t   cpos;     // socket reads coalesced data from here
+    doff_t   cend;     // end of coalesced data
+    // Write statistics - a flush is one batch of data handed to the socket (exported by metrics_render)
+    u4_t     wflushes;
+    u4_t     wframes;  // WS frames sent
+    u4_t     wrecords; // TLS records (or socket writes w/o TLS)
+    uL_t     wbytes;
+    // Round trip times in millis - ring buffer of last RTT_SAMPLES (PING/PONG, timesync)
+    tmr_t    pingtmr;
+    u2_t     rtts[RTT_SAMPLES];
+    u2_t     rttIdx;
+    u2_t     rttCnt;
 
     u1_t     state;
     s1_t     optemp;   // some temp value related to opctx
@@ -59,6 +75,7 @@ typedef struct conn {
     evcb_t   evcb;
 
     netctx_t   netctx;
+    struct connector* connector;  // pending TCP connect or NULL
     tlsctx_p   tlsctx;
     tlsconf_t* tlsconf;   // or NULL if shared and stored someplace else
     str_t      authtoken;
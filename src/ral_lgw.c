@@ -38,6 +38,7 @@
 #include "sys.h"
 #include "sx130xconf.h"
 #include "ral.h"
+#include "metrics.h"
 #include "lgw/loragw_reg.h"
 #include "lgw/loragw_hal.h"
 #if defined(CFG_sx1302)
@@ -45,7 +46,11 @@
 extern timestamp_counter_t counter_us; // from loragw_sx1302.c
 #endif // defined(CFG_sx1302)
 
-#define RAL_MAX_RXBURST 10
+#if !defined(LGW_PKT_FIFO_SIZE)
+#define LGW_PKT_FIFO_SIZE 16
+#endif
+
+#define RAL_MAX_RXBURST 10  // max lgw_receive calls per poll
 
 #define FSK_BAUD      50000
 #define FSK_FDEV      25  // [kHz]
@@ -302,63 +307,78 @@ static void log_rawpkt(u1_t level, str_t msg, struct lgw_pkt_rx_s * pkt_rx) {
     );
 }
 
+static int rxqFullPolls;  // consecutive polls deferred because rxq was full
+
 //ATTR_FASTCODE 
 static void rxpolling (tmr_t* tmr) {
     int rounds = 0;
-    while(rounds++ < RAL_MAX_RXBURST) {
-        struct lgw_pkt_rx_s pkt_rx;
-        int n = lgw_receive(1, &pkt_rx);
-        if( n < 0 || n > 1 ) {
-            LOG(MOD_RAL|ERROR, "lgw_receive error: %d", n);
-            break;
-        }
-        if( n==0 ) {
-            break;
-        }
-
-        rxjob_t* rxjob = !TC ? NULL : s2e_nextRxjob(&TC->s2ctx);
-        if( rxjob == NULL ) {
-            log_rawpkt(ERROR, "Dropped RX frame - out of space: ", &pkt_rx);
+    while( rounds++ < RAL_MAX_RXBURST ) {
+        struct lgw_pkt_rx_s pkt_rx[LGW_PKT_FIFO_SIZE];
+        // Only fetch what we can store - leave the rest in the radio FIFO
+        int room = !TC ? LGW_PKT_FIFO_SIZE : min(rxq_room(&TC->s2ctx.rxq), LGW_PKT_FIFO_SIZE);
+        if( room == 0 ) {
+            if( rxqFullPolls++ == 0 )
+                LOG(MOD_RAL|WARNING, "RX queue full - deferring fetch from radio");
             break; // Allow to flush RX jobs
         }
-        if( pkt_rx.status != STAT_CRC_OK ) {
-            if( log_shallLog(MOD_RAL|DEBUG) ) {
-                log_rawpkt(DEBUG, "", &pkt_rx);
-            }
-            continue; // silently ignore bad CRC
+        if( rxqFullPolls ) {
+            LOG(MOD_RAL|INFO, "RX queue has room again - fetch from radio was deferred %d times", rxqFullPolls);
+            rxqFullPolls = 0;
         }
-        if( pkt_rx.size > MAX_RXFRAME_LEN ) {
-            // This should not happen since caller provides
-            // space for max frame length - 255 bytes
-            log_rawpkt(ERROR, "Dropped RX frame - frame size too large: ", &pkt_rx);
-            continue;
+        int n = lgw_receive(room, pkt_rx);
+        if( n < 0 || n > room ) {
+            LOG(MOD_RAL|ERROR, "lgw_receive error: %d", n);
+            break;
         }
-
-        memcpy(&TC->s2ctx.rxq.rxdata[rxjob->off], pkt_rx.payload, pkt_rx.size);
-        rxjob->len   = pkt_rx.size;
-        rxjob->freq  = pkt_rx.freq_hz;
-        rxjob->xtime = ts_xticks2xtime(pkt_rx.count_us, last_xtime);
+        for( int i=0; i<n; i++ ) {
+            struct lgw_pkt_rx_s* p = &pkt_rx[i];
+            if( p->status != STAT_CRC_OK ) {
+                if( log_shallLog(MOD_RAL|DEBUG) ) {
+                    log_rawpkt(DEBUG, "", p);
+                }
+                metric_inc(MET_RX_CRCERR);
+                continue; // silently ignore bad CRC
+            }
+            if( p->size > MAX_RXFRAME_LEN ) {
+                // This should not happen since caller provides
+                // space for max frame length - 255 bytes
+                log_rawpkt(ERROR, "Dropped RX frame - frame size too large: ", p);
+                metric_inc(MET_RX_DROPPED);
+                continue;
+            }
+            rxjob_t* rxjob = !TC ? NULL : s2e_nextRxjob(&TC->s2ctx);
+            if( rxjob == NULL ) {
+                log_rawpkt(ERROR, "Dropped RX frame - out of space: ", p);
+                metric_inc(MET_RX_DROPPED);
+                continue;
+            }
+            memcpy(&TC->s2ctx.rxq.rxdata[rxjob->off], p->payload, p->size);
+            rxjob->len   = p->size;
+            rxjob->freq  = p->freq_hz;
+            rxjob->xtime = ts_xticks2xtime(p->count_us, last_xtime);
 #if defined(CFG_sx1302)
-        rxjob->rssi  = (u1_t)-pkt_rx.rssis;
+            rxjob->rssi  = (u1_t)-p->rssis;
 #else
-        rxjob->rssi  = (u1_t)-pkt_rx.rssi;
+            rxjob->rssi  = (u1_t)-p->rssi;
 #endif
-        rxjob->snr   = (s1_t)(pkt_rx.snr*4);
-        rps_t rps = ral_lgw2rps(&pkt_rx);
-        rxjob->dr = s2e_rps2dr(&TC->s2ctx, rps);/////////////////////////////////PROBLEMA AQUIII
-        if( rxjob->dr == DR_ILLEGAL ) {
-            log_rawpkt(ERROR, "Dropped RX frame - unable to map to an up DR: ", &pkt_rx);
-            continue;
-        }
-
-        if( log_shallLog(MOD_RAL|XDEBUG) ) {
-            log_rawpkt(XDEBUG, "", &pkt_rx);
+            rxjob->snr   = (s1_t)(p->snr*4);
+            rps_t rps = ral_lgw2rps(p);
+            rxjob->dr = s2e_rps2dr(&TC->s2ctx, rps);
+            if( rxjob->dr == DR_ILLEGAL ) {
+                log_rawpkt(ERROR, "Dropped RX frame - unable to map to an up DR: ", p);
+                metric_inc(MET_RX_DROPPED);
+                continue;
+            }
+            if( log_shallLog(MOD_RAL|XDEBUG) ) {
+                log_rawpkt(XDEBUG, "", p);
+            }
+            s2e_addRxjob(&TC->s2ctx, rxjob);
         }
-
-        s2e_addRxjob(&TC->s2ctx, rxjob);
-
+        if( n < room )
+            break;  // radio FIFO drained
     }
-    s2e_flushRxjobs(&TC->s2ctx);
+    if( TC )
+        s2e_flushRxjobs(&TC->s2ctx);
     rt_setTimer(tmr, rt_micros_ahead(RX_POLL_INTV));
 }
 
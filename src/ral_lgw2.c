@@ -42,6 +42,7 @@
 #endif // defined(CFG_linux)
 #include "sx1301v2conf.h"
 #include "ral.h"
+#include "metrics.h"
 #include "lgw2/sx1301ar_err.h"
 #include "lgw2/sx1301ar_gps.h"
 #include "lgw2/spi_linuxdev.h"
@@ -265,17 +266,20 @@ static void rxpolling (tmr_t* tmr) {
             rxjob_t* rxjob = !TC ? NULL : s2e_nextRxjob(&TC->s2ctx);
             if( rxjob == NULL ) {
                 LOG(ERROR, "SX1301 RX frame dropped - out of space");
+                metric_inc(MET_RX_DROPPED);
                 continue;
             }
             sx1301ar_rx_pkt_t* p = &pkt_rx[i];
             if( p->status != STAT_CRC_OK ) {
                 LOG(XDEBUG, "Dropped frame without CRC or with broken CRC");
+                metric_inc(MET_RX_CRCERR);
                 continue; // silently ignore bad CRC
             }
             if( p->size > MAX_RXFRAME_LEN ) {
                 // This should not happen since caller provides
                 // space for max frame length - 255 bytes
                 LOG(MOD_RAL|ERROR, "Frame size (%d) exceeds offered buffer (%d)", p->size, MAX_RXFRAME_LEN);
+                metric_inc(MET_RX_DROPPED);
                 continue;
             }
             
@@ -303,6 +307,7 @@ static void rxpolling (tmr_t* tmr) {
             rxjob->dr = s2e_rps2dr(&TC->s2ctx, rps);
             if( rxjob->dr == DR_ILLEGAL ) {
                 LOG(MOD_RAL|ERROR, "Unable to map to an up DR: %R", rps);
+                metric_inc(MET_RX_DROPPED);
                 continue;
             }
             s2e_addRxjob(&TC->s2ctx, rxjob);
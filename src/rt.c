@@ -34,9 +34,19 @@
 str_t rt_deveui  = "DevEui";
 str_t rt_joineui = "JoinEui";
 
+#if defined(CFG_timerheap)
+// 4-ary min-heap ordered by (deadline, arm sequence).
+// Queued timers remember their heap slot (hidx) which makes arming and
+// clearing O(log n). A queued timer has next=TMR_END, an idle one TMR_NIL.
+static tmr_t** timerHeap;
+static u4_t    timerCnt;
+static u4_t    timerCap;
+static u4_t    timerSeq;
+#else // !defined(CFG_timerheap)
 // We're using a simple linked list.
 // Complexity is O(n) but we don't expect to have many entries on a router.
 static tmr_t* timerQ = TMR_END;
+#endif // !defined(CFG_timerheap)
 // Buffer holding feature list
 static dbuf_t features;
 
@@ -135,23 +145,99 @@ void rt_ini() {
 }
 
 
+#if defined(CFG_timerheap)
+
+static inline int tmrBefore (const tmr_t* a, const tmr_t* b) {
+    return a->deadline < b->deadline || (a->deadline == b->deadline && (s4_t)(a->hseq - b->hseq) < 0);
+}
+
+static inline void heapPut (u4_t i, tmr_t* tmr) {
+    timerHeap[i] = tmr;
+    tmr->hidx = i;
+}
+
+static void heapUp (u4_t i, tmr_t* tmr) {
+    while( i > 0 ) {
+        u4_t parent = (i-1) >> 2;
+        if( !tmrBefore(tmr, timerHeap[parent]) )
+            break;
+        heapPut(i, timerHeap[parent]);
+        i = parent;
+    }
+    heapPut(i, tmr);
+}
+
+static void heapDown (u4_t i, tmr_t* tmr) {
+    while(1) {
+        u4_t child = 4*i+1;
+        if( child >= timerCnt )
+            break;
+        u4_t end = min(child+4, timerCnt);
+        u4_t m = child;
+        for( u4_t k=child+1; k < end; k++ ) {
+            if( tmrBefore(timerHeap[k], timerHeap[m]) )
+                m = k;
+        }
+        if( !tmrBefore(timerHeap[m], tmr) )
+            break;
+        heapPut(i, timerHeap[m]);
+        i = m;
+    }
+    heapPut(i, tmr);
+}
+
+static void heapRemove (tmr_t* tmr) {
+    u4_t i = tmr->hidx;
+    assert(i < timerCnt && timerHeap[i] == tmr);
+    tmr_t* last = timerHeap[--timerCnt];
+    if( last != tmr ) {
+        if( i > 0 && tmrBefore(last, timerHeap[(i-1)>>2]) )
+            heapUp(i, last);
+        else
+            heapDown(i, last);
+    }
+    tmr->next = TMR_NIL;
+}
+
+static inline tmr_t* firstTimer () {
+    return timerCnt == 0 ? TMR_END : timerHeap[0];
+}
+
+static inline void dropFirstTimer () {
+    heapRemove(timerHeap[0]);
+}
+
+#else // !defined(CFG_timerheap)
+
+static inline tmr_t* firstTimer () {
+    return timerQ;
+}
+
+static inline void dropFirstTimer () {
+    tmr_t* first = timerQ;
+    timerQ = first->next;
+    first->next = TMR_NIL;
+}
+
+#endif // !defined(CFG_timerheap)
+
+
 ATTR_FASTCODE
 ustime_t rt_processTimerQ () {
     while(1) {
-        if( timerQ == TMR_END )
+        tmr_t* expired = firstTimer();
+        if( expired == TMR_END )
             return USTIME_MAX;
 #if defined(CFG_timerfd)
-        ustime_t deadline = timerQ->deadline;
+        ustime_t deadline = expired->deadline;
         if( (deadline - rt_getTime()) > 0 )
             return deadline;
 #else // !defined(CFG_timerfd)
         ustime_t ahead;
-        if( (ahead = timerQ->deadline - rt_getTime()) > 0 )
+        if( (ahead = expired->deadline - rt_getTime()) > 0 )
             return ahead;
 #endif // !defined(CFG_timerfd)
-        tmr_t* expired = timerQ;
-        timerQ = expired->next;
-        expired->next = TMR_NIL;
+        dropFirstTimer();
         if (expired->callback) {
             expired->callback(expired);
         } else {
@@ -175,6 +261,37 @@ void rt_setTimerCb (tmr_t* tmr, ustime_t deadline, tmrcb_t callback) {
 }
 
 
+#if defined(CFG_timerheap)
+
+ATTR_FASTCODE
+void rt_setTimer (tmr_t* tmr, ustime_t deadline) {
+    assert(tmr != NULL && tmr != TMR_END && tmr != TMR_NIL);
+    if( tmr->next != TMR_NIL )
+        heapRemove(tmr); // still active
+    if( timerCnt == timerCap ) {
+        u4_t cap = timerCap == 0 ? 32 : 2*timerCap;
+        tmr_t** heap = rt_mallocN(tmr_t*, cap);
+        if( timerCnt > 0 )
+            memcpy(heap, timerHeap, timerCnt*sizeof(heap[0]));
+        rt_free(timerHeap);
+        timerHeap = heap;
+        timerCap = cap;
+    }
+    tmr->deadline = deadline;
+    tmr->hseq = timerSeq++;
+    tmr->next = TMR_END;
+    heapUp(timerCnt++, tmr);
+}
+
+
+void rt_clrTimer (tmr_t* tmr) {
+    if( (tmr == NULL || tmr == TMR_END) || tmr->next == TMR_NIL )
+        return;  // not active or NULL
+    heapRemove(tmr);
+}
+
+#else // !defined(CFG_timerheap)
+
 ATTR_FASTCODE
 void rt_setTimer (tmr_t* tmr, ustime_t deadline) {
     assert(tmr != NULL && tmr != TMR_END && tmr != TMR_NIL);
@@ -192,12 +309,6 @@ void rt_setTimer (tmr_t* tmr, ustime_t deadline) {
 }
 
 
-void rt_yieldTo (tmr_t* tmr, tmrcb_t callback) {
-    tmr->callback = callback;
-    rt_setTimer(tmr, rt_getTime());
-}
-
-
 void rt_clrTimer (tmr_t* tmr) {
     if( (tmr == NULL || tmr == TMR_END) || tmr->next == TMR_NIL )
         return;  // not active or NULL
@@ -213,6 +324,14 @@ void rt_clrTimer (tmr_t* tmr) {
     assert(0);     // LCOV_EXCL_LINE
 }
 
+#endif // !defined(CFG_timerheap)
+
+
+void rt_yieldTo (tmr_t* tmr, tmrcb_t callback) {
+    tmr->callback = callback;
+    rt_setTimer(tmr, rt_getTime());
+}
+
 
 
 u2_t rt_rlsbf2 (const u1_t* buf) {
@@ -231,6 +350,23 @@ uL_t rt_rlsbf8 (const u1_t* buf) {
     return rt_rlsbf4(buf) | ((uL_t)rt_rlsbf4(buf+4) << 32);
 }
 
+void rt_wlsbf2 (u1_t* buf, u2_t v) {
+    buf[0] = v;
+    buf[1] = v>>8;
+}
+
+void rt_wlsbf4 (u1_t* buf, u4_t v) {
+    buf[0] = v;
+    buf[1] = v>>8;
+    buf[2] = v>>16;
+    buf[3] = v>>24;
+}
+
+void rt_wlsbf8 (u1_t* buf, uL_t v) {
+    rt_wlsbf4(buf, (u4_t)v);
+    rt_wlsbf4(buf+4, (u4_t)(v>>32));
+}
+
 
 void* _rt_malloc(int size, int zero) {
     void* p = malloc(size);
@@ -528,15 +664,80 @@ static const uint32_t crc_table[256] = {
     0xB3667A2E,0xC4614AB8,0x5D681B02,0x2A6F2B94,0xB40BBE37,0xC30C8EA1,0x5A05DF1B,0x2D02EF8D,
 };
 
+u4_t rt_crc32_bytewise (u4_t crc, const void* buf, int size) {
+    const u1_t *p = (u1_t*)buf;
+
+    crc = crc ^ ~0U;
+    while( size-- > 0 )
+        crc = crc_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return crc ^ ~0U;
+}
+
+#if defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+
+// ARMv8 CRC32 instructions - enabled by the compiler target (e.g. -march=armv8-a+crc)
+u4_t rt_crc32 (u4_t crc, const void* buf, int size) {
+    const u1_t *p = (u1_t*)buf;
+
+    crc = crc ^ ~0U;
+    while( size > 0 && ((uintptr_t)p & 7) != 0 ) {
+        crc = __crc32b(crc, *p++);
+        size--;
+    }
+    while( size >= 8 ) {
+        uL_t v;
+        memcpy(&v, p, 8);
+        crc = __crc32d(crc, v);
+        p += 8;
+        size -= 8;
+    }
+    while( size-- > 0 )
+        crc = __crc32b(crc, *p++);
+    return crc ^ ~0U;
+}
+
+#else // !defined(__ARM_FEATURE_CRC32)
+
+// Slice-by-8: tables [1..7] are derived from crc_table on first use.
+// Table k advances the CRC of a byte by k additional zero bytes.
+static uint32_t crc_slices[7][256];
+static u1_t     crc_slicesReady;
+
+static void crc_iniSlices () {
+    for( int i=0; i < 256; i++ ) {
+        u4_t c = crc_table[i];
+        for( int k=0; k < 7; k++ ) {
+            c = crc_table[c & 0xFF] ^ (c >> 8);
+            crc_slices[k][i] = c;
+        }
+    }
+    crc_slicesReady = 1;
+}
+
 u4_t rt_crc32 (u4_t crc, const void* buf, int size) {
     const u1_t *p = (u1_t*)buf;
 
+    if( !crc_slicesReady )
+        crc_iniSlices();
     crc = crc ^ ~0U;
+    while( size >= 8 ) {
+        u4_t lo = crc ^ (p[0] | (p[1]<<8) | (p[2]<<16) | ((u4_t)p[3]<<24));
+        u4_t hi =        p[4] | (p[5]<<8) | (p[6]<<16) | ((u4_t)p[7]<<24);
+        crc = crc_slices[6][ lo      & 0xFF] ^ crc_slices[5][(lo>> 8) & 0xFF] ^
+              crc_slices[4][(lo>>16) & 0xFF] ^ crc_slices[3][ lo>>24        ] ^
+              crc_slices[2][ hi      & 0xFF] ^ crc_slices[1][(hi>> 8) & 0xFF] ^
+              crc_slices[0][(hi>>16) & 0xFF] ^ crc_table     [ hi>>24        ];
+        p += 8;
+        size -= 8;
+    }
     while( size-- > 0 )
         crc = crc_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
     return crc ^ ~0U;
 }
 
+#endif // !defined(__ARM_FEATURE_CRC32)
+
 void rt_addFeature (str_t s) {
     int l = strlen(s);
     int n = features.pos+l+1;
@@ -120,8 +120,19 @@ enum { MOD_ANY= 0*8, MOD_RAL= 1*8, MOD_S2E= 2*8, MOD_WSS= 3*8,
        MOD_TCE= 8*8, MOD_HAL= 9*8, MOD_SIO=10*8, MOD_SYN=11*8,
        MOD_GPS=12*8, MOD_SIM=13*8, MOD_WEB=14*8, MOD_ALL=0xF8 };
 
+// Rate limiter state of one LOG call site
+typedef struct logsite {
+    struct logsite* next;        // list of sites with suppressed messages
+    const char*     fmt;         // identifies site in summary
+    ustime_t        tat;         // earliest time next message conforms to rate (GCRA)
+    u4_t            suppressed;  // messages dropped since last summary
+    u1_t            mod_level;
+} logsite_t;
+
 void  log_setSlaveIdx (s1_t idx);
 int   log_setLevel (int level);
+void  log_setRate (int level, int rate);  // rate: messages/s per call site, 0=unlimited
+int   log_rateOk (logsite_t* site, u1_t mod_level, const char* fmt);
 str_t log_parseLevels (const char* levels);
 int   log_str2level (const char* level);
 int   log_shallLog (u1_t mod_level);
@@ -131,11 +142,30 @@ int   log_special (u1_t mod_level, dbuf_t* buf);
 void  log_specialFlush (int len);
 void  log_flush ();
 void  log_flushIO ();
+void  log_startRing ();                         // defer formatting of log lines to log_drainRing
+int   log_addText (const char* line, int len);  // queue preformatted text into log ring
+int   log_drainRing (char* buf, int bufsize);   // format pending log records into buf (log thread)
+
+// Single producer/single consumer ring of binary log records - see log.c
+typedef struct logring {
+    u1_t* buf;      // 8 byte aligned
+    u4_t  size;     // multiple of 8
+    u4_t  head;     // offset of next record - written by producer only
+    u4_t  tail;     // offset of oldest record - written by consumer only
+} logring_t;
+
+// Return bytes pending after adding the record, -1 if ring is full.
+// log_ringFmt returns 0 if arguments cannot be captured - caller has to format.
+int   log_ringFmt (logring_t* ring, u1_t mod_level, const char* fmt, va_list args);
+int   log_ringText (logring_t* ring, const char* line, int len);
+int   log_ringDrain (logring_t* ring, char* buf, int bufsize);
 
 
 #if defined(CFG_log_file_line)
 #define LOG(level, fmt, ...) {                                  \
-        if( log_shallLog(level) ) {                             \
+        static logsite_t _logsite;                              \
+        if( log_shallLog(level) &&                              \
+            log_rateOk(&_logsite, (level), fmt) ) {             \
         log_msg((level), "-- %s[%d]", __FILE__, __LINE__);      \
         log_msg((level), fmt, ## __VA_ARGS__);                  \
         }                                                       \
@@ -151,7 +181,9 @@ void  log_flushIO ();
         if( !((1<<((level)>>3)) & (CFG_logmod_exclude)) &&      \
             ((level) & 7) > (CFG_loglvl_exclude) &&             \
             log_shallLog(level) ) {                             \
-            log_msg((level), fmt, ## __VA_ARGS__);              \
+            static logsite_t _logsite;                          \
+            if( log_rateOk(&_logsite, (level), fmt) )           \
+                log_msg((level), fmt, ## __VA_ARGS__);          \
         }                                                       \
 }
 #endif // !defined(CFG_log_file_line)
@@ -170,11 +202,15 @@ typedef struct tmr {
     ustime_t    deadline;
     tmrcb_t     callback;
     void*       ctx;
+#if defined(CFG_timerheap)
+    u4_t        hidx;       // slot in timer heap - valid while queued
+    u4_t        hseq;       // arm sequence - keeps timers with equal deadlines in FIFO order
+#endif
 } tmr_t;
 
 
 #define TMR_NIL ((tmr_t*)0) // Timer not queued for timeout
-#define TMR_END ((tmr_t*)1) // End of timer queue
+#define TMR_END ((tmr_t*)1) // End of timer queue (timer heap: marks a queued timer)
 
 void rt_iniTimer  (tmr_t* tmr, tmrcb_t callback);
 void rt_setTimer  (tmr_t* tmr, ustime_t deadline);
@@ -207,6 +243,9 @@ u2_t rt_rlsbf2 (const u1_t* buf);
 u2_t rt_rmsbf2 (const u1_t* buf);
 u4_t rt_rlsbf4 (const u1_t* buf);
 uL_t rt_rlsbf8 (const u1_t* buf);
+void rt_wlsbf2 (u1_t* buf, u2_t v);
+void rt_wlsbf4 (u1_t* buf, u4_t v);
+void rt_wlsbf8 (u1_t* buf, uL_t v);
 
 char*   rt_strdup   (str_t s);
 char*   rt_strdupn  (str_t s, int n);
@@ -233,6 +272,7 @@ sL_t rt_readSpan (str_t* pp, ustime_t defaultUnit);
 sL_t rt_readSize (str_t* pp, ustime_t defaultUnit);
 
 u4_t rt_crc32 (u4_t crc, const void* buf, int size);
+u4_t rt_crc32_bytewise (u4_t crc, const void* buf, int size);  // reference implementation
 
 void  rt_addFeature (str_t s);
 str_t rt_features ();
@@ -253,6 +293,11 @@ typedef struct aio {
     aiofn_t wrfn;
     aiofn_t rdfn;
     void*   ctx;
+#if defined(CFG_epoll)
+    int     idx;    // slot in handle table
+    u4_t    gen;    // bumped on close - filters stale epoll events
+    u4_t    events; // interest set currently registered with epoll
+#endif
 } aio_t;
 
 void   aio_ini    ();
@@ -108,6 +108,7 @@ enum {  MAX_FILEPATH_LEN = 256 };   // max size of a file path
 
 enum {  TC_RECV_BUFFER_SIZE =   DFLT_TC_RECV_BUFSZ }; // websocket connections to TC (infos/muxs)
 enum {  TC_SEND_BUFFER_SIZE =   DFLT_TC_SEND_BUFSZ };
+enum {  WS_COALESCE_SIZE = 16*1024 }; // gather queued WS frames into one TLS record (<= max TLS fragment)
 
 enum {  MAX_HWSPEC_SIZE = 32 };
 enum {  MAX_CMDARGS = 64 };
@@ -115,6 +116,8 @@ enum {  MUXS_PROTOCOL_VERSION = 2 };
 enum {  MAX_RMTSH = DFLT_MAX_RMTSH };
 
 enum {  LOGLINE_LEN = 512 };
+enum {  LOGRATE_SUMMARY = 10 };    // secs between summaries of rate limited log messages
+enum {  LOGRING_SIZE = 64*1024 };  // binary log records pending formatting by log thread
 
 // --------------------------------------------------------------------------------
 // Lora processing
@@ -167,6 +170,8 @@ CONF_PARAM(TCP_KEEPALIVE_EN    , u4    , u4      ,   DFLT_TCP_KEEPALIVE, "TCP ke
 CONF_PARAM(TCP_KEEPALIVE_IDLE  , u4    , u4      ,    DFLT_TCP_KEEPIDLE, "TCP keepalive TCP_KEEPIDLE [s]")
 CONF_PARAM(TCP_KEEPALIVE_INTVL , u4    , u4      ,   DFLT_TCP_KEEPINTVL, "TCP keepalive TCP_KEEPINTVL [s]")
 CONF_PARAM(TCP_KEEPALIVE_CNT   , u4    , u4      ,     DFLT_TCP_KEEPCNT, "TCP keepalive TCP_KEEPCNT")
+CONF_PARAM(TCP_CONNECT_TIMEOUT , ustime, tspan_s ,            "\"10s\"", "give up on a single TCP connect attempt")
+CONF_PARAM(TCP_CONNECT_STAGGER , ustime, tspan_ms,          "\"250ms\"", "race next resolved address if connect did not complete")
 CONF_PARAM(MAX_JOINEUI_RANGES  , u4    , u4      ,                 "10", "max ranges to suppress unwanted join requests")
 CONF_PARAM(CUPS_CONN_TIMEOUT   , ustime, tspan_s ,            "\"60s\"", "connection timeout")
 CONF_PARAM(CUPS_OKSYNC_INTV    , ustime, tspan_h ,            "\"24h\"", "regular check-in with CUPS for updates")
@@ -177,7 +182,12 @@ CONF_PARAM(GPS_REOPEN_TTY_INTV , ustime, tspan_ms,             "\"1s\"", "rechec
 CONF_PARAM(GPS_REOPEN_FIFO_INTV, ustime, tspan_ms,             "\"1s\"", "recheck if FIFO writer fake GPS")
 CONF_PARAM(CMD_REOPEN_FIFO_INTV, ustime, tspan_ms,             "\"1s\"", "recheck if FIFO writer")
 CONF_PARAM(RX_POLL_INTV        , ustime, tspan_ms,           "\"20ms\"", "interval to poll SX1301 RX FIFO")
+CONF_PARAM(MIRROR_WINDOW       , ustime, tspan_ms,            "\"1s\"", "identical frames received within this window are mirrors (0=keep all)")
+CONF_PARAM(UPDF_BATCH_MAX      , u4    , u4      ,                  "1", "max uplinks per websocket message if LNS supports batching (1=off)")
+CONF_PARAM(UPDF_BATCH_LINGER   , ustime, tspan_ms,            "\"0ms\"", "hold back a partial uplink batch at most this long")
+CONF_PARAM(WS_PING_INTV        , ustime, tspan_s ,            "\"30s\"", "send WS PING to measure round trip time (0=off)")
 CONF_PARAM(TC_TIMEOUT          , ustime, tspan_s ,            "\"60s\"", "reconnected to muxs")
+CONF_PARAM(MUXS_URI_TTL        , ustime, tspan_h ,            "\"24h\"", "connect to last good MUXS directly without asking INFOS (0=off)")
 CONF_PARAM(CLASS_C_BACKOFF_BY  , ustime, tspan_s ,          "\"100ms\"", "retry interval for class C TX attempts")
 CONF_PARAM(CLASS_C_BACKOFF_MAX , u4    , u4      ,                 "10", "max number of class C TX attempts")
 CONF_PARAM(RADIO_INIT_WAIT     , ustime, tspan_s , DFLT_RADIO_INIT_WAIT, "max wait for radio init command to finish")
@@ -191,8 +201,11 @@ CONF_PARAM(TX_MIN_GAP          , ustime, tspan_s ,      DFLT_TX_MIN_GAP, "min di
 CONF_PARAM(TX_AIM_GAP          , ustime, tspan_s ,      DFLT_TX_AIM_GAP, "aim for this TX lead time, if delayed should not fall under min")
 CONF_PARAM(TX_MAX_AHEAD        , ustime, tspan_s ,    DFLT_TX_MAX_AHEAD, "maximum time message can be scheduled into the future")
 CONF_PARAM(TXCHECK_FUDGE       , ustime, tspan_s ,   DFLT_TXCHECK_FUDGE, "check radio state this time into ongoing TX")
+CONF_PARAM(TX_LOOKAHEAD        , u4    , bool    ,              "false", "place new frames around queued ones (antennas/RX2) before resolving by priority")
+CONF_PARAM(DC_WINDOW           , ustime, tspan_h ,             "\"1h\"", "sliding window for duty cycle budgets (airtime/rate within window)")
 CONF_PARAM(BEACON_INTVL        , ustime, tspan_s ,    DFLT_BEACON_INTVL, "beaconing interval")
 CONF_PARAM(TLS_SNI             ,     u4,    bool ,               "true", "Set and verify server name of TLS connections")
+CONF_PARAM(TLS_RESUME          ,     u4,    bool ,               "true", "Resume TLS sessions when reconnecting to the same server")
 
 #endif // _s2conf_x_
 
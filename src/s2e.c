@@ -32,7 +32,8 @@
 #include "ral.h"
 #include "s2e.h"
 #include "kwcrc.h"
-#include "timesync.h" 
+#include "timesync.h"
+#include "metrics.h"
 
 
 u1_t s2e_dcDisabled;    // no duty cycle limits - override for test/dev
@@ -47,22 +48,113 @@ extern inline rps_t rps_make (int sf, int bw);
 // Fwd decl.
 static void s2e_txtimeout (tmr_t* tmr);
 static void s2e_bcntimeout (tmr_t* tmr);
+static void s2e_updftimeout (tmr_t* tmr);
 
 
-static void setDC (s2ctx_t* s2ctx, ustime_t t) {
+static const u2_t DC_EU868BAND_RATE[] = {
+    [DC_DECI ]=   10,
+    [DC_CENTI]=  100,
+    [DC_MILLI]= 1000,
+};
+
+// Set all ledgers to empty (n=0) or untracked (n=DC_LEDGER_OFF)
+static void setDC (s2ctx_t* s2ctx, u1_t n) {
     for( u1_t u=0; u<MAX_TXUNITS; u++ ) {
         for( u1_t i=0; i<DC_NUM_BANDS; i++ )
-            s2ctx->txunits[u].dc_eu868bands[i] = t;
-        for( u1_t i=0; i<MAX_DNCHNLS; i++ )
-            s2ctx->txunits[u].dc_perChnl[i] = t;
+            s2ctx->txunits[u].dc_eu868bands[i].n = n;
+        for( u1_t i=0; i<=MAX_DNCHNLS; i++ )
+            s2ctx->txunits[u].dc_perChnl[i].n = n;
     }
 }
 
 static void resetDC (s2ctx_t* s2ctx, u2_t dc_chnlRate) {
-    setDC(s2ctx, rt_getTime());
+    setDC(s2ctx, 0);
     s2ctx->dc_chnlRate = dc_chnlRate;
 }
 
+// Ledger records are buckets of width DC_WINDOW/DC_LEDGER_BUCKETS aligned to multiples of the width.
+// A bucket counts until its end has left the window - thus airtime is kept a bit
+// longer than exact accounting would (on the safe side) but never indefinitely.
+static ustime_t dc_bucketWidth () {
+    return max(1, DC_WINDOW / DC_LEDGER_BUCKETS);
+}
+
+// Airtime accounted to the window ending at t. Records starting after t are included
+// since they still count against frames queued in front of them.
+ustime_t s2e_dcUsed (const dcledger_t* l, ustime_t t) {
+    ustime_t used = 0;
+    ustime_t w = dc_bucketWidth();
+    for( int i=0; i < l->n; i++ ) {
+        if( l->start[i] + w + DC_WINDOW > t )
+            used += l->airtime[i];
+    }
+    return used;
+}
+
+// Can a frame of airtime at txtime be sent within the budget (DC_WINDOW/rate)?
+int s2e_dcAdmit (const dcledger_t* l, ustime_t txtime, ustime_t airtime, u2_t rate) {
+    if( l->n == DC_LEDGER_OFF )
+        return 1;
+    return s2e_dcUsed(l, txtime) + airtime <= DC_WINDOW / rate;
+}
+
+void s2e_dcRecord (dcledger_t* l, ustime_t txtime, ustime_t airtime) {
+    if( l->n == DC_LEDGER_OFF )
+        return;
+    ustime_t w = dc_bucketWidth();
+    ustime_t b = txtime - txtime % w;
+    int k = 0;
+    while( k < l->n && l->start[k] + w + DC_WINDOW <= txtime )
+        k++;  // expired
+    if( k ) {
+        memmove(&l->start[0],   &l->start[k],   (l->n-k)*sizeof(l->start[0]));
+        memmove(&l->airtime[0], &l->airtime[k], (l->n-k)*sizeof(l->airtime[0]));
+        l->n -= k;
+    }
+    int i = 0;
+    while( i < l->n && l->start[i] < b )
+        i++;
+    if( i < l->n && l->start[i] == b ) {
+        l->airtime[i] += airtime;
+        return;
+    }
+    if( l->n == DC_LEDGER_SIZE ) {
+        // Only with frames queued far ahead: fold the oldest bucket into the next one.
+        // Moves airtime to a later fixed bucket - safe side and bounded by that bucket's expiry.
+        if( i == 0 ) {
+            l->airtime[0] += airtime;  // older than all records - account to oldest bucket
+            return;
+        }
+        l->airtime[1] += l->airtime[0];
+        memmove(&l->start[0],   &l->start[1],   (l->n-1)*sizeof(l->start[0]));
+        memmove(&l->airtime[0], &l->airtime[1], (l->n-1)*sizeof(l->airtime[0]));
+        l->n -= 1;
+        i -= 1;
+    }
+    memmove(&l->start[i+1],   &l->start[i],   (l->n-i)*sizeof(l->start[0]));
+    memmove(&l->airtime[i+1], &l->airtime[i], (l->n-i)*sizeof(l->airtime[0]));
+    l->start[i] = b;
+    l->airtime[i] = airtime;
+    l->n += 1;
+}
+
+int s2e_dcUsage (s2ctx_t* s2ctx, u1_t txunit, int dnchnl, int band) {
+    if( txunit >= MAX_TXUNITS )
+        return -1;
+    const dcledger_t* l = NULL;
+    u2_t rate = 0;
+    if( band >= 0 && band < DC_NUM_BANDS ) {
+        l = &s2ctx->txunits[txunit].dc_eu868bands[band];
+        rate = DC_EU868BAND_RATE[band];
+    } else if( dnchnl >= 0 && dnchnl <= MAX_DNCHNLS ) {
+        l = &s2ctx->txunits[txunit].dc_perChnl[dnchnl];
+        rate = s2ctx->dc_chnlRate;
+    }
+    if( l == NULL || l->n == DC_LEDGER_OFF || rate == 0 )
+        return -1;
+    return (int)(s2e_dcUsed(l, rt_getTime()) * 1000 / (DC_WINDOW / rate));
+}
+
 static int s2e_canTxOK (s2ctx_t* s2ctx, txjob_t* txjob, int* ccaDisabled) {
     return 1;
 }
@@ -78,7 +170,7 @@ void s2e_ini (s2ctx_t* s2ctx) {
     s2ctx->canTx = s2e_canTxOK;
     for( u1_t i=0; i<DR_CNT; i++ )
         s2ctx->dr_defs[i] = RPS_ILLEGAL;
-    setDC(s2ctx, USTIME_MIN);   // disable until we have a region that needs it
+    setDC(s2ctx, DC_LEDGER_OFF);   // disable until we have a region that needs it
 
     for( int u=0; u < MAX_TXUNITS; u++ ) {
         rt_iniTimer(&s2ctx->txunits[u].timer, s2e_txtimeout);
@@ -87,12 +179,15 @@ void s2e_ini (s2ctx_t* s2ctx) {
     }
     rt_iniTimer(&s2ctx->bcntimer, s2e_bcntimeout);
     s2ctx->bcntimer.ctx = s2ctx;
+    rt_iniTimer(&s2ctx->updftimer, s2e_updftimeout);
+    s2ctx->updftimer.ctx = s2ctx;
 }
 
 void s2e_free (s2ctx_t* s2ctx) {
     for( int u=0; u < MAX_TXUNITS; u++ )
         rt_clrTimer(&s2ctx->txunits[u].timer);
     rt_clrTimer(&s2ctx->bcntimer);
+    rt_clrTimer(&s2ctx->updftimer);
     memset(s2ctx, 0, sizeof(*s2ctx));
     ts_iniTimesync();
     ral_stop();
@@ -115,93 +210,204 @@ rxjob_t* s2e_nextRxjob (s2ctx_t* s2ctx) {
 
 void s2e_addRxjob (s2ctx_t* s2ctx, rxjob_t* rxjob) {
     // Add newly received frame to rxq
-    // Check for mirror frame (reflection on a neighboring frequency)
-    
-    for( rxjob_t* p = &s2ctx->rxq.rxjobs[s2ctx->rxq.first]; p < rxjob; p++ ) {
-        if( p->dr == rxjob->dr &&
-            p->len == rxjob->len &&
-            memcmp(&s2ctx->rxq.rxdata[p->off], &s2ctx->rxq.rxdata[rxjob->off], rxjob->len) == 0 ) {
-            // Duplicate detected - drop the mirror
-            printf("Duplicate detected");
-            if( (8*rxjob->snr - rxjob->rssi) > (8*p->snr - p->rssi) ) {
-                // Drop previous frame p
-                LOG(MOD_S2E|DEBUG, "Dropped mirror frame freq=%F snr=%5.1f rssi=%d (vs. freq=%F snr=%5.1f rssi=%d) - DR%d mic=%d (%d bytes)",
-                    p->freq, p->snr/4.0, -p->rssi, rxjob->freq, rxjob->snr/4.0, -rxjob->rssi,
-                    p->dr, (s4_t)rt_rlsbf4(&s2ctx->rxq.rxdata[p->off]+rxjob->len-4), p->len);
-                xprintf("Dropped mirror frame freq=%F", p-> freq);
-                rxq_commitJob(&s2ctx->rxq, rxjob);
-                rxjob = rxq_dropJob(&s2ctx->rxq, p);
-            } else {
-                // else: Drop newly retrieved frame - aka don't commit it
-                LOG(MOD_S2E|DEBUG, "Dropped mirror frame freq=%F snr=%5.1f rssi=%d (vs. freq=%F snr=%5.1f rssi=%d) - DR%d mic=%d (%d bytes)",
-                    rxjob-> freq, rxjob->snr/4.0, -rxjob->rssi, p->freq, p->snr/4.0, -p->rssi,
-                    rxjob->dr, (s4_t)rt_rlsbf4(&s2ctx->rxq.rxdata[rxjob->off]+rxjob->len-4), rxjob->len);
-
-                    xprintf("Dropped mirror frame freq=%F", rxjob-> freq);
-            }
-            return;
+    // Check for mirror frame (reflection on a neighboring frequency).
+    // Identical frames further apart than MIRROR_WINDOW are true retransmissions.
+    rxjob->rxtime = rt_getTime();
+    rxjob_t* p = MIRROR_WINDOW <= 0 ? NULL : rxq_findMirror(&s2ctx->rxq, rxjob, rxjob->rxtime - MIRROR_WINDOW);
+    if( p != NULL ) {
+        // Duplicate detected - drop the mirror
+        if( (8*rxjob->snr - rxjob->rssi) > (8*p->snr - p->rssi) ) {
+            // Drop previous frame p
+            LOG(MOD_S2E|DEBUG, "Dropped mirror frame freq=%F snr=%5.1f rssi=%d (vs. freq=%F snr=%5.1f rssi=%d) - DR%d mic=%d (%d bytes)",
+                p->freq, p->snr/4.0, -p->rssi, rxjob->freq, rxjob->snr/4.0, -rxjob->rssi,
+                p->dr, (s4_t)rt_rlsbf4(&s2ctx->rxq.rxdata[p->off]+rxjob->len-4), p->len);
+            rxq_commitJob(&s2ctx->rxq, rxjob);
+            rxq_dropJob(&s2ctx->rxq, p);
+        } else {
+            // else: Drop newly retrieved frame - aka don't commit it
+            LOG(MOD_S2E|DEBUG, "Dropped mirror frame freq=%F snr=%5.1f rssi=%d (vs. freq=%F snr=%5.1f rssi=%d) - DR%d mic=%d (%d bytes)",
+                rxjob->freq, rxjob->snr/4.0, -rxjob->rssi, p->freq, p->snr/4.0, -p->rssi,
+                rxjob->dr, (s4_t)rt_rlsbf4(&s2ctx->rxq.rxdata[rxjob->off]+rxjob->len-4), rxjob->len);
         }
+        metric_inc(MET_RX_MIRROR);
+        return;
     }
     // No mirror frame found
     rxq_commitJob(&s2ctx->rxq, rxjob);
+    metric_inc(MET_RX_FRAMES);
+}
+
+// Encode rxjob as a binary uplink frame - see BINMSG_UPDF in s2e.h for the layout.
+// Returns the number of bytes written or 0 if the frame does not fit.
+static int s2e_encBinUpdf (s2ctx_t* s2ctx, rxjob_t* j, u1_t* buf, int bufsize) {
+    int n = BIN_UPDF_HDRLEN + j->len;
+    if( n > bufsize )
+        return 0;
+    sL_t reftime = 0;
+    if( s2ctx->muxtime ) {
+        reftime = (sL_t)(s2ctx->muxtime * 1e6) +
+            ts_normalizeTimespanMCU(rt_getTime()-s2ctx->reftime);
+    }
+    buf[0] = BINMSG_UPDF;
+    buf[1] = BIN_UPDF_HDRLEN;
+    buf[2] = j->dr;
+    buf[3] = j->len;
+    rt_wlsbf4(&buf[ 4], j->freq);
+    rt_wlsbf8(&buf[ 8], j->rctx);
+    rt_wlsbf8(&buf[16], j->xtime);
+    rt_wlsbf8(&buf[24], ts_xtime2gpstime(j->xtime));
+    rt_wlsbf8(&buf[32], reftime);
+    rt_wlsbf8(&buf[40], rt_getUTC());
+    rt_wlsbf4(&buf[48], j->fts);
+    rt_wlsbf2(&buf[52], -(s4_t)j->rssi);
+    buf[54] = j->snr;
+    buf[55] = 0;
+    memcpy(&buf[BIN_UPDF_HDRLEN], &s2ctx->rxq.rxdata[j->off], j->len);
+    return n;
+}
+
+// Encode rxjob as an updf JSON object.
+// Returns 0 if the frame failed sanity checks or was stopped by filters - nothing is added to sendbuf.
+static int s2e_encUpdf (s2ctx_t* s2ctx, rxjob_t* j, ujbuf_t* sendbuf) {
+    int mark = sendbuf->pos;
+    dbuf_t lbuf = { .buf = NULL };
+    if( log_special(MOD_S2E|VERBOSE, &lbuf) )
+        xprintf(&lbuf, "RX %F DR%d %R snr=%.1f rssi=%d xtime=0x%lX - ",
+                j->freq, j->dr, s2e_dr2rps(s2ctx, j->dr), j->snr/4.0, -j->rssi, j->xtime);
+
+    uj_encOpen(sendbuf, '{');
+    bool is_lorawan = false;
+    if( !s2e_parse_lora_frame(sendbuf, &s2ctx->rxq.rxdata[j->off], j->len, lbuf.buf ? &lbuf : NULL, &is_lorawan) ) {
+        sendbuf->pos = mark;
+        return 0;
+    }
+    if( lbuf.buf )
+        log_specialFlush(lbuf.pos);
+    double reftime = 0.0;
+    if( s2ctx->muxtime ) {
+        reftime = s2ctx->muxtime +
+        ts_normalizeTimespanMCU(rt_getTime()-s2ctx->reftime) / 1e6;
+    }
+    uj_encKVn(sendbuf,
+          "RefTime",  'T', reftime,
+          "DR",       'i', j->dr,
+          "Freq",     'i', j->freq,
+          "upinfo",   '{',
+          /**/ "rctx",    'I', j->rctx,
+          /**/ "xtime",   'I', j->xtime,
+          /**/ "gpstime", 'I', ts_xtime2gpstime(j->xtime),
+          /**/ "fts",     'i', j->fts,
+          /**/ "rssi",    'i', -(s4_t)j->rssi,
+          /**/ "snr",     'g', j->snr/4.0,
+          /**/ "rxtime",  'T', rt_getUTC()/1e6,
+          "}",
+          NULL);
+    uj_encClose(sendbuf, '}');
+    return 1;
+}
+
+// With batching enabled hold back a partial batch until its oldest frame
+// has waited UPDF_BATCH_LINGER. Returns 1 if flushing should be deferred.
+static int s2e_lingerRxjobs (s2ctx_t* s2ctx) {
+    rxq_t* rxq = &s2ctx->rxq;
+    if( !s2ctx->updfBatch || UPDF_BATCH_LINGER <= 0 ||
+        rxq->first >= rxq->next || rxq->next - rxq->first >= UPDF_BATCH_MAX )
+        return 0;
+    ustime_t deadline = rxq->rxjobs[rxq->first].rxtime + UPDF_BATCH_LINGER;
+    if( deadline <= rt_getTime() )
+        return 0;
+    rt_setTimer(&s2ctx->updftimer, deadline);
+    return 1;
+}
+
+static void s2e_updftimeout (tmr_t* tmr) {
+    s2e_flushRxjobs((s2ctx_t*)tmr->ctx);
 }
 
 void s2e_flushRxjobs (s2ctx_t* s2ctx) {
-    while( s2ctx->rxq.first < s2ctx->rxq.next ) {
+    if( s2e_lingerRxjobs(s2ctx) )
+        return;
+    rt_clrTimer(&s2ctx->updftimer);
+    rxq_t* rxq = &s2ctx->rxq;
+    int batch = s2ctx->updfBatch ? UPDF_BATCH_MAX : 1;
+
+    // Binary frames are self-delimiting - a batch is a plain concatenation
+    while( rxq->first < rxq->next && s2ctx->binUpdf ) {
+        dbuf_t sendbuf = (*s2ctx->getSendbuf)(s2ctx, BIN_UPDF_HDRLEN + MAX_RXFRAME_LEN);
+        if( sendbuf.buf == NULL ) {
+            metric_inc(MET_UPDF_NOBUF);
+            return;  // WS will call again
+        }
+        for( int n=0; n < batch && rxq->first < rxq->next; ) {
+            rxjob_t* j = &rxq->rxjobs[rxq->first];
+            if( s2e_filterLoraFrame(&rxq->rxdata[j->off], j->len) ) {
+                int k = s2e_encBinUpdf(s2ctx, j, (u1_t*)sendbuf.buf + sendbuf.pos, sendbuf.bufsize - sendbuf.pos);
+                if( k == 0 )
+                    break;  // no more space - goes into next message
+                sendbuf.pos += k;
+                n += 1;
+                metric_inc(MET_UPDF_SENT);
+                metric_observe(MET_H_UPDFLAT, rt_getTime() - j->rxtime);
+            }
+            rxq->first += 1;
+        }
+        if( sendbuf.pos == 0 )
+            continue;   // all frames filtered
+        (*s2ctx->sendBinary)(s2ctx, &sendbuf);
+        assert(sendbuf.buf==NULL);
+    }
+    while( rxq->first < rxq->next ) {
         // Get a send buffer - parse frame / check filter
         ujbuf_t sendbuf = (*s2ctx->getSendbuf)(s2ctx, MIN_UPJSON_SIZE);
         if( sendbuf.buf == NULL ) {
             // Websocket has no space - WS will call again
+            metric_inc(MET_UPDF_NOBUF);
             return;
         }
-        rxjob_t* j = &s2ctx->rxq.rxjobs[s2ctx->rxq.first++];
-        dbuf_t lbuf = { .buf = NULL };
-        if( log_special(MOD_S2E|VERBOSE, &lbuf) )
-            //xprintf(&lbuf, "RX %F DR%d %R snr=%.1f rssi=%d xtime=0x%lX - ",
-            //        j->freq, j->dr, s2e_dr2rps(s2ctx, j->dr), j->snr/4.0, -j->rssi, j->xtime);
-
-        uj_encOpen(&sendbuf, '{');
-        bool is_lorawan = false;
-        if( !s2e_parse_lora_frame(&sendbuf, &s2ctx->rxq.rxdata[j->off], j->len, lbuf.buf ? &lbuf : NULL, &is_lorawan) ) {
-            // Frame failed sanity checks or stopped by filters
+        int bufsize = sendbuf.bufsize;
+        if( batch > 1 ) {
+            uj_encOpen(&sendbuf, '{');
+            uj_encKV(&sendbuf, "msgtype", 's', "updf_batch");
+            uj_encKey(&sendbuf, "frames");
+            uj_encOpen(&sendbuf, '[');
+            sendbuf.bufsize -= 3;  // keep space for closing ]} and terminating \0
+        }
+        int n = 0;
+        while( n < batch && rxq->first < rxq->next ) {
+            rxjob_t* j = &rxq->rxjobs[rxq->first++];
+            int mark = sendbuf.pos;
+            if( !s2e_encUpdf(s2ctx, j, &sendbuf) )
+                continue;
+            if( !xeos(&sendbuf) ) {
+                sendbuf.pos = mark;
+                if( n > 0 ) {
+                    rxq->first -= 1;  // retry with next message
+                    break;
+                }
+                LOG(MOD_S2E|ERROR, "JSON encoding exceeds available buffer space: %d", sendbuf.bufsize);
+                continue;
+            }
+            n += 1;
+            metric_inc(MET_UPDF_SENT);
+            metric_observe(MET_H_UPDFLAT, rt_getTime() - j->rxtime);
+        }
+        if( n == 0 ) {
             sendbuf.pos = 0;
             continue;
         }
-        if( lbuf.buf )
-            log_specialFlush(lbuf.pos);
-        double reftime = 0.0;
-        if( s2ctx->muxtime ) {
-            reftime = s2ctx->muxtime +
-            ts_normalizeTimespanMCU(rt_getTime()-s2ctx->reftime) / 1e6;
-        }
-        uj_encKVn(&sendbuf,
-              "RefTime",  'T', reftime,
-              "DR",       'i', j->dr,
-              "Freq",     'i', j->freq,
-              "upinfo",   '{',
-              /**/ "rctx",    'I', j->rctx,
-              /**/ "xtime",   'I', j->xtime,
-              /**/ "gpstime", 'I', ts_xtime2gpstime(j->xtime),
-              /**/ "fts",     'i', j->fts,
-              /**/ "rssi",    'i', -(s4_t)j->rssi,
-              /**/ "snr",     'g', j->snr/4.0,
-              /**/ "rxtime",  'T', rt_getUTC()/1e6,
-              "}",
-              NULL);
-        uj_encClose(&sendbuf, '}');
-        
-        if( !xeos(&sendbuf) ) {
-            LOG(MOD_S2E|ERROR, "JSON encoding exceeds available buffer space: %d", sendbuf.bufsize);
-        } else {
-            (*s2ctx->sendText)(s2ctx, &sendbuf);
-            assert(sendbuf.buf==NULL);
+        if( batch > 1 ) {
+            sendbuf.bufsize = bufsize;
+            uj_encClose(&sendbuf, ']');
+            uj_encClose(&sendbuf, '}');
+            xeos(&sendbuf);
         }
+        (*s2ctx->sendText)(s2ctx, &sendbuf);
+        assert(sendbuf.buf==NULL);
     }
 }
 
 
 
-
 // --------------------------------------------------------------------------------
 //
 // TX PART
@@ -209,12 +415,6 @@ void s2e_flushRxjobs (s2ctx_t* s2ctx) {
 // --------------------------------------------------------------------------------
 
 
-static const u2_t DC_EU868BAND_RATE[] = {
-    [DC_DECI ]=   10,
-    [DC_CENTI]=  100,
-    [DC_MILLI]= 1000,
-};
-
 static ustime_t _calcAirTime (rps_t rps, u1_t plen, u1_t nocrc, u2_t preamble) {
     if( preamble == 0 )
         preamble = 8;
@@ -370,23 +570,21 @@ static int freq2band (u4_t freq) {
 static void update_DC (s2ctx_t* s2ctx, txjob_t* txj) {
     if( s2ctx->region == J_AU915 ) { //antes J_EU868
         u1_t band = freq2band(txj->freq);
-        ustime_t* dcbands = s2ctx->txunits[txj->txunit].dc_eu868bands;
-        ustime_t t = dcbands[band];
-        // Update unless disabled or blocked
-        if( t != USTIME_MIN && t != USTIME_MAX ) {
-            dcbands[band] = t = txj->txtime + txj->airtime * DC_EU868BAND_RATE[band];
-            LOG(MOD_S2E|XDEBUG, "DC EU band %d blocked until %>.3T (txtime=%>.3T airtime=%~T)",
-                DC_EU868BAND_RATE[band], rt_ustime2utc(t), rt_ustime2utc(txj->txtime), (ustime_t)txj->airtime);
+        dcledger_t* l = &s2ctx->txunits[txj->txunit].dc_eu868bands[band];
+        if( l->n != DC_LEDGER_OFF ) {
+            s2e_dcRecord(l, txj->txtime, txj->airtime);
+            LOG(MOD_S2E|XDEBUG, "DC EU band %d: %~T of %~T used (txtime=%>.3T airtime=%~T)",
+                DC_EU868BAND_RATE[band], s2e_dcUsed(l, txj->txtime), DC_WINDOW / DC_EU868BAND_RATE[band],
+                rt_ustime2utc(txj->txtime), (ustime_t)txj->airtime);
         }
     }
     int dnchnl = txj->dnchnl;
-    ustime_t* dclist = s2ctx->txunits[txj->txunit].dc_perChnl;
-    ustime_t t = dclist[dnchnl];
-    // Update unless disabled or blocked
-    if( t != USTIME_MIN && t != USTIME_MAX ) {
-        dclist[dnchnl] = t = txj->txtime + txj->airtime * s2ctx->dc_chnlRate;
-        LOG(MOD_S2E|XDEBUG, "DC dnchnl %d blocked until %>.3T (txtime=%>.3T airtime=%~T)",
-            dnchnl, rt_ustime2utc(t), rt_ustime2utc(txj->txtime), (ustime_t)txj->airtime);
+    dcledger_t* l = &s2ctx->txunits[txj->txunit].dc_perChnl[dnchnl];
+    if( l->n != DC_LEDGER_OFF ) {
+        s2e_dcRecord(l, txj->txtime, txj->airtime);
+        LOG(MOD_S2E|XDEBUG, "DC dnchnl %d: %~T of %~T used (txtime=%>.3T airtime=%~T)",
+            dnchnl, s2e_dcUsed(l, txj->txtime), DC_WINDOW / s2ctx->dc_chnlRate,
+            rt_ustime2utc(txj->txtime), (ustime_t)txj->airtime);
     }
 }
 
@@ -477,33 +675,37 @@ static int altTxTime (s2ctx_t* s2ctx, txjob_t* txjob, ustime_t earliest) {
 
 static int s2e_canTxEU868 (s2ctx_t* s2ctx, txjob_t* txjob, int* ccaDisabled) {
     ustime_t txtime = txjob->txtime;
-    ustime_t band_exp = s2ctx->txunits[txjob->txunit].dc_eu868bands[freq2band(txjob->freq)];
-    if( txtime >= band_exp ) {
-        
+    int band = freq2band(txjob->freq);
+    const dcledger_t* l = &s2ctx->txunits[txjob->txunit].dc_eu868bands[band];
+    if( s2e_dcAdmit(l, txtime, txjob->airtime, DC_EU868BAND_RATE[band]) )
         return 1;   // clear channel analysis not required
-    }
     // No DC in band
-    LOG(MOD_S2E|VERBOSE, "%J %F - no DC in band: txtime=%>.3T free=%>.3T",
-        txjob, txjob->freq, rt_ustime2utc(txtime), rt_ustime2utc(band_exp));
+    LOG(MOD_S2E|VERBOSE, "%J %F - no DC in band: txtime=%>.3T used=%~T budget=%~T",
+        txjob, txjob->freq, rt_ustime2utc(txtime), s2e_dcUsed(l, txtime), DC_WINDOW / DC_EU868BAND_RATE[band]);
     return 0;
 }
 
 static int s2e_canTxPerChnlDC (s2ctx_t* s2ctx, txjob_t* txjob, int* ccaDisabled) {
     ustime_t txtime = txjob->txtime;
-    ustime_t chfree = s2ctx->txunits[txjob->txunit].dc_perChnl[txjob->dnchnl];
-    if( txtime >= chfree )
+    const dcledger_t* l = &s2ctx->txunits[txjob->txunit].dc_perChnl[txjob->dnchnl];
+    if( s2e_dcAdmit(l, txtime, txjob->airtime, s2ctx->dc_chnlRate) )
         return 2;  // can send if channel clear
-    LOG(MOD_S2E|VERBOSE, "%J %F - no DC in channel: txtime=%>.3T until=%>.3T",
-        txjob, txjob->freq, rt_ustime2utc(txtime), rt_ustime2utc(chfree));
+    LOG(MOD_S2E|VERBOSE, "%J %F - no DC in channel: txtime=%>.3T used=%~T budget=%~T",
+        txjob, txjob->freq, rt_ustime2utc(txtime), s2e_dcUsed(l, txtime), DC_WINDOW / s2ctx->dc_chnlRate);
     return 0;
+}
 
-    ustime_t band_exp = s2ctx->txunits[txjob->txunit].dc_eu868bands[freq2band(txjob->freq)];
-    if( txtime >= band_exp )
-        return 1;   // clear channel analysis not required
-    // No DC in band
-    LOG(MOD_S2E|VERBOSE, "%J %F - no DC in band: txtime=%>.3T free=%>.3T",
-        txjob, txjob->freq, rt_ustime2utc(txtime), rt_ustime2utc(band_exp));
-    return 0;
+// Find a queued txjob on the same txunit whose air time would overlap with txjob
+static txjob_t* findConflict (s2ctx_t* s2ctx, txjob_t* txjob) {
+    ustime_t txend = txjob->txtime + txjob->airtime;
+    txjob_t* other = txq_idx2job(&s2ctx->txq, s2ctx->txunits[txjob->txunit].head);
+    for( ; other != NULL; other = txq_idx2job(&s2ctx->txq, other->next) ) {
+        if( other->txtime - TX_MIN_GAP > txend )
+            break;  // queue is sorted - no more overlaps possible
+        if( txjob->txtime < other->txtime + other->airtime + TX_MIN_GAP )
+            return other;
+    }
+    return NULL;
 }
 
 // Add a txjob to the TX queue and insert ordered by txtime.
@@ -515,10 +717,16 @@ static int s2e_canTxPerChnlDC (s2ctx_t* s2ctx, txjob_t* txjob, int* ccaDisabled)
 //  - collision with ongoing TX on current antenna (never stop a running TX)
 // If not excluded enter based on txtime. If txtime is head of txunit queue reset processing timer
 // to kick start s2e_nextTxAction
+// With TX_LOOKAHEAD a placement overlapping an already queued txjob is only taken if all
+// alternatives (antennas, RX2, class C retries) overlap as well or need more air time.
+// Otherwise the conflict is resolved by priorities in s2e_nextTxAction when the first of
+// the two txjobs becomes due.
 //
 int s2e_addTxjob (s2ctx_t* s2ctx, txjob_t* txjob, int relocate, ustime_t now) {
     ustime_t earliest = now + TX_AIM_GAP;
     u1_t txunit;
+    u1_t lookahead = TX_LOOKAHEAD;
+    txjob_t fallback;   // first placement found which overlaps with a queued txjob
     if( !relocate ) {
         // txjob is fresh entry from LNS and not one that got reschduled due to TX conflicts
         ustime_t txtime = txjob->txtime;    //
@@ -542,6 +750,13 @@ int s2e_addTxjob (s2ctx_t* s2ctx, txjob_t* txjob, int relocate, ustime_t now) {
         if( alts==0 ) {
             // No more alternative antennas - try later TX time
             if( !altTxTime(s2ctx, txjob, earliest) ) {
+                if( lookahead > 1 ) {
+                    // Nothing conflict free - go back to first choice and let priorities decide
+                    *txjob = fallback;
+                    txunit = txjob->txunit;
+                    lookahead = 0;
+                    goto start;
+                }
                 LOG(MOD_S2E|WARNING, "%J - unable to place frame", txjob);
                 
                 return 0;
@@ -571,6 +786,21 @@ int s2e_addTxjob (s2ctx_t* s2ctx, txjob_t* txjob, int relocate, ustime_t now) {
             LOG(MOD_S2E|DEBUG, "%J - frame colliding with ongoing TX on ant#%d", txjob, txunit);
             goto check_alt;
         }
+        txjob_t* other;
+        if( lookahead && (other = findConflict(s2ctx, txjob)) != NULL ) {
+            LOG(MOD_S2E|DEBUG, "%J - overlaps with queued %J on ant#%d - looking for alternative", txjob, other, txunit);
+            if( lookahead == 1 ) {
+                fallback = *txjob;
+                lookahead = 2;
+            }
+            goto check_alt;
+        }
+        if( lookahead == 2 && txjob->airtime > fallback.airtime ) {
+            // Conflict free but slower (e.g. RX2 at SF12) - would block the antenna for
+            // longer than the conflict it avoids and push later frames into the same move
+            LOG(MOD_S2E|DEBUG, "%J - alternative on ant#%d takes longer (%~T) - looking further", txjob, txunit, txjob->airtime);
+            goto check_alt;
+        }
         // Insert into Q by ascending txtime
         do {
             if( idx == TXIDX_END  ||  txtime < curr->txtime ) {
@@ -650,10 +880,13 @@ ustime_t s2e_nextTxAction (s2ctx_t* s2ctx, u1_t txunit) {
     }
     if( txdelta < TX_MIN_GAP ) {
         // Missed TX start time - try alternative or drop frame
+        metric_inc(MET_TX_LATE);
       check_alt:
         txq_unqJob(&s2ctx->txq, phead);
-        if( !s2e_addTxjob(s2ctx, curr, /*relocate*/1, now) )  // note: might change queue head! (reload @ again)
+        if( !s2e_addTxjob(s2ctx, curr, /*relocate*/1, now) ) {  // note: might change queue head! (reload @ again)
             txq_freeJob(&s2ctx->txq, curr);
+            metric_inc(MET_TX_DROPPED);
+        }
         goto again;
     }
     // Txtime time too far out Head is TXable - is it time to feed the radio?
@@ -680,8 +913,10 @@ ustime_t s2e_nextTxAction (s2ctx_t* s2ctx, u1_t txunit) {
     // Txtime close enough to make a decision
     // Check channel access
     int ccaDisabled = s2e_ccaDisabled;
-    if( !s2e_dcDisabled && !(*s2ctx->canTx)(s2ctx, curr, &ccaDisabled) )
+    if( !s2e_dcDisabled && !(*s2ctx->canTx)(s2ctx, curr, &ccaDisabled) ) {
+        metric_inc(MET_TX_NODC);
         goto check_alt;
+    }
 
     // Check collision with subsequent frames and weigh priorities
     // Assuming a txjob with later txstart time is not blocked by duty cycle
@@ -699,6 +934,7 @@ ustime_t s2e_nextTxAction (s2ctx_t* s2ctx, u1_t txunit) {
         if( prio < oprio ) {
             LOG(MOD_S2E|ERROR, "%J - Hindered by %J %~T later: prio %d<%d - trying alternative",
                 curr, other_txjob, other_txjob->txtime - curr->txtime, prio, oprio);
+            metric_inc(MET_TX_COLLISION);
             goto check_alt;
         }
     } while(1);
@@ -714,12 +950,16 @@ ustime_t s2e_nextTxAction (s2ctx_t* s2ctx, u1_t txunit) {
     if( txerr != RAL_TX_OK ) {
         if( txerr == RAL_TX_NOCA ) {
             LOG(MOD_S2E|ERROR, "%J - channel busy - trying alternative", curr);
+            metric_inc(MET_TX_NOCA);
         } else {
             LOG(MOD_S2E|ERROR, "%J - radio layer failed to TX - trying alternative", curr);
+            metric_inc(MET_TX_FAIL);
         }
         goto check_alt;
     }
     curr->txflags |= TXFLAG_TXING;
+    metric_inc(MET_TX_STARTED);
+    metric_observe(MET_H_TXLEAD, txdelta);
 
     // Unqueue all overlapping subsequent txjobs and find alternatives (antenna/txtime)
     // If no alternatives drop txjob.
@@ -728,9 +968,12 @@ ustime_t s2e_nextTxAction (s2ctx_t* s2ctx, u1_t txunit) {
         if( next_txjob == NULL || txend < next_txjob->txtime - TX_MIN_GAP )
             break;  // no next or no overlap
         LOG(MOD_S2E|INFO, "%J - displaces %J due to %~T overlap", curr, next_txjob, next_txjob->txtime - TX_MIN_GAP - txend);
+        metric_inc(MET_TX_COLLISION);
         txq_unqJob(&s2ctx->txq, &curr->next);
-        if( !s2e_addTxjob(s2ctx, next_txjob, /*relocate*/1, now) )  // note: might change next!
+        if( !s2e_addTxjob(s2ctx, next_txjob, /*relocate*/1, now) ) {  // note: might change next!
             txq_freeJob(&s2ctx->txq, next_txjob);
+            metric_inc(MET_TX_DROPPED);
+        }
     }
     return curr->txtime + TXCHECK_FUDGE;
 }
@@ -858,6 +1101,8 @@ static int handle_router_config (s2ctx_t* s2ctx, ujdec_t* D) {
     s2bcn_t bcn = { 0 };
 
     s2ctx->txpow = 14 * TXPOW_SCALE;  // builtin default
+    s2ctx->binUpdf = 0;
+    s2ctx->updfBatch = 0;
 
     while( (field = uj_nextField(D)) ) {
         switch(field) {
@@ -1042,6 +1287,14 @@ static int handle_router_config (s2ctx_t* s2ctx, ujdec_t* D) {
             rt_utcOffset_ts = s2ctx->reftime;
             break;
         }
+        case J_updf_batch: {
+            s2ctx->updfBatch = uj_bool(D) && UPDF_BATCH_MAX > 1;
+            break;
+        }
+        case J_bin_updf: {
+            s2ctx->binUpdf = uj_bool(D);
+            break;
+        }
         case J_hwspec: {
             str_t s = uj_str(D);
             if( D->str.len > sizeof(hwspec)-1 )
@@ -1211,6 +1464,8 @@ static int handle_router_config (s2ctx_t* s2ctx, ujdec_t* D) {
             s2e_netidFilter[3], s2e_netidFilter[2], s2e_netidFilter[1], s2e_netidFilter[0]);
         LOG(MOD_S2E|INFO, "  Dev/test settings: nocca=%d nodc=%d nodwell=%d",
             (s2e_ccaDisabled!=0), (s2e_dcDisabled!=0), (s2e_dwellDisabled!=0));
+        LOG(MOD_S2E|INFO, "  Uplink format: %s%s", s2ctx->binUpdf ? "binary" : "JSON",
+            s2ctx->updfBatch ? " (batched)" : "");
     }
     if( (bcn.ctrl&0xF0) != 0 ) {
         // At least one beacon frequency was specified
@@ -1777,19 +2032,17 @@ void handle_runcmd (s2ctx_t* s2ctx, ujdec_t* D) {
 int s2e_onMsg (s2ctx_t* s2ctx, char* json, ujoff_t jsonlen) {
     ujdec_t D;
     uj_iniDecoder(&D, json, jsonlen);
-    ujcrc_t msgtype = uj_msgtype(&D);
     if( uj_decode(&D) ) {
         LOG(MOD_S2E|ERROR, "Parsing of JSON message failed - ignored");
         return 1;   // return fail? would trigger a reconnect
     }
+    // All JSON data must be a single object per frame
+    ujcrc_t msgtype = uj_enterMsg(&D);
     if( s2ctx->region == 0 && (msgtype == J_dnmsg || msgtype == J_dnsched || msgtype == J_dnframe) ) {
         // Might happen if messages are still queued
         LOG(MOD_S2E|WARNING, "Received '%.*s' before 'router_config' - dropped", D.str.len, D.str.beg);
         return 1;
     }
-    // All JSON data must be a single object per frame
-    uj_nextValue(&D);
-    uj_enterObject(&D);
     int ok = 1;
 
     switch(msgtype) {
@@ -38,6 +38,7 @@
 extern uL_t* s2e_joineuiFilter;
 extern u4_t  s2e_netidFilter[4];
 int  s2e_parse_lora_frame(ujbuf_t* buf, const u1_t* frame , int len, dbuf_t* lbuf, bool* is_lorawan);
+int  s2e_filterLoraFrame (const u1_t* frame, int len);
 void s2e_make_beacon (uint8_t* layout, sL_t epoch_secs, int infodesc, double lat, double lon, uint8_t* buf);
 
 
@@ -84,15 +85,47 @@ enum { PRIO_BEACON             = 128 };
 
 
 
+// Binary uplink frame - sent instead of JSON if LNS enabled it (router_config: bin_updf).
+// All multi-byte fields are little endian. The header is followed by the raw PHYPayload.
+//   off  size  field
+//    0    1    type (BINMSG_UPDF)
+//    1    1    header length (BIN_UPDF_HDRLEN) - payload starts here
+//    2    1    DR
+//    3    1    payload length
+//    4    4    Freq (Hz)
+//    8    8    rctx
+//   16    8    xtime
+//   24    8    gpstime (us)
+//   32    8    RefTime (us) - 0 if no MuxTime
+//   40    8    rxtime (UTC us)
+//   48    4    fts (-1 = none)
+//   52    2    rssi (dBm)
+//   54    1    snr (dB * 4)
+//   55    1    reserved (0)
+enum { BINMSG_UPDF = 0x01 };
+enum { BIN_UPDF_HDRLEN = 56 };
+
+
 enum { DC_DECI, DC_CENTI, DC_MILLI, DC_NUM_BANDS };
 enum { MAX_DNCHNLS = 48 };
 enum { MAX_UPCHNLS = MAX_130X * 10 };  // 10 channels per chip
 enum { DR_CNT = 16 };
 enum { DR_ILLEGAL = 16 };
 
+enum { DC_LEDGER_BUCKETS = 6 };  // DC_WINDOW is tracked in buckets of DC_WINDOW/DC_LEDGER_BUCKETS
+enum { DC_LEDGER_SIZE = DC_LEDGER_BUCKETS+2 };  // buckets in window + partial one + frames queued ahead
+enum { DC_LEDGER_OFF  = 0xFF };  // dcledger_t.n: duty cycle not tracked
+
+// Airtime spent on a band/channel within the sliding window DC_WINDOW
+typedef struct dcledger {
+    ustime_t start[DC_LEDGER_SIZE];    // bucket start times - oldest first
+    u4_t     airtime[DC_LEDGER_SIZE];  // sum of airtime of TX starting in bucket
+    u1_t     n;                        // records in use or DC_LEDGER_OFF
+} dcledger_t;
+
 typedef struct s2txunit {
-    ustime_t dc_eu868bands[DC_NUM_BANDS];
-    ustime_t dc_perChnl[MAX_DNCHNLS+1];
+    dcledger_t dc_eu868bands[DC_NUM_BANDS];
+    dcledger_t dc_perChnl[MAX_DNCHNLS+1];
     txidx_t  head;
     tmr_t    timer;
 } s2txunit_t;
@@ -117,6 +150,8 @@ typedef struct s2ctx {
     int    (*canTx)      (struct s2ctx* s2ctx, txjob_t* txjob, int* ccaDisabled);  // region dependent
 
     u1_t     ccaEnabled;     // this region uses CCA
+    u1_t     binUpdf;        // LNS accepts binary uplink frames
+    u1_t     updfBatch;      // LNS accepts batched uplinks (updf_batch)
     rps_t    dr_defs[DR_CNT];
     u2_t     dc_chnlRate;
     u4_t     dn_chnls[MAX_DNCHNLS+1];
@@ -134,6 +169,7 @@ typedef struct s2ctx {
     s2txunit_t txunits[MAX_TXUNITS];
     s2bcn_t    bcn;      // beacon definition
     tmr_t      bcntimer;
+    tmr_t      updftimer;  // linger timer for partial uplink batches
 
 } s2ctx_t;
 
@@ -161,8 +197,14 @@ void     s2e_flushRxjobs  (s2ctx_t*);
 int      s2e_onMsg        (s2ctx_t*, char* json, ujoff_t jsonlen);
 int      s2e_onBinary     (s2ctx_t*, u1_t* data, ujoff_t datalen);
 ustime_t s2e_nextTxAction (s2ctx_t*, u1_t txunit);
+int      s2e_dcUsage      (s2ctx_t*, u1_t txunit, int dnchnl, int band);  // permille of budget, -1 if not tracked
 int      s2e_handleCommands (ujcrc_t msgtype, s2ctx_t* s2ctx, ujdec_t* D);
 void     s2e_handleRmtsh    (s2ctx_t* s2ctx, ujdec_t* D);
 
+// Duty cycle ledgers
+ustime_t s2e_dcUsed   (const dcledger_t* l, ustime_t t);
+int      s2e_dcAdmit  (const dcledger_t* l, ustime_t txtime, ustime_t airtime, u2_t rate);
+void     s2e_dcRecord (dcledger_t* l, ustime_t txtime, ustime_t airtime);
+
 
 #endif // _s2e_h_
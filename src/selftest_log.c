@@ -0,0 +1,213 @@
+/*
+ * --- Revised 3-Clause BSD License ---
+ * Copyright Semtech Corporation 2022. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright notice,
+ *       this list of conditions and the following disclaimer in the documentation
+ *       and/or other materials provided with the distribution.
+ *     * Neither the name of the Semtech corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SEMTECH CORPORATION. BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "selftests.h"
+#include "s2conf.h"
+#include "uj.h"
+
+// Log records go through a private ring - the station ring may be drained
+// concurrently by the log thread while selftests run.
+enum { RINGSZ = 2048 };
+enum { MAXPEND = RINGSZ/32 };   // smallest record is 32 bytes
+
+static uL_t      ringbuf[RINGSZ/8];
+static logring_t ring;
+// Expected output of records in the ring - FIFO mirroring the ring
+static char expect[MAXPEND][LOGLINE_LEN];
+static int  expectText[MAXPEND];
+static int  expectHead, expectTail;
+
+
+static void resetRing () {
+    memset(&ring, 0, sizeof(ring));
+    ring.buf = (u1_t*)ringbuf;
+    ring.size = RINGSZ;
+    expectHead = expectTail = 0;
+}
+
+// Format right away and queue into ring - returns log_ringFmt result.
+static int addFmt (const char* fmt, ...) {
+    va_list ap, aq;
+    va_start(ap, fmt);
+    va_copy(aq, ap);
+    dbuf_t b = { .buf=expect[expectHead % MAXPEND], .bufsize=LOGLINE_LEN, .pos=0 };
+    vxprintf(&b, fmt, aq);
+    va_end(aq);
+    xeol(&b);
+    xeos(&b);
+    int fill = log_ringFmt(&ring, MOD_SYS|INFO, fmt, ap);
+    va_end(ap);
+    if( fill > 0 ) {
+        TCHECK(expectHead - expectTail < MAXPEND);
+        expectText[expectHead++ % MAXPEND] = 0;
+    }
+    return fill;
+}
+
+static int addText (const char* text) {
+    int fill = log_ringText(&ring, text, strlen(text));
+    if( fill > 0 ) {
+        TCHECK(expectHead - expectTail < MAXPEND);
+        strcpy(expect[expectHead % MAXPEND], text);
+        expectText[expectHead++ % MAXPEND] = 1;
+    }
+    return fill;
+}
+
+// Drain into a buffer of bufsize and compare lines - returns number of lines.
+static int drainCheck (int bufsize) {
+    char out[8*LOGLINE_LEN];
+    int len = log_ringDrain(&ring, out, min(bufsize, sizeof(out)-1));
+    out[len] = 0;
+    int lines = 0;
+    char* line = out;
+    while( line < out+len ) {
+        char* eol = strchr(line, '\n');
+        TCHECK(eol != NULL);
+        *eol = 0;
+        TCHECK(expectTail < expectHead);
+        char* want = expect[expectTail % MAXPEND];
+        if( expectText[expectTail % MAXPEND] ) {
+            TCHECK(strncmp(line, want, strlen(want)-1) == 0 && strlen(line) == strlen(want)-1);
+        } else {
+            // Skip header: time [MOD:LEVEL]
+            char* body = strstr(line, " [SYS:INFO] ");
+            TCHECK(body != NULL);
+            body += 12;
+            TCHECK(strncmp(body, want, strlen(want)-1) == 0 && strlen(body) == strlen(want)-1);
+        }
+        expectTail += 1;
+        lines += 1;
+        line = eol+1;
+    }
+    return lines;
+}
+
+static void drainAll () {
+    while( drainCheck(8*LOGLINE_LEN) > 0 );
+    TCHECK(expectTail == expectHead);
+    TCHECK(ring.head == ring.tail);
+}
+
+
+static void test_formats () {
+    static const u1_t data[40] = "0123456789abcdefghijklmnopqrstuvwxyz!?#+";
+    resetRing();
+    TCHECK(addFmt("Plain line without arguments") > 0);
+    TCHECK(addFmt("100%% done - trailing %") > 0);
+    TCHECK(addFmt("%d %u %x %X %c [%5d] [%-5d] [%05d]", -17, 17u, 0xab, 0xCD, 'z', 42, 42, 42) > 0);
+    TCHECK(addFmt("%ld %lu %lx %lX", (sL_t)-1234567890123, (uL_t)0xFFFFFFFFFFFFFFFF, (uL_t)1<<40, (uL_t)0xABCDEF012345) > 0);
+    TCHECK(addFmt("[%*s] [%-*s] [%.*s] [%*.*s]", 6, "ab", 6, "cd", 2, "abcdef", 5, 2, "xyz") > 0);
+    TCHECK(addFmt("%f %g %.2f %-8.3g|", 1.5, 1e-7, -3.14159, 2.0/3) > 0);
+    TCHECK(addFmt("%s|%10s|%-10s|%.3s|%s", "hello", "right", "left", "truncated", (const char*)NULL) > 0);
+    TCHECK(addFmt("%p %p", (void*)NULL, (void*)data) > 0);
+    TCHECK(addFmt("%E %:E %.4E %M", 0x1A2B3C4DA1B2C3D4, 0xFFFE000000000001, 0x1A2B3C4DA1B2C3D4, 0x1A2B3C4DA1B2C3D4) > 0);
+    TCHECK(addFmt("%H|%2.2H|%4H|%B", 40, data, 40, data, 40, data, 7, data) > 0);
+    TCHECK(addFmt("%T|%.3T|%.6T|%~T|%~>12T", (ustime_t)1700000000123456, (ustime_t)1700000000123456,
+                  (ustime_t)1700000000123456, rt_seconds(7200), (ustime_t)-3500) > 0);
+    TCHECK(addFmt("%F %.1F %~F", 868100000, 868100000, 869525000) > 0);
+    TCHECK(addFmt("%R %R %12R| %-12R|", 0, 5, 2|0x08, 3|0x10) > 0);
+    // Referenced data is copied - caller may free or reuse buffers right away
+    char* heap = rt_strdup("freed after logging");
+    char stack[32];
+    strcpy(stack, "first content");
+    u1_t bin[4] = { 1, 2, 3, 4 };
+    TCHECK(addFmt("%s / %s / %H", heap, stack, 4, bin) > 0);
+    memset(heap, 'X', strlen(heap));
+    rt_free(heap);
+    strcpy(stack, "second content!");
+    memset(bin, 0xEE, sizeof(bin));
+    TCHECK(addFmt("%s", stack) > 0);
+    TCHECK(addText("preformatted text record\n") > 0);
+    // Cannot be captured - caller formats synchronously
+    static u1_t big[LOGLINE_LEN+1];
+    TCHECK(addFmt("%H", (int)sizeof(big), big) == 0);
+    drainAll();
+}
+
+
+static void test_wrap () {
+    resetRing();
+    int wraps = 0, drops = 0;
+    u4_t lastHead = 0;
+    char text[80];
+    for( int i=0; i < 400; i++ ) {
+        // Produce faster than consumed so the ring runs full while wrapped
+        int fill;
+        if( i % 3 == 0 ) {
+            dbuf_t b = dbuf_ini(text);
+            xprintf(&b, "text #%d %.*s\n", i, i%50, "..................................................");
+            TCHECK(xeos(&b));
+            fill = addText(text);
+        } else {
+            fill = addFmt("record #%d %.*s %H", i, i%40, "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMN", i%17, (const u1_t*)"\1\2\3\4\5\6\7\10\11\12\13\14\15\16\17\20");
+        }
+        TCHECK(fill != 0);
+        if( fill < 0 )
+            drops += 1;
+        if( ring.head < lastHead )
+            wraps += 1;
+        lastHead = ring.head;
+        // Consumer has room for one formatted record (or several short texts)
+        if( i % 2 == 0 )
+            drainCheck(LOGLINE_LEN);
+    }
+    TCHECK(wraps >= 3);
+    TCHECK(drops > 0);
+    drainAll();
+}
+
+
+static void test_full () {
+    resetRing();
+    int n = 0, fill;
+    while( (fill = addFmt("filling %d", n)) > 0 ) {
+        TCHECK(fill < RINGSZ);
+        n += 1;
+    }
+    TCHECK(fill == -1);
+    TCHECK(n > 10 && n < MAXPEND);
+    // Full ring drops records - text and formatted - and keeps what is queued
+    TCHECK(addText("dropped\n") == -1);
+    TCHECK(addFmt("dropped %d", n) == -1);
+    TCHECK(expectHead - expectTail == n);
+    drainAll();
+    // Usable again - queue another full round across the ring end
+    int m = 0;
+    while( addFmt("refill %d", m) > 0 )
+        m += 1;
+    TCHECK(m >= n-1);  // may lose a slot to the wrap marker
+    drainAll();
+}
+
+
+void selftest_log () {
+    test_formats();
+    test_wrap();
+    test_full();
+}
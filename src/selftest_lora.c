@@ -35,7 +35,134 @@ static const uL_t euiFilter1[] = { 0xEFCDAB8967452300, 0xEFCDAB8967452300, 0 };
 static const uL_t euiFilter2[] = { 0xEFCDAB8967452300, 0xEFCDAB8967452301, 0 };
 
 
+// Sensor frames: 0x01 DevEUI 0x41 FCnt followed by status values (0x10..0x50), GNSS (0x61) and WiFi (0x62) scans.
+// Expected JSON after the header fields (DevEUI, FCnt, payload) as delivered to existing LNS back ends.
+#define F(...) sizeof((const u1_t[]){__VA_ARGS__}), (const u1_t[]){__VA_ARGS__}
+#define HDR(e,c) 0x01, 0x70,0xB3,0xD5,0x7E,0xD0,0x05,0x1A,e, 0x41, 0x00,0x00,(c>>8)&0xFF,c&0xFF
+static const struct {
+    int         len;
+    const u1_t* frame;
+    const char* json;
+} sfCorpus[] = {
+    // Periodic status report
+    { F( HDR(0x2C,0x0131), 0x10,0x0F,0x3C, 0x11,0x00,0x00,0x12,0x9A, 0x12,0x00,0x00,0x03,0xE8, 0x30,0x05, 0x40,0x00,0x00,0x07, 0x50,0x17 ),
+      ",\"msgtype\":\"lora\",\"Batt\":3900,\"Ener\":4762,\"Charge \":1000,\"Flags\":5,\"Resets\":7,\"Temp\":23" },
+    // Battery + temperature only
+    { F( HDR(0x2C,0x0132), 0x10,0x0E,0xD8, 0x50,0xF6 ),
+      ",\"msgtype\":\"lora\",\"Batt\":3800,\"Temp\":246" },
+    // GNSS scan
+    { F( HDR(0x31,0x0A05), 0x61, 38, 0x80,0x4F,0x2E,0x66, 0x00,0x00,0x00,0x03,
+       0x01,0x85,0x32,0xE8,0x47,0x07,0x9C,0x1B,0x28,0x4D,0x31,0x0E,0x5C,0xA3,0x17,0x06,0x8F,0x22,0x4A,0x90,0x13,0x7D,0x2B,0x65,0x19,0x04,0xB1,0x39,0x72,0xC0 ),
+      ",\"msgtype\":\"lora\",\"GNSS_TS\":1714311040,\"GNSS_Status\":3,\"GNSS\":\"018532E847079C1B284D310E5CA317068F224A90137D2B651904B13972C0\"" },
+    // WiFi scan with 4 access points
+    { F( HDR(0x31,0x0A06), 0x62, 36, 0x81,0x4F,0x2E,0x66,
+       0xB5,0x01,0x3C,0x84,0x6A,0x12,0x9E,0x40, 0xC2,0x01,0xF4,0xEC,0x38,0x8B,0x11,0x02,
+       0xC9,0x06,0x00,0x1E,0x42,0x37,0xA5,0x6D, 0xD0,0x0B,0x88,0x1F,0xA1,0x5C,0x02,0x9B ),
+      ",\"msgtype\":\"lora\",\"WiFi_TS\":1714311041,\"WiFi_MACs\":\"[\\\"B5:3C:84:6A:12:9E:40\\\",\\\"C2:F4:EC:38:8B:11:02\\\",\\\"C9:00:1E:42:37:A5:6D\\\",\\\"D0:88:1F:A1:5C:02:9B\\\"]\"" },
+    // Status, GNSS with error status, WiFi, trailing status
+    { F( HDR(0x47,0x0010), 0x10,0x0F,0x01, 0x30,0x81,
+       0x61, 12, 0x00,0x50,0x2E,0x66, 0x80,0x00,0x00,0x10, 0x00,0x00,0x00,0x00,
+       0x62, 20, 0x82,0x50,0x2E,0x66, 0xBE,0x01,0x00,0x11,0x32,0x44,0x55,0x66, 0xC0,0x01,0x00,0x11,0x32,0x44,0x55,0x67,
+       0x11,0x80,0x00,0x00,0x01, 0x50,0x15 ),
+      ",\"msgtype\":\"lora\",\"Batt\":3841,\"Flags\":129,\"GNSS_TS\":1714311168,\"GNSS_Status\":-2147483632,\"GNSS\":\"00000000\",\"WiFi_TS\":1714311298,\"WiFi_MACs\":\"[\\\"BE:00:11:32:44:55:66\\\",\\\"C0:00:11:32:44:55:67\\\"]\",\"Ener\":-2147483647,\"Temp\":21" },
+    // Empty WiFi scan
+    { F( HDR(0x47,0xFFFF), 0x62, 4, 0x00,0x00,0x00,0x80 ),
+      ",\"msgtype\":\"lora\",\"WiFi_TS\":-2147483648,\"WiFi_MACs\":\"[]\"" },
+    // Header only
+    { F( HDR(0x01,0x0000) ),
+      ",\"msgtype\":\"lora\"" },
+};
+#undef F
+#undef HDR
+
+static void selftest_sensorFrames () {
+    char jsonbuf[BUFSZ];
+    ujbuf_t B = { .buf = jsonbuf, .bufsize = BUFSZ, .pos = 0 };
+    bool is_lorawan = true;
+
+    for( int i=0; i < SIZE_ARRAY(sfCorpus); i++ ) {
+        B.pos = 0;
+        is_lorawan = true;
+        TCHECK(s2e_parse_lora_frame(&B, sfCorpus[i].frame, sfCorpus[i].len, NULL, &is_lorawan));
+        TCHECK(!is_lorawan);
+        xeos(&B);
+        TCHECK(strncmp("\"DevEUI\":\"70-B3-D5-7E-D0-05-1A-", B.buf, 31) == 0);
+        const char* tail = strstr(B.buf, ",\"msgtype\"");
+        TCHECK(tail != NULL && strcmp(sfCorpus[i].json, tail) == 0);
+    }
+    B.pos = 0;
+    TCHECK(s2e_parse_lora_frame(&B, sfCorpus[0].frame, sfCorpus[0].len, NULL, &is_lorawan));
+    xeos(&B);
+    TCHECK(strncmp("\"DevEUI\":\"70-B3-D5-7E-D0-05-1A-2C\",\"FCnt\":305,\"payload\":\"0170B3D57ED0051A2C4100000131100F3C", B.buf, 91) == 0);
+
+    const u1_t* mixed = sfCorpus[4].frame;
+    int mixedLen = sfCorpus[4].len;
+    // Variable size value exceeds frame
+    B.pos = 0;
+    TCHECK(!s2e_parse_lora_frame(&B, mixed, 14+5+2+11, NULL, &is_lorawan));
+    // Fixed size value exceeds frame
+    B.pos = 0;
+    TCHECK(!s2e_parse_lora_frame(&B, mixed, 14+2, NULL, &is_lorawan));
+    // Unknown tag stops decoding - values up to it are reported
+    u1_t f[256];
+    memcpy(f, mixed, mixedLen);
+    f[17] = 0x77;
+    B.pos = 0;
+    TCHECK(s2e_parse_lora_frame(&B, f, mixedLen, NULL, &is_lorawan));
+    xeos(&B);
+    TCHECK(strstr(B.buf, "\"Batt\":3841") != NULL && strstr(B.buf, "Flags") == NULL && strstr(B.buf, "GNSS") == NULL);
+
+    // Per frame decoding cost over the corpus
+    enum { N_BENCH = 5000 };
+    int nbytes = 0;
+    ustime_t t0 = rt_getTime();
+    for( int k=0; k<N_BENCH; k++ ) {
+        for( int i=0; i < SIZE_ARRAY(sfCorpus); i++ ) {
+            B.pos = 0;
+            s2e_parse_lora_frame(&B, sfCorpus[i].frame, sfCorpus[i].len, NULL, &is_lorawan);
+            nbytes += sfCorpus[i].len;
+        }
+    }
+    ustime_t t1 = rt_getTime();
+    LOG(MOD_S2E|INFO, "Sensor frame decoding (%d frames, avg %d bytes): %ld ns/frame", SIZE_ARRAY(sfCorpus),
+        nbytes/(N_BENCH*SIZE_ARRAY(sfCorpus)), (t1-t0)*1000/(N_BENCH*SIZE_ARRAY(sfCorpus)));
+}
+
+
+// Binary uplinks (s2e_filterLoraFrame) and JSON uplinks (s2e_parse_lora_frame) filter alike
+static void selftest_loraFilters () {
+    char jsonbuf[512];
+    ujbuf_t B = { .buf = jsonbuf, .bufsize = sizeof(jsonbuf), .pos = 0 };
+    bool is_lorawan = false;
+    uL_t joineuiFilter[2*10+2] = { 0, 0 };
+    uL_t* savedFilter = s2e_joineuiFilter;
+    s2e_joineuiFilter = joineuiFilter;
+    const u1_t* jreq = (const u1_t*)"\x00\x01\x23\x45\x67\x89\xAB\xCD\xEF\xF1\xE3\xF5\xE7\xF9\xEB\xFD\xEF\xF0\xF1\xA0\xA1\xA2\xA3";
+    const u1_t* daup = (const u1_t*)"\x40\xAB\xCD\xEF\xFF\x01\xF3\xF4\xFF\x20\x21\x22\xA0\xA1\xA2\xA3";
+
+    TCHECK(s2e_filterLoraFrame(jreq, 23) && s2e_parse_lora_frame(&B, jreq, 23, NULL, &is_lorawan));
+    memcpy(joineuiFilter, euiFilter1, sizeof(euiFilter1));
+    B.pos = 0;
+    TCHECK(!s2e_filterLoraFrame(jreq, 23) && !s2e_parse_lora_frame(&B, jreq, 23, NULL, &is_lorawan));
+    memcpy(joineuiFilter, euiFilter2, sizeof(euiFilter2));
+    B.pos = 0;
+    TCHECK(s2e_filterLoraFrame(jreq, 23) && s2e_parse_lora_frame(&B, jreq, 23, NULL, &is_lorawan));
+    TCHECK(!s2e_filterLoraFrame(jreq, 22));
+
+    u4_t netids[4];
+    memcpy(netids, s2e_netidFilter, sizeof(netids));
+    TCHECK(s2e_filterLoraFrame(daup, 16));
+    s2e_netidFilter[0] = s2e_netidFilter[1] = s2e_netidFilter[2] = s2e_netidFilter[3] = 0;
+    B.pos = 0;
+    TCHECK(!s2e_filterLoraFrame(daup, 16) && !s2e_parse_lora_frame(&B, daup, 16, NULL, &is_lorawan));
+    memcpy(s2e_netidFilter, netids, sizeof(netids));
+    s2e_joineuiFilter = savedFilter;
+}
+
+
 void selftest_lora () {
+    selftest_sensorFrames();
+    selftest_loraFilters();
     char* jsonbuf = rt_mallocN(char, BUFSZ);
 
     ujbuf_t B = { .buf = jsonbuf, .bufsize = BUFSZ, .pos = 0 };
@@ -30,6 +30,129 @@
 #include "rt.h"
 
 
+enum { N_STRESS_TMRS = 4000 };
+
+static tmr_t stressTmrs[N_STRESS_TMRS];
+static int   stressFired[N_STRESS_TMRS];
+static int   stressOrder[N_STRESS_TMRS];
+static int   stressCnt;
+
+static void stress_cb (tmr_t* tmr) {
+    int i = tmr - stressTmrs;
+    stressFired[i] += 1;
+    if( stressCnt < N_STRESS_TMRS )
+        stressOrder[stressCnt] = i;
+    stressCnt += 1;
+}
+
+static void stress_reset () {
+    stressCnt = 0;
+    memset(stressFired, 0, sizeof(stressFired));
+}
+
+static void selftest_timers () {
+    ustime_t now = rt_getTime();
+    for( int i=0; i < N_STRESS_TMRS; i++ )
+        rt_iniTimer(&stressTmrs[i], stress_cb);
+
+    // All due - must fire in deadline order, equal deadlines in arm order
+    stress_reset();
+    for( int i=0; i < N_STRESS_TMRS; i++ )
+        rt_setTimer(&stressTmrs[i], now - rt_millis(rand() % 64));
+    rt_processTimerQ();
+    TCHECK(stressCnt == N_STRESS_TMRS);
+    for( int k=1; k < N_STRESS_TMRS; k++ ) {
+        tmr_t* a = &stressTmrs[stressOrder[k-1]];
+        tmr_t* b = &stressTmrs[stressOrder[k]];
+        TCHECK(a->deadline <= b->deadline);
+        TCHECK(a->deadline < b->deadline || stressOrder[k-1] < stressOrder[k]);
+    }
+    for( int i=0; i < N_STRESS_TMRS; i++ ) {
+        TCHECK(stressFired[i] == 1);
+        TCHECK(stressTmrs[i].next == TMR_NIL);
+    }
+
+    // Re-arming moves a timer, clearing removes it
+    stress_reset();
+    for( int i=0; i < N_STRESS_TMRS; i++ )
+        rt_setTimer(&stressTmrs[i], now + rt_seconds(10) + i);
+    for( int i=0; i < N_STRESS_TMRS; i++ ) {
+        if( i % 3 == 0 )
+            rt_clrTimer(&stressTmrs[i]);
+        else if( i % 3 == 1 )
+            rt_setTimer(&stressTmrs[i], now - i);
+    }
+    rt_clrTimer(&stressTmrs[0]);  // already cleared - no-op
+    rt_processTimerQ();
+    TCHECK(stressCnt == N_STRESS_TMRS/3);
+    for( int i=0; i < N_STRESS_TMRS; i++ ) {
+        TCHECK(stressFired[i] == (i % 3 == 1));
+        TCHECK((stressTmrs[i].next == TMR_NIL) == (i % 3 != 2));
+    }
+    for( int i=2; i < N_STRESS_TMRS; i += 3 )
+        rt_clrTimer(&stressTmrs[i]);
+    rt_processTimerQ();
+    TCHECK(stressCnt == N_STRESS_TMRS/3);
+
+    // Throughput of arm/fire and arm/clear cycles
+    stress_reset();
+    ustime_t t0 = rt_getTime();
+    for( int round=0; round < 10; round++ ) {
+        now = rt_getTime();
+        for( int i=0; i < N_STRESS_TMRS; i++ )
+            rt_setTimer(&stressTmrs[i], now - rand() % 10000);
+        rt_processTimerQ();
+    }
+    ustime_t t1 = rt_getTime();
+    for( int round=0; round < 10; round++ ) {
+        now = rt_getTime();
+        for( int i=0; i < N_STRESS_TMRS; i++ )
+            rt_setTimer(&stressTmrs[i], now + rt_seconds(10) + rand() % 10000);
+        for( int i=N_STRESS_TMRS; --i >= 0; )
+            rt_clrTimer(&stressTmrs[i]);
+    }
+    ustime_t t2 = rt_getTime();
+    TCHECK(stressCnt == 10*N_STRESS_TMRS);
+    LOG(MOD_SYS|INFO, "Timer stress (%d timers): arm+fire %ld/s  arm+clear %ld/s", N_STRESS_TMRS,
+        (sL_t)10*N_STRESS_TMRS*rt_seconds(1) / max(1, t1-t0),
+        (sL_t)10*N_STRESS_TMRS*rt_seconds(1) / max(1, t2-t1));
+}
+
+
+static void selftest_crc32 () {
+    TCHECK(rt_crc32(0, "123456789", 9) == 0xCBF43926);
+    TCHECK(rt_crc32(0, "", 0) == 0);
+
+    enum { N_CRCBUF = 4096 };
+    static u1_t crcbuf[N_CRCBUF+8];
+    for( int i=0; i < sizeof(crcbuf); i++ )
+        crcbuf[i] = rand();
+    // Random offsets/lengths exercise unaligned heads and short tails
+    for( int k=0; k < 2000; k++ ) {
+        int off = rand() % 8;
+        int len = k < 64 ? k : rand() % N_CRCBUF;
+        u4_t init = rand();
+        TCHECK(rt_crc32(init, crcbuf+off, len) == rt_crc32_bytewise(init, crcbuf+off, len));
+        int cut = len ? rand() % len : 0;
+        TCHECK(rt_crc32(rt_crc32(init, crcbuf+off, cut), crcbuf+off+cut, len-cut) ==
+               rt_crc32_bytewise(init, crcbuf+off, len));
+    }
+
+    enum { N_BENCH = 2000 };
+    u4_t c0 = 0, c1 = 0;
+    ustime_t t0 = rt_getTime();
+    for( int i=0; i < N_BENCH; i++ )
+        c0 = rt_crc32_bytewise(c0, crcbuf, N_CRCBUF);
+    ustime_t t1 = rt_getTime();
+    for( int i=0; i < N_BENCH; i++ )
+        c1 = rt_crc32(c1, crcbuf, N_CRCBUF);
+    ustime_t t2 = rt_getTime();
+    TCHECK(c0 == c1);
+    LOG(MOD_SYS|INFO, "CRC32: bytewise %.1f MB/s  rt_crc32 %.1f MB/s",
+        (double)N_CRCBUF*N_BENCH/max(1, t1-t0), (double)N_CRCBUF*N_BENCH/max(1, t2-t1));
+}
+
+
 void selftest_rt () {
     TCHECK(rt_seconds(2) == rt_millis(2000));
     u1_t b[] = { 1,2,3,4,5,6,7,8 };
@@ -37,6 +160,13 @@ void selftest_rt () {
     TCHECK(rt_rmsbf2(b) == 0x0102);
     TCHECK(rt_rlsbf4(b) == 0x04030201);
     TCHECK(rt_rlsbf8(b) == (uL_t)0x0807060504030201);
+    u1_t w[8] = { 0 };
+    rt_wlsbf2(w, 0x0201);
+    TCHECK(memcmp(w, b, 2) == 0);
+    rt_wlsbf4(w, 0x04030201);
+    TCHECK(memcmp(w, b, 4) == 0);
+    rt_wlsbf8(w, (uL_t)0x0807060504030201);
+    TCHECK(memcmp(w, b, 8) == 0);
     TCHECK(rt_hexDigit('1') == 1);
     TCHECK(rt_hexDigit('a') == 10);
     TCHECK(rt_hexDigit('f') == 15);
@@ -136,4 +266,7 @@ void selftest_rt () {
     str_t sp4 = "ms400---";
     p = sp4;
     TCHECK(rt_readSpan(&p, 0) == -1);
+
+    selftest_timers();
+    selftest_crc32();
 }
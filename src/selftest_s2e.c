@@ -0,0 +1,84 @@
+/*
+ * --- Revised 3-Clause BSD License ---
+ * Copyright Semtech Corporation 2022. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright notice,
+ *       this list of conditions and the following disclaimer in the documentation
+ *       and/or other materials provided with the distribution.
+ *     * Neither the name of the Semtech corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SEMTECH CORPORATION. BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "selftests.h"
+#include "s2conf.h"
+#include "s2e.h"
+
+
+static void selftest_dcLedger () {
+    ustime_t window = DC_WINDOW;
+    DC_WINDOW = rt_seconds(3600);
+    ustime_t w = DC_WINDOW / DC_LEDGER_BUCKETS;
+    dcledger_t l = { .n = 0 };
+    ustime_t t0 = rt_seconds(1000000);
+
+    // Long low duty cycle stream: 100ms every 3min = 0.056% - must never hit the 1% budget
+    ustime_t t = t0;
+    for( int i=0; i < 48*20; i++ ) {
+        TCHECK(s2e_dcAdmit(&l, t, rt_millis(100), 100));
+        s2e_dcRecord(&l, t, rt_millis(100));
+        TCHECK(l.n <= DC_LEDGER_SIZE);
+        // Frames of last window plus at most two bucket widths
+        TCHECK(s2e_dcUsed(&l, t) <= (DC_WINDOW + 2*w) / rt_seconds(180) * rt_millis(100) + rt_millis(100));
+        t += rt_seconds(180);
+    }
+
+    // Burst up to budget of 1% band (36s/h) - then blocked until it leaves the window
+    l.n = 0;
+    t = t0;
+    for( int i=0; i < 36; i++ ) {
+        TCHECK(s2e_dcAdmit(&l, t, rt_seconds(1), 100));
+        s2e_dcRecord(&l, t, rt_seconds(1));
+        t += rt_seconds(2);
+    }
+    TCHECK(s2e_dcUsed(&l, t) == rt_seconds(36));
+    TCHECK(!s2e_dcAdmit(&l, t, rt_millis(1), 100));
+    TCHECK(!s2e_dcAdmit(&l, t0 + DC_WINDOW - 1, rt_millis(1), 100));
+    TCHECK( s2e_dcAdmit(&l, t0 + DC_WINDOW + 2*w, rt_seconds(36), 100));
+
+    // Frames queued ahead are recorded latest first - more buckets than ledger records
+    l.n = 0;
+    for( int i=3*DC_LEDGER_SIZE; --i >= 0; )
+        s2e_dcRecord(&l, t0 + i*w/2, rt_millis(10));
+    TCHECK(l.n == DC_LEDGER_SIZE);
+    TCHECK(s2e_dcUsed(&l, t0) == 3*DC_LEDGER_SIZE * rt_millis(10));
+    for( int i=1; i < l.n; i++ )
+        TCHECK(l.start[i-1] < l.start[i]);
+    TCHECK(s2e_dcUsed(&l, t0 + 3*DC_LEDGER_SIZE*w/2 + DC_WINDOW + w) == 0);
+
+    l.n = DC_LEDGER_OFF;
+    s2e_dcRecord(&l, t0, rt_seconds(100));
+    TCHECK(l.n == DC_LEDGER_OFF && s2e_dcAdmit(&l, t0, rt_seconds(100), 100));
+    DC_WINDOW = window;
+}
+
+
+void selftest_s2e () {
+    selftest_dcLedger();
+}
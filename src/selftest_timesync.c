@@ -0,0 +1,89 @@
+/*
+ * --- Revised 3-Clause BSD License ---
+ * Copyright Semtech Corporation 2022. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice,
+ *       this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright notice,
+ *       this list of conditions and the following disclaimer in the documentation
+ *       and/or other materials provided with the distribution.
+ *     * Neither the name of the Semtech corporation nor the names of its
+ *       contributors may be used to endorse or promote products derived from this
+ *       software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL SEMTECH CORPORATION. BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <math.h>
+#include "selftests.h"
+#include "s2conf.h"
+#include "ral.h"
+#include "timesync.h"
+
+
+static u4_t lcg = 1;
+
+static int jitter (int us) {
+    lcg = lcg * 1103515245 + 12345;
+    return (int)((lcg >> 8) % (2*us+1)) - us;
+}
+
+// Feed time syncs of a SX130X whose clock drifts against the MCU and check
+// how well xtimes are converted 2s past the last sync.
+static void selftest_drift () {
+    const u1_t  txunit = 1;
+    const sL_t  xbase = ((sL_t)txunit << RAL_TXUNIT_SHIFT) | ((sL_t)1 << RAL_XTSESS_SHIFT);
+    const ustime_t t0 = rt_seconds(1000);
+    const ustime_t ahead = rt_seconds(2);
+    const double drifts[] = { 25e-6, -10e-6 };   // second phase: drift changes sign
+
+    ustime_t intv = TIMESYNC_RADIO_INTV;
+    TIMESYNC_RADIO_INTV = rt_millis(2100);
+    ts_iniTimesync();
+    ustime_t u = t0;
+    double x = 0;
+    for( int p=0; p < SIZE_ARRAY(drifts); p++ ) {
+        double d = drifts[p];
+        double errsum = 0, errmax = 0;
+        int n = 0;
+        for( int i=0; i < 200; i++ ) {
+            // Sync points carry +-10us jitter on the SX130X side
+            u += TIMESYNC_RADIO_INTV;
+            x += TIMESYNC_RADIO_INTV * (1-d);
+            timesync_t sync = { .ustime = u, .xtime = xbase + (sL_t)round(x) + jitter(10) };
+            ts_updateTimesync(txunit, 0, &sync);
+            if( i < 48 )
+                continue;   // let the estimator settle (3x its horizon)
+            sL_t xt = xbase + (sL_t)round(x + ahead * (1-d));
+            double err = fabs((double)(ts_xtime2ustime(xt) - (u + ahead)));
+            errsum += err;
+            errmax = max(errmax, err);
+            n += 1;
+        }
+        // A fixed 1:1 rate would be off by ~50us / ~20us here
+        TCHECK(errsum/n < 8.0);
+        TCHECK(errmax <= 20.0);
+    }
+    // Other direction uses the same estimate
+    sL_t xt = xbase + (sL_t)round(x + ahead * (1+10e-6));
+    TCHECK(abs(ts_ustime2xtime(txunit, u + ahead) - xt) <= 20);
+    ts_iniTimesync();
+    TIMESYNC_RADIO_INTV = intv;
+}
+
+
+void selftest_timesync () {
+    selftest_drift();
+}
@@ -612,6 +612,35 @@ static void test_sugar() {
         TFAIL("G31");            // LCOV_EXCL_LINE
     TCHECK(J_EU868 == uj_msgtype(&D));
 
+    // ---------- uj_enterMsg
+    iniDecoder(&D,"{ \"msgtype\" : \"EU868\", \"diid\":1}");
+    if( uj_decode(&D) )
+        TFAIL("G40");            // LCOV_EXCL_LINE
+    TCHECK(J_EU868 == uj_enterMsg(&D));
+    TCHECK(J_diid == uj_nextField(&D));  // msgtype already consumed
+    TCHECK(1 == uj_int(&D));
+    TCHECK(0 == uj_nextField(&D));
+    uj_exitObject(&D);
+    uj_assertEOF(&D);
+    iniDecoder(&D,"{\"diid\":\"msgtype\",\"msgtype\":\"EU868\"}");
+    if( uj_decode(&D) )
+        TFAIL("G41");            // LCOV_EXCL_LINE
+    TCHECK(J_EU868 == uj_enterMsg(&D));
+    TCHECK(J_diid == uj_nextField(&D));  // fallback - still before first field
+    TCHECK(strcmp(uj_str(&D), "msgtype") == 0);
+    TCHECK(J_msgtype == uj_nextField(&D));
+    TCHECK(J_EU868 == uj_keyword(&D));
+    TCHECK(0 == uj_nextField(&D));
+    iniDecoder(&D,"{\"diid\":1}");
+    if( uj_decode(&D) )
+        TFAIL("G42");            // LCOV_EXCL_LINE
+    TCHECK(0 == uj_enterMsg(&D));
+    TCHECK(J_diid == uj_nextField(&D));
+    iniDecoder(&D,"[\"msgtype\"]");
+    if( uj_decode(&D) == 0 ) {
+        uj_enterMsg(&D);
+        TFAIL("G43");            // LCOV_EXCL_LINE
+    }
 }
 
 
@@ -713,6 +742,103 @@ static void test_indexedField_intRange() {
 }
 
 
+// Exercise SIMD/scalar boundaries of whitespace, string and hex scanning
+static void test_scan() {
+    ujdec_t D;
+    char json[200];
+    for( int n=0; n<40; n++ ) {
+        // Whitespace runs and strings with an escape at varying offsets
+        int k = 0;
+        for( int i=0; i<n; i++ ) json[k++] = " \t\r\n"[i%4];
+        k += sprintf(&json[k], "{\"%.*s\\n%.*s\":%d}", n, "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMN", n/2, "0123456789abcdefghij", n);
+        uj_iniDecoder(&D, json, k);
+        if( uj_decode(&D) ) {
+            TFAIL("Failed to parse");
+        }
+        uj_enterObject(&D);
+        TCHECK(uj_nextField(&D));
+        TCHECK((int)strlen(D.field.name) == n + 1 + n/2);
+        TCHECK(D.field.name[n] == '\n' && strncmp(D.field.name, "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMN", n) == 0);
+        TCHECK(uj_int(&D) == n);
+        TCHECK(!uj_nextField(&D));
+        uj_exitObject(&D);
+        uj_assertEOF(&D);
+
+        // Hex strings of varying length - with an illegal digit at each position
+        u1_t bin[40];
+        k = sprintf(json, "\"");
+        for( int i=0; i<n; i++ )
+            k += sprintf(&json[k], i&1 ? "%02x" : "%02X", (i*37+11) & 0xFF);
+        k += sprintf(&json[k], "\"");
+        uj_iniDecoder(&D, json, k);
+        if( uj_decode(&D) ) {
+            TFAIL("Failed to parse");
+        }
+        TCHECK(uj_hexstr(&D, bin, sizeof(bin)) == n);
+        for( int i=0; i<n; i++ )
+            TCHECK(bin[i] == ((i*37+11) & 0xFF));
+        for( int e=1; e<2*n+1; e++ ) {
+            char saved = json[e];
+            json[e] = "g/:@`G"[e%6];
+            uj_iniDecoder(&D, json, k);
+            if( !uj_decode(&D) ) {
+                uj_hexstr(&D, bin, sizeof(bin));
+                TFAIL("Illegal hex digit not detected");
+            }
+            json[e] = saved;
+        }
+    }
+}
+
+// Decoding speed for typical LNS traffic (dnmsg with a large pdu, indented router_config)
+static void test_bench() {
+    static const char* MSGS[] = {
+        "{\"msgtype\":\"dnmsg\",\"DevEui\":\"00-00-00-00-11-00-00-01\",\"dC\":0,\"diid\":35101,"
+        "\"pdu\":\"60010000018514000370DDB1A7C2D15E2F4E0E5BBE56A5B5AF9A8D0E1B7E7A76DE6D4E6C4CD3F4A25B3C"
+        "8C6E3BE0C1F4C27D9A8A3A58E2C4E7E5B2A6D8D9BCE8E4F2D6A8B3E6A1C4D0F6E3A7B8C9D0E1F2A3B4C5D6E7F8091A2B"
+        "3C4D5E6F708192A3B4C5D6E7F8091A2B3C4D5E6F708192A3B4C5D6E7F8091A2B3C4D5E6F708192A3B4C5D6E7F809A1B2\","
+        "\"RxDelay\":1,\"RX1DR\":8,\"RX1Freq\":923300000,\"RX2DR\":8,\"RX2Freq\":923300000,"
+        "\"priority\":0,\"xtime\":37154696713479316,\"rctx\":0,\"MuxTime\":1601890183.3515325}",
+        "{\n    \"msgtype\": \"router_config\",\n    \"NetID\": [ 1 ],\n    \"JoinEui\": [ [ 0, 18446744073709551615 ] ],\n"
+        "    \"region\": \"US902\",\n    \"hwspec\": \"sx1301/1\",\n    \"freq_range\": [ 902000000, 928000000 ],\n"
+        "    \"DRs\": [\n        [ 10, 125, 0 ],\n        [ 9, 125, 0 ],\n        [ 8, 125, 0 ],\n"
+        "        [ 7, 125, 0 ],\n        [ 8, 500, 0 ],\n        [ -1, 0, 0 ]\n    ],\n"
+        "    \"sx1301_conf\": [\n        {\n            \"radio_0\": { \"enable\": true, \"freq\": 902700000 },\n"
+        "            \"radio_1\": { \"enable\": true, \"freq\": 903400000 },\n"
+        "            \"chan_FSK\": { \"enable\": false },\n"
+        "            \"chan_multiSF_0\": { \"enable\": true, \"radio\": 0, \"if\": -400000 }\n        }\n    ],\n"
+        "    \"nocca\": true,\n    \"nodc\": true,\n    \"nodwell\": true\n}\n",
+    };
+    enum { N_BENCH = 20000 };
+    for( int m=0; m < SIZE_ARRAY(MSGS); m++ ) {
+        int len = strlen(MSGS[m]);
+        u1_t pdu[256];
+        ustime_t t0 = rt_getTime();
+        for( int i=0; i<N_BENCH; i++ ) {
+            ujdec_t D;
+            memcpy(jsonbuf, MSGS[m], len);
+            uj_iniDecoder(&D, jsonbuf, len);
+            if( uj_decode(&D) ) {
+                TFAIL("Failed to parse");
+            }
+            uj_enterObject(&D);
+            ujcrc_t field;
+            while( (field = uj_nextField(&D)) ) {
+                if( field == J_pdu )
+                    uj_hexstr(&D, pdu, sizeof(pdu));
+                else
+                    uj_skipValue(&D);
+            }
+            uj_exitObject(&D);
+            uj_assertEOF(&D);
+        }
+        ustime_t dt = max(1, rt_getTime()-t0);
+        LOG(MOD_JSN|INFO, "Decoding %s (%d bytes): %.1f MB/s", m ? "router_config" : "dnmsg", len,
+            (double)len*N_BENCH/dt);
+    }
+}
+
+
 void selftest_ujdec () {
     jsonbuf = rt_mallocN(char, BUFSZ);
 
@@ -733,6 +859,8 @@ void selftest_ujdec () {
     test_skip();
     test_comment();
     test_indexedField_intRange();
+    test_scan();
+    test_bench();
 
     free(jsonbuf);
 }
@@ -145,6 +145,27 @@ void selftest_txq () {
     TCHECK(n==MAX_TXJOBS);
     TCHECK(txq.txdataInUse==0);
 
+#if defined(CFG_txslots)
+    // Every job gets its own slot - data never runs out before jobs do
+    n = 0;
+    while( (j = txq_reserveJob(&txq)) != NULL ) {
+        u1_t* d = txq_reserveData(&txq, 255);
+        TCHECK(d != NULL && txq_reserveData(&txq, TXSLOT_SIZE+1) == NULL);
+        memset(d, txq_job2idx(&txq, j), 255);
+        j->len = 255;
+        txq_commitJob(&txq, j);
+        n++;
+    }
+    TCHECK(n == MAX_TXJOBS);
+    TCHECK(txq_reserveData(&txq, 1) == NULL);
+    for( int i=0; i<MAX_TXJOBS; i++ ) {
+        j = &txq.txjobs[i];
+        TCHECK(txq.txdata[j->off] == i && txq.txdata[j->off+254] == i);
+    }
+    txq_freeData(&txq, &txq.txjobs[3]);
+    TCHECK(txq.txjobs[3].off == TXOFF_NIL && txq.txjobs[4].off == 4*TXSLOT_SIZE);
+    TCHECK(txq.txdataInUse == (MAX_TXJOBS-1)*255);
+#else // !defined(CFG_txslots)
     do {
         if( (j = txq_reserveJob(&txq)) == NULL )
             TFAIL("Fail");    // LCOV_EXCL_LINE
@@ -153,6 +174,7 @@ void selftest_txq () {
         j->len = 255;
         txq_commitJob(&txq, j);
     } while(1);
+#endif // !defined(CFG_txslots)
 
     heads[0] = TXIDX_END;
     TCHECK(NULL == txq_unqJob(&txq, &heads[0]));
@@ -172,7 +194,9 @@ void selftest_rxq () {
         case 0:
         case 1:
         case 2: {
+            int room = rxq_room(&rxq);
             j = rxq_nextJob(&rxq);
+            TCHECK(room == 0 || j != NULL);
             if( j != NULL ) {
                 j->len = k < 300 ? 196 : 16;
                 rxq_commitJob(&rxq, j);
@@ -199,6 +223,41 @@ void selftest_rxq () {
             TCHECK(rxq.rxjobs[i-1].off + rxq.rxjobs[i-1].len == rxq.rxjobs[i].off);
         }
     }
+
+    // Mirror index must agree with a linear scan across commits, drops and compactions
+    rxq_ini(&rxq);
+    for( int k=0; k<4000; k++ ) {
+        r = rand() % 6;
+        if( r < 4 ) {
+            if( (j = rxq_nextJob(&rxq)) == NULL )
+                continue;
+            j->dr = rand() % 2;
+            j->len = 16 + (rand() % 3) * 80;
+            j->rxtime = k;
+            memset(&rxq.rxdata[j->off], rand() % 8, j->len);
+            ustime_t since = k - 50;
+            rxjob_t* m = rxq_findMirror(&rxq, j, since);
+            rxjob_t* x = NULL;
+            for( rxjob_t* q = &rxq.rxjobs[rxq.first]; q < j; q++ ) {
+                if( q->dr == j->dr && q->len == j->len && q->rxtime >= since &&
+                    memcmp(&rxq.rxdata[q->off], &rxq.rxdata[j->off], j->len) == 0 )
+                    x = q;
+            }
+            TCHECK((m == NULL) == (x == NULL));
+            if( m == NULL ) {
+                rxq_commitJob(&rxq, j);
+            } else if( r == 0 ) {
+                rxq_commitJob(&rxq, j);
+                rxq_dropJob(&rxq, m);
+            }
+        } else if( r == 4 ) {
+            if( rxq.first < rxq.next )
+                rxq.first += 1;
+        } else {
+            if( rxq.first+2 < rxq.next )
+                rxq_dropJob(&rxq, &rxq.rxjobs[rxq.first+1]);
+        }
+    }
     rt_free(_rxq);
 }
 
@@ -45,6 +45,9 @@ static void (*const selftest_fns[])() = {
     selftest_ujenc,
     selftest_xprintf,
     selftest_fs,
+    selftest_s2e,
+    selftest_timesync,
+    selftest_log,
     NULL
 };
 
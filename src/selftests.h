@@ -49,6 +49,9 @@ extern void selftest_ujdec ();
 extern void selftest_ujenc ();
 extern void selftest_xprintf ();
 extern void selftest_fs ();
+extern void selftest_s2e ();
+extern void selftest_timesync ();
+extern void selftest_log ();
 
 void selftest_fail (const char* expr, const char* file, int line);
 void selftests ();
@@ -72,7 +72,6 @@ static const char sFN_TAF[] = "-temp.upd\0" "-temp.cpy\0" "-bak.done\0" "?";  //
 
 static char* CFNS[nFN_CAT*(nFN_SET * nFN_EXT + nFN_TAF)];
 static u1_t  bakDone[nFN_CAT];
-static char  uriCache[nFN_SET-1][MAX_URI_LEN];
 static char* pendData;
 
 enum { UPD_CUPS=1<<FN_CUPS, UPD_TC=1<<FN_TC, UPD_ERROR=0xFF };;
@@ -249,25 +248,60 @@ uL_t sys_eui () {
     return prefixEUI | protoEUI;
 }
 
+// In-memory copy of config/credential files - read lazily, dropped whenever
+// the station writes, renames or unlinks files of a set.
+// Avoids rereading (flash) files on every connect and CUPS check-in.
+static struct credset {
+    dbuf_t files[nFN_EXT];   // buf==NULL: absent/unreadable, zero-terminated otherwise
+    u4_t   crc;              // see sys_crcCred
+    u1_t   loaded;
+} credStore[nFN_CAT][nFN_SET];
+
+static void dropCredSet (int cat, int set) {
+    struct credset* cs = &credStore[cat][set];
+    for( int ext=0; ext < nFN_EXT; ext++ )
+        rt_free(cs->files[ext].buf);
+    memset(cs, 0, sizeof(*cs));
+}
+
+static struct credset* getCredSet (int cat, int set) {
+    struct credset* cs = &credStore[cat][set];
+    if( cs->loaded )
+        return cs;
+    u4_t crc = 0;
+    for( int ext=0; ext < nFN_EXT; ext++ ) {
+        dbuf_t data = readFile(configFilename(cat, set, ext), 0);
+        if( ext == FN_URI && data.buf ) {
+            data.bufsize = data.pos = trimEnd(data.buf);
+        }
+        else if( ext != FN_URI ) {
+            if( data.buf && data.bufsize != 0 )
+                crc = rt_crc32(crc, data.buf, data.bufsize);
+            else
+                crc = rt_crc32(crc, &(u1_t[]){0,0,0,0}, 4);
+        }
+        cs->files[ext] = data;
+    }
+    cs->crc = crc;
+    cs->loaded = 1;
+    return cs;
+}
+
 str_t sys_uri (int cred_cat, int cred_set) {
-    str_t uri_fn = configFilename(cred_cat, cred_set, FN_URI);
-    dbuf_t dbuf = readFile(uri_fn, 0);
-    if( dbuf.buf == NULL )
+    dbuf_t* uri = &getCredSet(cred_cat, cred_set)->files[FN_URI];
+    if( uri->buf == NULL )
         return NULL;
-    dbuf.bufsize = trimEnd(dbuf.buf);
-    if( dbuf.bufsize+1 > MAX_URI_LEN ) {
-        LOG(MOD_SYS|ERROR, "URI in '%s' too long (max %d): %s", uri_fn, MAX_URI_LEN, dbuf.buf);
-        rt_free(dbuf.buf);
+    if( uri->bufsize+1 > MAX_URI_LEN ) {
+        LOG(MOD_SYS|ERROR, "URI in '%s' too long (max %d): %s",
+            configFilename(cred_cat, cred_set, FN_URI), MAX_URI_LEN, uri->buf);
         return NULL;
     }
-    char* p = &uriCache[cred_cat][cred_set];
-    strcpy(p, dbuf.buf);
-    rt_free(dbuf.buf);
-    return p;
+    return uri->buf;
 }
 
 void sys_saveUri (int cred_cat, str_t uri) {
     str_t uri_fn = configFilename(cred_cat, FN_TEMP, FN_URI);
+    dropCredSet(cred_cat, FN_TEMP);
     if( !writeFile(uri_fn, uri, strlen(uri)) )
         updateState |= UPD_ERROR;
     updateState |= (1<<cred_cat);
@@ -313,6 +347,8 @@ int checkUris () {
 static int updateConfigFiles (int cat, int rollFwd) {
     // Rename temp setup files to regular files.
     str_t taf_upd = transactionFilename(cat, FN_UPD);
+    dropCredSet(cat, FN_TEMP);
+    dropCredSet(cat, FN_REG);
     if( !rollFwd && !writeFile(taf_upd, "", 0) ) {
         fs_unlink(taf_upd);
         LOG(MOD_SYS|CRITICAL, "Failed to create '%s': %s", taf_upd);
@@ -345,6 +381,7 @@ static int backupConfigFiles (int cat, int rollFwd) {
         return 0;
     }
     fs_sync();
+    dropCredSet(cat, FN_BAK);
     str_t unlink_fn = transactionFilename(cat, FN_DON);
     if( fs_unlink(unlink_fn) == -1 && errno != ENOENT ) {
       unlink_fail:
@@ -444,11 +481,14 @@ void checkRollForward () {
 int sys_cred (int cred_cat, int cred_set, str_t* elems, int* elemslen) {
     memset(elems,    0, sizeof(elems[0]   ) * SYS_CRED_NELEMS);
     memset(elemslen, 0, sizeof(elemslen[0]) * SYS_CRED_NELEMS);
+    struct credset* cs = getCredSet(cred_cat, cred_set);
     for( int ext=FN_TRUST; ext < FN_URI; ext++ ) {
-        str_t fn = configFilename(cred_cat, cred_set, ext);
-        int sz = sizeFile(fn);
-        if( sz > 0 ) { // Empty file (sz==0) is treated as absent
-            elems[ext] = fn;
+        dbuf_t* f = &cs->files[ext];
+        if( f->buf && f->bufsize > 0 ) { // Empty file is treated as absent
+            elems[ext] = f->buf;
+            // mbedTLS takes data as PEM if it contains a BEGIN marker and then expects
+            // the terminating '\0' to be included
+            elemslen[ext] = f->bufsize + (strstr(f->buf, "-----BEGIN ") ? 1 : 0);
         }
     }
     if( elems[SYS_CRED_TRUST] == NULL ) {
@@ -465,22 +505,14 @@ int sys_cred (int cred_cat, int cred_set, str_t* elems, int* elemslen) {
 
 
 u4_t sys_crcCred (int cred_cat, int cred_set) {
-    u4_t crc = 0;
-    for( int ext=FN_TRUST; ext < FN_URI; ext++ ) {
-        dbuf_t data = readFile(configFilename(cred_cat, cred_set, ext), 0);
-        if( data.buf && data.bufsize != 0 )
-            crc = rt_crc32(crc, data.buf, data.bufsize);
-        else
-            crc = rt_crc32(crc, &(u1_t[]){0,0,0,0}, 4);
-        rt_free(data.buf);
-    }
-    return crc;
+    return getCredSet(cred_cat, cred_set)->crc;
 }
 
 
 void sys_resetConfigUpdate () {
     updateState = 0;
     for( int cat=0; cat < nFN_CAT; cat++ ) {
+        dropCredSet(cat, FN_TEMP);
         str_t fn = transactionFilename(cat, FN_UPD);
         if( fn ) fs_unlink(fn);
         for( int ext=0; ext < nFN_EXT; ext++ ) {
@@ -590,6 +622,7 @@ void sys_credComplete (int cred_cat, int len) {
             len, datalen[SYS_CRED_TRUST] + datalen[SYS_CRED_MYCERT] + datalen[SYS_CRED_MYKEY]);
         goto parsing_failed;
     }
+    dropCredSet(cred_cat, FN_TEMP);
     for( int ext=FN_TRUST; ext < FN_URI; ext++ ) {
         str_t fn = configFilename(cred_cat, FN_TEMP, ext);
         // Note: unset credential files are create as empty files.
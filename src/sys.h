@@ -45,6 +45,7 @@ extern uL_t   prefixEUI;
 void  sys_ini ();
 void  sys_fatal (int code);
 void  sys_addLog (str_t line, int len);     // output/store one log line - *is* always \n treminated
+void  sys_wakeLog (int fill);               // records pending in log ring - fill in bytes
 #if defined(CFG_sysrandom)
 int  sys_random (u1_t* buf, int len);
 #else
@@ -66,7 +67,7 @@ void sys_inState (int state);
 
 // Categories of credentials/config
 enum { SYS_CRED_CUPS, SYS_CRED_TC, SYS_CRED_MAX };  // cat - category
-enum { SYS_CRED_REG, SYS_CRED_BAK, SYS_CRED_BOOT }; // set - set of configs
+enum { SYS_CRED_REG, SYS_CRED_BAK, SYS_CRED_BOOT, SYS_CRED_NSETS }; // set - set of configs
 enum { SYS_CRED_TRUST, SYS_CRED_MYCERT, SYS_CRED_MYKEY, SYS_CRED_NELEMS };
 enum { SYS_AUTH_NONE, SYS_AUTH_SERVER, SYS_AUTH_BOTH, SYS_AUTH_TOKEN };
 str_t sys_credcat2str (int cred_cat);
@@ -97,6 +98,8 @@ int    sys_execCommand (ustime_t max_wait, str_t* argv);
 dbuf_t sys_sigKey (int key_id);
 u4_t   sys_crcSigkey (int key_id);
 dbuf_t sys_readFile (str_t filename);   // should this be here? - only used in sx130xconf.c
+dbuf_t sys_checkFile (str_t filename);  // like sys_readFile but absent file is not an error
+void   sys_writeFile (str_t filename, dbuf_t* data);
 str_t  sys_makeFilepath (str_t fn, int complain);
 
 void   sys_iniTC ();
@@ -115,6 +118,13 @@ void   sys_stopWeb ();
 
 void   sys_keepAlive (int fd);
 
+// Resolve host/port on a helper thread - cb is called from the event loop.
+// cb owns res and must release it with freeaddrinfo. err is a getaddrinfo error code.
+struct addrinfo;
+typedef void (*sys_resolvecb_t) (void* ctx, struct addrinfo* res, int err);
+void*  sys_resolve       (str_t host, str_t port, sys_resolvecb_t cb, void* ctx);  // NULL on failure
+void   sys_cancelResolve (void* job);  // cb will not be called
+
 int    sys_getLatLon (double* lat, double* lon);
 
 #endif // _sys_h_
@@ -53,12 +53,162 @@ static void tc_timeout (tmr_t* tmr) {
 }
 
 
+// Reconnect delay: exponential backoff with jitter - at least half of the nominal delay.
+// Spreads reconnects of many stations after an LNS node restarts.
+static ustime_t tc_backoff (int retries, ustime_t base, ustime_t cap) {
+    ustime_t delay = min(cap, base << min(retries, 16));
+    return delay/2 + (ustime_t)rand() % (delay/2 + 1);
+}
+
+
+// Parse a MUXS URI into tc->muxsuri: [0]=URI_TLS|URI_TCP [1]=port offset [2]=path offset [3..]=host
+static int tc_setMuxsUri (tc_t* tc, char* muxsuri, int len) {
+    if( !uri_isScheme(muxsuri,"ws") && !uri_isScheme(muxsuri,"wss") ) {
+        LOG(MOD_TCE|ERROR, "Muxs URI must be ws://.. or wss://..: %s", muxsuri);
+        return 0;
+    }
+    if( len+1 > MAX_URI_LEN ) {
+        LOG(MOD_TCE|ERROR, "Muxs URI too long (max %d): %s", MAX_URI_LEN, muxsuri);
+        return 0;
+    }
+    struct uri_info ui;
+    dbuf_t uri = { .buf=muxsuri, .bufsize=len, .pos=0 };
+    if( !uri_parse(&uri, &ui, 0) || ui.portBeg==ui.portEnd || ui.pathBeg==ui.pathEnd ) {
+        LOG(MOD_TCE|ERROR, "Illegal muxs URI (no port/path etc.): %s", muxsuri);
+        return 0;
+    }
+    memset(tc->muxsuri, 0, sizeof(tc->muxsuri));
+    u1_t portoff = ui.hostEnd - ui.hostBeg + 4;
+    u1_t pathoff = portoff + ui.portEnd - ui.portBeg + 1;
+    tc->muxsuri[0] = muxsuri[2]=='s' ? URI_TLS : URI_TCP;
+    tc->muxsuri[1] = portoff;
+    tc->muxsuri[2] = pathoff;
+    memcpy(&tc->muxsuri[3],       &muxsuri[ui.hostBeg], ui.hostEnd - ui.hostBeg);
+    memcpy(&tc->muxsuri[portoff], &muxsuri[ui.portBeg], ui.portEnd - ui.portBeg);
+    memcpy(&tc->muxsuri[pathoff], &muxsuri[ui.pathBeg], ui.pathEnd - ui.pathBeg);
+    return 1;
+}
+
+
+// --------------------------------------------------------------------------------
+//
+// Cache of the last MUXS URI which accepted a connection
+//
+// Kept in memory and in the temp dir so that reconnects and restarts can go
+// to MUXS directly and skip the INFOS round trip. Bound to the INFOS URI it
+// was obtained from and expires after MUXS_URI_TTL.
+//
+// --------------------------------------------------------------------------------
+
+static str_t const muxscache_filename = "~temp/station.muxs";
+
+static struct {
+    char     infosuri[MAX_URI_LEN];
+    char     muxsuri[MAX_URI_LEN];
+    ustime_t expires;   // UTC - 0 if cache is empty
+    u1_t     loaded;    // file has been consulted
+} muxscache;
+
+
+static void muxscache_write () {
+    char buf[3*MAX_URI_LEN];
+    dbuf_t b = dbuf_ini(buf);
+    if( muxscache.expires ) {
+        uj_encOpen(&b, '{');
+        uj_encKVn(&b,
+                  "infos_uri", 's', muxscache.infosuri,
+                  "uri",       's', muxscache.muxsuri,
+                  "expires",   'I', muxscache.expires,
+                  NULL);
+        uj_encClose(&b, '}');
+    }
+    sys_writeFile(muxscache_filename, &b);
+}
+
+
+static void muxscache_load () {
+    muxscache.loaded = 1;
+    dbuf_t b = sys_checkFile(muxscache_filename);
+    if( b.buf == NULL || b.bufsize == 0 )
+        goto done;
+    ujdec_t D;
+    uj_iniDecoder(&D, b.buf, b.bufsize);
+    if( uj_decode(&D) ) {
+        LOG(MOD_TCE|WARNING, "Parsing of '%s' failed - ignoring cached MUXS URI", muxscache_filename);
+        memset(&muxscache, 0, sizeof(muxscache));
+        muxscache.loaded = 1;
+        goto done;
+    }
+    uj_enterObject(&D);
+    ujcrc_t field;
+    while( (field = uj_nextField(&D)) ) {
+        switch(field) {
+        case J_infos_uri: { snprintf(muxscache.infosuri, sizeof(muxscache.infosuri), "%s", uj_str(&D)); break; }
+        case J_uri:       { snprintf(muxscache.muxsuri,  sizeof(muxscache.muxsuri),  "%s", uj_str(&D)); break; }
+        case J_expires:   { muxscache.expires = uj_int(&D); break; }
+        default:          { uj_skipValue(&D); break; }
+        }
+    }
+    uj_exitObject(&D);
+ done:
+    rt_free(b.buf);
+}
+
+
+static void muxscache_clear () {
+    if( muxscache.expires == 0 )
+        return;
+    memset(&muxscache, 0, sizeof(muxscache));
+    muxscache.loaded = 1;
+    muxscache_write();
+}
+
+
+static void muxscache_save (tc_t* tc) {
+    str_t infosuri = sys_uri(SYS_CRED_TC, tc->credset);
+    if( MUXS_URI_TTL <= 0 || infosuri == NULL || tc->muxsuri[0] == URI_BAD )
+        return;
+    ustime_t now = rt_getUTC();
+    const char* u = tc->muxsuri;
+    snprintf(muxscache.infosuri, sizeof(muxscache.infosuri), "%s", infosuri);
+    snprintf(muxscache.muxsuri, sizeof(muxscache.muxsuri), "ws%s://%s:%s%s",
+             u[0]==URI_TLS ? "s" : "", u+3, &u[(u1_t)u[1]], &u[(u1_t)u[2]]);
+    muxscache.expires = now + MUXS_URI_TTL;
+    muxscache.loaded = 1;
+    muxscache_write();
+}
+
+
+// Fill in tc->muxsuri from cache if there is a valid entry for the current INFOS URI
+static int muxscache_lookup (tc_t* tc, str_t infosuri) {
+    if( MUXS_URI_TTL <= 0 )
+        return 0;
+    if( !muxscache.loaded )
+        muxscache_load();
+    if( muxscache.expires == 0 || strcmp(muxscache.infosuri, infosuri) != 0 )
+        return 0;
+    if( muxscache.expires <= rt_getUTC() || muxscache.expires > rt_getUTC() + MUXS_URI_TTL ) {
+        muxscache_clear();  // expired or clock went backwards
+        return 0;
+    }
+    if( !tc_setMuxsUri(tc, muxscache.muxsuri, strlen(muxscache.muxsuri)) ) {
+        muxscache_clear();
+        return 0;
+    }
+    return 1;
+}
+
+
 static void tc_muxs_connection (conn_t* _conn, int ev) {
     tc_t* tc = conn2tc(_conn);
     if( ev == WSEV_CONNECTED ) {
         rt_clrTimer(&tc->timeout);
         tc->tstate = TC_MUXS_CONNECTED;
         LOG(MOD_TCE|VERBOSE, "Connected to MUXS.");
+        // Only a URI freshly obtained from INFOS starts a new TTL period - reconnects to
+        // a cached URI must not extend it, otherwise INFOS would never be asked again.
+        if( !tc->muxsCached )
+            muxscache_save(tc);
         dbuf_t b = ws_getSendbuf(&tc->ws, MIN_UPJSON_SIZE);
         assert(b.buf != NULL);   // this should not fail on a fresh connection
         uj_encOpen(&b, '{');
@@ -183,29 +333,8 @@ static void tc_info_request (conn_t* _conn, int ev) {
             case J_muxs  : { muxsid  = uj_str(&D); break; }
             case J_error : { error   = uj_str(&D); break; }
             case J_uri   : { muxsuri = uj_str(&D);
-                if( !uri_isScheme(muxsuri,"ws") && !uri_isScheme(muxsuri,"wss") ) {
-                    LOG(MOD_TCE|ERROR, "Muxs URI must be ws://.. or wss://..: %s", muxsuri);
-                    goto failed;
-                }
-                if( D.str.len+1 > MAX_URI_LEN ) {
-                    LOG(MOD_TCE|ERROR, "Muxs URI too long (max %d): %s", MAX_URI_LEN, muxsuri);
-                    goto failed;
-                }
-                struct uri_info ui;
-                dbuf_t uri = { .buf=D.str.beg, .bufsize=D.str.len, .pos=0 };
-                if( !uri_parse(&uri, &ui, 0) || ui.portBeg==ui.portEnd || ui.pathBeg==ui.pathEnd ) {
-                    LOG(MOD_TCE|ERROR, "Illegal muxs URI (no port/path etc.): %s", muxsuri);
+                if( !tc_setMuxsUri(tc, muxsuri, D.str.len) )
                     goto failed;
-                }
-                memset(tc->muxsuri, 0, sizeof(tc->muxsuri));
-                u1_t portoff = ui.hostEnd - ui.hostBeg + 4;
-                u1_t pathoff = portoff + ui.portEnd - ui.portBeg + 1;
-                tc->muxsuri[0] = muxsuri[2]=='s' ? URI_TLS : URI_TCP;
-                tc->muxsuri[1] = portoff;
-                tc->muxsuri[2] = pathoff;
-                memcpy(&tc->muxsuri[3],       &muxsuri[ui.hostBeg], ui.hostEnd - ui.hostBeg);
-                memcpy(&tc->muxsuri[portoff], &muxsuri[ui.portBeg], ui.portEnd - ui.portBeg);
-                memcpy(&tc->muxsuri[pathoff], &muxsuri[ui.pathBeg], ui.pathEnd - ui.pathBeg);
                 break;
             }
             default: {
@@ -281,6 +410,9 @@ tc_t* tc_ini (tmrcb_t ondone) {
     tc->credset = SYS_CRED_REG;
     tc->ondone = ondone==NULL ? tc_ondone_default : ondone;
     tc->muxsuri[0] = URI_BAD;
+    rt_addFeature("updf-bin");  // LNS may switch uplinks to binary frames
+    if( UPDF_BATCH_MAX > 1 )
+        rt_addFeature("updf-batch");  // LNS may enable batched uplinks
     s2e_ini(&tc->s2ctx);
     tc->s2ctx.getSendbuf = tc_getSendbuf;
     tc->s2ctx.sendText   = tc_sendText;
@@ -319,6 +451,12 @@ void tc_start (tc_t* tc) {
         LOG(MOD_TCE|ERROR,"Bad TC URI: %s", tc);
         goto errexit;
     }
+    if( muxscache_lookup(tc, tcuri) ) {
+        LOG(MOD_TCE|INFO, "Connecting to cached MUXS (skipping INFOS): %s", muxscache.muxsuri);
+        tc->muxsCached = 1;
+        tc_connect_muxs(tc);
+        return;
+    }
     if( ok == URI_TLS && !conn_setup_tls(&tc->ws, SYS_CRED_TC, tc->credset, hostname) ) {
         goto errexit;
     }
@@ -369,20 +507,30 @@ void tc_continue (tc_t* tc) {
         // We have a muxs uri
         if( tc->retries <= 4 && tstate == TC_ERR_CLOSED ) {
             // Try to reconnect with increasing backoff
-            int backoff = 1 << tc->retries;
+            ustime_t backoff = tc_backoff(tc->retries, rt_seconds(1), rt_seconds(16));
             tc->tstate = TC_MUXS_BACKOFF;
-            rt_setTimerCb(&tc->timeout, rt_seconds_ahead(backoff), tc->ondone);
-            LOG(MOD_TCE|INFO, "MUXS reconnect backoff %ds (retry %d)", backoff, tc->retries);
+            rt_setTimerCb(&tc->timeout, rt_micros_ahead(backoff), tc->ondone);
+            LOG(MOD_TCE|INFO, "MUXS reconnect backoff %~T (retry %d)", backoff, tc->retries);
             return;
         }
+        // Give up on this muxs - ask INFOS again
+        muxscache_clear();
         tc->muxsuri[0] = URI_BAD;
+        if( tc->muxsCached ) {
+            // Cached MUXS did not work out - go to INFOS right away
+            LOG(MOD_TCE|INFO, "Cached MUXS unreachable - asking INFOS");
+            tc->muxsCached = 0;
+            tc->tstate = TC_INFOS_BACKOFF;
+            rt_yieldTo(&tc->timeout, tc->ondone);
+            return;
+        }
         tc->retries = 1;
     }
 
-    int backoff = min(tc->retries, 6);
+    ustime_t backoff = tc_backoff(tc->retries, rt_seconds(10), rt_seconds(60));
     tc->tstate = TC_INFOS_BACKOFF;
-    rt_setTimerCb(&tc->timeout, rt_seconds_ahead(backoff * 10), tc->ondone);
-    LOG(MOD_TCE|INFO, "INFOS reconnect backoff %ds (retry %d)", backoff*10, tc->retries);
+    rt_setTimerCb(&tc->timeout, rt_micros_ahead(backoff), tc->ondone);
+    LOG(MOD_TCE|INFO, "INFOS reconnect backoff %~T (retry %d)", backoff, tc->retries);
 }
 
 
@@ -56,6 +56,7 @@ typedef struct tc {
     s1_t     tstate;      // state of TC engine
     u1_t     credset;     // connect via this credential set
     u1_t     retries;
+    u1_t     muxsCached;  // muxsuri taken from cache - fall back to INFOS if MUXS is unreachable
     char     muxsuri[MAX_URI_LEN+3];
     tmrcb_t  ondone;
     s2ctx_t  s2ctx;
@@ -32,6 +32,7 @@
 #include "tc.h"
 #include "timesync.h"
 #include "ral.h"
+#include "metrics.h"
 
 #if defined(CFG_smtcpico)
 #define _MAX_DT 300
@@ -45,6 +46,7 @@
 #define MCU_DRIFT_THRES        90  // cut off quantile - for MCU sync quality
 #define PPS_DRIFT_THRES        80  // cut off quantile - for PPS sync quality
 #define N_DRIFTS               20  // size of quantile table MCU/PPS
+#define DRIFT_FILTER_N         16  // horizon of MCU/SX130X drift estimator (samples)
 #define QUICK_RETRIES           3
 #define PPM       ((sL_t)1000000)  // 1sec in micros
 #define iPPM_SCALE             10  // keep drifts in deci ppm as ints
@@ -60,11 +62,7 @@
 #define UTC_GPS_EPOCH_US 315964800 // UTC epoch expressed in s since GPS epoch
 
 #define ustimeRoundSecs(x) (((x) + PPM/2) / PPM * PPM)
-#define ustime2xtime(sync, _ustime) ((sync)->xtime + ((_ustime)-(sync)->ustime))
 #define xtime2ustime(sync, _xtime)  ((sync)->ustime + ((_xtime)-(sync)->xtime))
-#define xtime2xtime(src_sync, dst_sync, _xtime)                 \
-    (((dst_sync)->xtime - (src_sync)->xtime) +                  \
-     ((src_sync)->ustime - (dst_sync)->ustime) + (_xtime))
 
 
 struct quants {
@@ -76,8 +74,9 @@ static struct txunit_stats {
     int drift_thres;   // drift threshold (MCU_DRIFT_THRES quantile)
     int mcu_drifts[N_DRIFTS];
     int mcu_drifts_widx;
+    int drift_n;       // samples in drift estimate (saturates at DRIFT_FILTER_N)
+    double drift;      // estimated MCU/SX130X rate: dustime = dxtime * (1+drift)
 } txunit_stats[MAX_TXUNITS];
-static int         sum_mcu_drifts;    // sum of txunit_stats[0].mcu_drifts
 
 static int         pps_drifts[N_DRIFTS];
 static int         pps_drifts_widx;
@@ -99,6 +98,26 @@ static int         syncQual_thres;  // current threshold
 // Fwd decl
 static void onTimesyncLns (tmr_t* tmr);
 
+// Incremental drift estimate - running mean at first then exponentially weighted,
+// so each sample is O(1) and the estimate follows temperature induced changes.
+static void updateDrift (struct txunit_stats* stats, double drift) {
+    if( stats->drift_n < DRIFT_FILTER_N )
+        stats->drift_n += 1;
+    stats->drift += (drift - stats->drift) / stats->drift_n;
+}
+
+// Extrapolate from a time sync point taking the estimated drift into account
+static ustime_t sync_xtime2ustime (const timesync_t* sync, u1_t txunit, sL_t xtime) {
+    sL_t dx = xtime - sync->xtime;
+    return sync->ustime + dx + (sL_t)round(dx * txunit_stats[txunit].drift);
+}
+
+static sL_t sync_ustime2xtime (const timesync_t* sync, u1_t txunit, ustime_t ustime) {
+    double drift = txunit_stats[txunit].drift;
+    sL_t du = ustime - sync->ustime;
+    return sync->xtime + du - (sL_t)round(du * drift / (1.0 + drift));
+}
+
 static void timesyncReport (int force) {
     ustime_t now = rt_getTime();
     if( !force && now < lastReport + TIMESYNC_REPORTS )
@@ -111,7 +130,7 @@ static void timesyncReport (int force) {
         timesyncs[0].ustime, timesyncs[0].xtime, pps_ustime, timesyncs[0].pps_xtime);
     if( !ppsOffset )
         return;
-    pps_ustime = xtime2ustime(&timesyncs[0], ppsSync.pps_xtime);
+    pps_ustime = sync_xtime2ustime(&timesyncs[0], 0, ppsSync.pps_xtime);
     LOG(MOD_SYN|INFO, "Time sync: Last PPS     ustime=0x%012lX xtime=0x%lX pps_ustime=0x%lX pps_xtime=0x%lX",
         ppsSync.ustime, ppsSync.xtime, pps_ustime, ppsSync.pps_xtime);
     if( !gpsOffset )
@@ -126,14 +145,6 @@ static int encodeDriftPPM (double drift) {
     return (int)round((drift - 1.0) * PPM * iPPM_SCALE);
 }
 
-static double decodeDriftPPM (double scaled_ppm) {
-    return 1.0 + scaled_ppm / (PPM * fPPM_SCALE);
-}
-
-static double decodePPM (double scaled_ppm) {
-    return scaled_ppm / fPPM_SCALE;
-}
-
 static int cmp_abs_int (const void* a, const void* b) {
     return abs(*(int*)a) - abs(*(int*)b);
 }
@@ -162,13 +173,12 @@ static int log_drift_stats (str_t msg, int* drifts, int thresQ, int* auxQ) {
 }
 
 ustime_t ts_normalizeTimespanMCU (ustime_t timespan) {
-    
-    
-    return (ustime_t)round(timespan / decodeDriftPPM((double)sum_mcu_drifts / N_DRIFTS));
-    return (ustime_t)round( timespan / (1.0 + sum_mcu_drifts / (PPM*iPPM_SCALE) / N_DRIFTS) );
+    return (ustime_t)round(timespan / (1.0 + txunit_stats[0].drift));
 }
 
 ustime_t ts_updateTimesync (u1_t txunit, int quality, const timesync_t* curr) {
+    metric_inc(MET_TS_UPDATES);
+    metric_observe(MET_H_TSQUAL, abs(quality));
     syncQual[syncQual_widx] = quality;
     syncQual_widx = (syncQual_widx + 1) % N_SYNC_QUAL;
     if( syncQual_widx == 0 ) {
@@ -182,6 +192,7 @@ ustime_t ts_updateTimesync (u1_t txunit, int quality, const timesync_t* curr) {
     }
     if( abs(quality) > syncQual_thres ) {
         LOG(MOD_SYN|VERBOSE, "Time sync rejected: quality=%d threshold=%d", quality, syncQual_thres);
+        metric_inc(MET_TS_REJECTED);
         return TIMESYNC_RADIO_INTV;
     }
 
@@ -204,22 +215,14 @@ ustime_t ts_updateTimesync (u1_t txunit, int quality, const timesync_t* curr) {
     }
     struct txunit_stats* stats = &txunit_stats[txunit];
     int drift_ppm = encodeDriftPPM( (double)dus/(double)dxc );
-    if( txunit == 0 )
-        sum_mcu_drifts += drift_ppm - stats->mcu_drifts[stats->mcu_drifts_widx];
     stats->mcu_drifts[stats->mcu_drifts_widx] = drift_ppm;
     stats->mcu_drifts_widx = (stats->mcu_drifts_widx + 1) % N_DRIFTS;
     if( stats->mcu_drifts_widx == 0 ) {
-        
-        
-        
+        // Quantiles only steer outlier rejection - conversions use the drift estimate
         int thres = log_drift_stats("MCU/SX130X drift stats", stats->mcu_drifts, MCU_DRIFT_THRES, NULL);
         stats->drift_thres = max(MIN_MCU_DRIFT_THRES, min(MAX_MCU_DRIFT_THRES, abs(thres)));
-        double mean_ppm = decodePPM( ((double)sum_mcu_drifts) / N_DRIFTS);
-        LOG(MOD_SYN|INFO, "Mean MCU drift vs SX130X#0: %.1fppm",  mean_ppm);
-        if( rt_utcOffset_ts != 0 && !ppsSync.pps_xtime) {
-            rt_utcOffset -= (curr->ustime - rt_utcOffset_ts) * mean_ppm/PPM;
-            rt_utcOffset_ts = curr->ustime;
-        }
+        if( txunit == 0 )
+            LOG(MOD_SYN|INFO, "Mean MCU drift vs SX130X#0: %.1fppm",  stats->drift * PPM);
     }
     if( abs(drift_ppm) > stats->drift_thres ) {
         stats->excessive_drift_cnt += 1;
@@ -232,6 +235,12 @@ ustime_t ts_updateTimesync (u1_t txunit, int quality, const timesync_t* curr) {
         return TIMESYNC_RADIO_INTV/2;
     }
     stats->excessive_drift_cnt = 0;
+    updateDrift(stats, (double)dus/(double)dxc - 1.0);
+    if( txunit == 0 && rt_utcOffset_ts != 0 && !ppsSync.pps_xtime ) {
+        // No PPS - keep UTC reference in line with the SX130X clock
+        rt_utcOffset -= (curr->ustime - rt_utcOffset_ts) * stats->drift;
+        rt_utcOffset_ts = curr->ustime;
+    }
     ustime_t delay = TIMESYNC_RADIO_INTV;
 
     // Only txunit#0 can have PPS or we're not tracking a PPS
@@ -327,7 +336,9 @@ sL_t ts_gpstime2xtime (u1_t txunit, sL_t gpstime) {
         return 0;
     }
     sL_t xtime = gpstime - gpsOffset + ppsSync.pps_xtime;
-    return txunit==0 ? xtime : xtime2xtime(&ppsSync, &timesyncs[txunit], xtime);
+    if( txunit == 0 )
+        return xtime;
+    return sync_ustime2xtime(&timesyncs[txunit], txunit, sync_xtime2ustime(&ppsSync, 0, xtime));
 }
 
 sL_t ts_xtime2gpstime (sL_t xtime) {
@@ -346,8 +357,7 @@ sL_t ts_xtime2gpstime (sL_t xtime) {
 sL_t ts_ustime2xtime (u1_t txunit, ustime_t ustime) {
     if( txunit >= MAX_TXUNITS || timesyncs[txunit].xtime == 0 )
         return 0; // cannot convert
-    const timesync_t* sync = &timesyncs[txunit];
-    return ustime2xtime(sync, ustime);
+    return sync_ustime2xtime(&timesyncs[txunit], txunit, ustime);
 }
 
 ustime_t ts_xtime2ustime (sL_t xtime) {
@@ -366,7 +376,7 @@ ustime_t ts_xtime2ustime (sL_t xtime) {
             xtime, ral_xtime2sess(xtime), ral_xtime2sess(sync->xtime));
         return 0;
     }
-    return xtime2ustime(sync, xtime);
+    return sync_xtime2ustime(sync, txunit, xtime);
 }
 
 sL_t ts_xtime2xtime (sL_t xtime, u1_t dst_txunit) {
@@ -379,9 +389,8 @@ sL_t ts_xtime2xtime (sL_t xtime, u1_t dst_txunit) {
         LOG(MOD_SYN|ERROR, "Cannot convert xtime=%ld from txunit#%d to txunit#%d", xtime, src_txunit, dst_txunit);
         return 0; // cannot convert
     }
-    const timesync_t* src_sync = &timesyncs[src_txunit];
-    const timesync_t* dst_sync = &timesyncs[dst_txunit];
-    return xtime2xtime(src_sync, dst_sync, xtime);
+    ustime_t ustime = sync_xtime2ustime(&timesyncs[src_txunit], src_txunit, xtime);
+    return sync_ustime2xtime(&timesyncs[dst_txunit], dst_txunit, ustime);
 }
 
 // Convert a 32bit SX130X tick counter into a xtime reported back to the LNS
@@ -426,7 +435,6 @@ void ts_iniTimesync () {
     syncQual_thres = INT_MAX;
     syncLnsCnt = 0;
     lastReport = 0;
-    sum_mcu_drifts = 0;
     memset(timesyncs, 0, sizeof(timesyncs));
     rt_clrTimer(&syncLnsTmr);
     //LOG(MOD_SYN|INFO, "----------------------Time sync:: %d\n", timesyncs);
@@ -488,12 +496,14 @@ void ts_setTimesyncLns (ustime_t xtime, sL_t gpstime) {
 
 // Server reported back a timestamp - infer GPS second label for a specific PPS edge
 void ts_processTimesyncLns (ustime_t txtime, ustime_t rxtime, sL_t gpstime) {
+    if( TC )
+        ws_addRtt(&TC->ws, rxtime - txtime);
     if( ppsOffset < 0 || rxtime - txtime >= 2*PPM || gpsOffset )
         return;    // need ppsOffset || roundtrip too long || we already have a solution
     if( sys_modePPS == PPS_FUZZY ) {
         // In this timing mode the PPS of the gateway and the PPS of the server are not aligned.
         // This mode facilitates beaconing while not perfectly aligned to an absolute GPS time.
-        sL_t xtime = ustime2xtime(&timesyncs[0], (txtime + rxtime)/2);
+        sL_t xtime = sync_ustime2xtime(&timesyncs[0], 0, (txtime + rxtime)/2);
         LOG(MOD_SYN|INFO, "Timesync with LNS - fuzzy PPS: tx/rx=0x%lX..0x%lX xtime=0x%lX gpsOffset=0x%lX", txtime, rxtime, xtime, gpsOffset);
         ts_setTimesyncLns(xtime, gpstime);
         return;
@@ -526,7 +536,7 @@ void ts_processTimesyncLns (ustime_t txtime, ustime_t rxtime, sL_t gpstime) {
     //    us_s (localtime) equivalent to gps_s (GPS seconds since epoch)
     // Translate into a seconds offset
     const timesync_t* sync0 = &timesyncs[0];
-    sL_t pps_xtime_inferred = ustime2xtime(sync0, us_s);    // inferred PPS pulse in xtime (subject to ustime->xtime error)
+    sL_t pps_xtime_inferred = sync_ustime2xtime(sync0, 0, us_s);    // inferred PPS pulse in xtime (subject to ustime->xtime error)
     sL_t delta  = ustimeRoundSecs(pps_xtime_inferred - ppsSync.pps_xtime);  // seconds between last latched PPS and inferred
     sL_t pps_xtime = ppsSync.pps_xtime + delta;
     sL_t jitter = pps_xtime - pps_xtime_inferred;
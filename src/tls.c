@@ -40,11 +40,20 @@
 #include "uj.h"
 #include "tls.h"
 
+#define TLS_SAVED_SESSIONS 4
+
 struct tlsconf {
     mbedtls_ssl_config  sslconfig;
     mbedtls_x509_crt*   trust;
     mbedtls_x509_crt*   mycert;
     mbedtls_pk_context* mykey;
+    int                 refs;
+    // Sessions of previous connections - resumed when reconnecting to the same server
+    struct {
+        char*                servername;  // NULL if slot unused
+        mbedtls_ssl_session  session;
+    } saved[TLS_SAVED_SESSIONS];
+    u1_t                savedIdx;         // next slot to overwrite
 };
 
 u1_t tls_dbgLevel;
@@ -114,6 +123,7 @@ tlsconf_t* tls_makeConf (mbedtls_x509_crt* trust, mbedtls_x509_crt* mycert, mbed
     conf->trust  = NULL;
     conf->mycert = NULL;
     conf->mykey  = NULL;
+    conf->refs   = 1;
     int ret;
     if( (ret = mbedtls_ssl_config_defaults(&conf->sslconfig,
                                            MBEDTLS_SSL_IS_CLIENT,
@@ -134,14 +144,30 @@ tlsconf_t* tls_makeConf (mbedtls_x509_crt* trust, mbedtls_x509_crt* mycert, mbed
     mbedtls_ssl_conf_dbg(&conf->sslconfig, log_mbedDebug, NULL );
     mbedtls_debug_set_threshold(tls_dbgLevel);  // 0=off, 1=error, 2=state change, 3=info, 4=verbose
 #endif // CFG_tlsdebug
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+    mbedtls_ssl_conf_session_tickets(&conf->sslconfig, TLS_RESUME ? MBEDTLS_SSL_SESSION_TICKETS_ENABLED : MBEDTLS_SSL_SESSION_TICKETS_DISABLED);
+#endif // MBEDTLS_SSL_SESSION_TICKETS
+    return conf;
+}
+
+
+// Share a conf - each reference is dropped by tls_freeConf
+tlsconf_t* tls_refConf (tlsconf_t* conf) {
+    conf->refs += 1;
     return conf;
 }
 
 
-// NOTE: this must only be done if no tlsctx_p is referencing this conf.
+// NOTE: the last reference must only be dropped if no tlsctx_p is referencing this conf.
 void tls_freeConf (tlsconf_t* conf) {
-    if( conf == NULL )
+    if( conf == NULL || --conf->refs > 0 )
         return;
+    for( int i=0; i < TLS_SAVED_SESSIONS; i++ ) {
+        if( conf->saved[i].servername ) {
+            mbedtls_ssl_session_free(&conf->saved[i].session);
+            rt_free(conf->saved[i].servername);
+        }
+    }
     if( conf->trust ) {
         mbedtls_x509_crt_free(conf->trust);
         rt_free(conf->trust);
@@ -281,14 +307,54 @@ tlsctx_p tls_makeSession (tlsconf_t* conf, const char* servername) {
             goto fail;
         }
     }
+    if( servername && TLS_RESUME ) {
+        for( int i=0; i < TLS_SAVED_SESSIONS; i++ ) {
+            if( conf->saved[i].servername && strcmp(conf->saved[i].servername, servername) == 0 ) {
+                if( (ret = mbedtls_ssl_set_session(sslctx, &conf->saved[i].session)) != 0 ) {
+                    log_mbedError(MOD_AIO|WARNING, ret, "Cannot resume TLS session with %s", servername);
+                } else {
+                    LOG(MOD_AIO|DEBUG, "Trying to resume TLS session with %s", servername);
+                }
+                break;
+            }
+        }
+    }
     // To be done in ws_connect/http_connect
     //mbedtls_ssl_set_bio(sslctx, netctx, mbedtls_net_send, mbedtls_net_recv, NULL);
     return sslctx;
 }
 
+// Remember session parameters of a completed handshake for resumption
+static void saveSession (tlsctx_p tlsctx) {
+    if( !TLS_RESUME || tlsctx->state != MBEDTLS_SSL_HANDSHAKE_OVER || tlsctx->hostname == NULL )
+        return;
+    tlsconf_t* conf = memberof(tlsconf_t, tlsctx->conf, sslconfig);
+    int i = 0;
+    while( i < TLS_SAVED_SESSIONS && (conf->saved[i].servername == NULL || strcmp(conf->saved[i].servername, tlsctx->hostname) != 0) )
+        i++;
+    if( i == TLS_SAVED_SESSIONS ) {
+        i = conf->savedIdx;
+        conf->savedIdx = (i + 1) % TLS_SAVED_SESSIONS;
+    }
+    if( conf->saved[i].servername ) {
+        mbedtls_ssl_session_free(&conf->saved[i].session);
+        rt_free(conf->saved[i].servername);
+        conf->saved[i].servername = NULL;
+    }
+    mbedtls_ssl_session_init(&conf->saved[i].session);
+    int ret;
+    if( (ret = mbedtls_ssl_get_session(tlsctx, &conf->saved[i].session)) != 0 ) {
+        log_mbedError(MOD_AIO|DEBUG, ret, "Cannot save TLS session");
+        mbedtls_ssl_session_free(&conf->saved[i].session);
+        return;
+    }
+    conf->saved[i].servername = rt_strdup(tlsctx->hostname);
+}
+
 // NOTE: this does not free the TLS config (since it could be shared among multiple sessions)
 void tls_freeSession (tlsctx_p tlsctx) {
     if( tlsctx != NULL ) {
+        saveSession(tlsctx);
         mbedtls_ssl_free(tlsctx);
         rt_free(tlsctx);
     }
@@ -39,6 +39,7 @@ extern u1_t tls_dbgLevel;
 void log_mbedError (u1_t mod_level, int ret, const char* fmt, ...);
 
 tlsconf_t* tls_makeConf      ();
+tlsconf_t* tls_refConf       (tlsconf_t* conf);
 void       tls_freeConf      (tlsconf_t* conf);
 int        tls_setMyCert     (tlsconf_t* conf, const char* cert, int certlen, const char* key, int keylen, const char* pwd);
 int        tls_setTrustedCAs (tlsconf_t* conf, const char* file_or_data, int len);
@@ -32,6 +32,129 @@
 #include "xq.h"     // %J - txjob only
 #include "kwcrc.h"
 
+// SIMD fast paths for scanning - disable with CFG_no_simd
+#if !defined(CFG_no_simd) && defined(__SSE2__)
+#define UJ_SSE2
+#include <emmintrin.h>
+#elif !defined(CFG_no_simd) && defined(__ARM_NEON)
+#define UJ_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined(UJ_NEON)
+// Bit mask with one bit per byte lane which is set (lanes are 0x00 or 0xFF)
+static inline u4_t neon_movemask (uint8x16_t m) {
+    static const u1_t bits[16] = { 1,2,4,8,16,32,64,128, 1,2,4,8,16,32,64,128 };
+    uint8x16_t b = vandq_u8(m, vld1q_u8(bits));
+    uint8x8_t  s = vpadd_u8(vget_low_u8(b), vget_high_u8(b));
+    s = vpadd_u8(s, s);
+    s = vpadd_u8(s, s);
+    return vget_lane_u8(s, 0) | (vget_lane_u8(s, 1) << 8);
+}
+#endif
+
+// First position in [p,end) which is not JSON whitespace - end if none.
+static const char* scanWsp (const char* p, const char* end) {
+#if defined(UJ_SSE2)
+    for( ; p+16 <= end; p += 16 ) {
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        __m128i w = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                                              _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))),
+                                 _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\r')),
+                                              _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))));
+        u4_t m = ~_mm_movemask_epi8(w) & 0xFFFF;
+        if( m )
+            return p + __builtin_ctz(m);
+    }
+#elif defined(UJ_NEON)
+    for( ; p+16 <= end; p += 16 ) {
+        uint8x16_t v = vld1q_u8((const u1_t*)p);
+        uint8x16_t w = vorrq_u8(vorrq_u8(vceqq_u8(v, vdupq_n_u8(' ')), vceqq_u8(v, vdupq_n_u8('\n'))),
+                                vorrq_u8(vceqq_u8(v, vdupq_n_u8('\r')), vceqq_u8(v, vdupq_n_u8('\t'))));
+        u4_t m = ~neon_movemask(w) & 0xFFFF;
+        if( m )
+            return p + __builtin_ctz(m);
+    }
+#endif
+    while( p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t') )
+        p++;
+    return p;
+}
+
+// First position in [p,end) holding a char which ends a plain run
+// inside a JSON string: '"', '\\' or '\0' - end if none.
+static const char* scanStrRun (const char* p, const char* end) {
+#if defined(UJ_SSE2)
+    for( ; p+16 <= end; p += 16 ) {
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        __m128i w = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')),
+                                              _mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))),
+                                 _mm_cmpeq_epi8(v, _mm_setzero_si128()));
+        u4_t m = _mm_movemask_epi8(w);
+        if( m )
+            return p + __builtin_ctz(m);
+    }
+#elif defined(UJ_NEON)
+    for( ; p+16 <= end; p += 16 ) {
+        uint8x16_t v = vld1q_u8((const u1_t*)p);
+        uint8x16_t w = vorrq_u8(vorrq_u8(vceqq_u8(v, vdupq_n_u8('"')), vceqq_u8(v, vdupq_n_u8('\\'))),
+                                vceqq_u8(v, vdupq_n_u8(0)));
+        u4_t m = neon_movemask(w);
+        if( m )
+            return p + __builtin_ctz(m);
+    }
+#endif
+    while( p < end && *p != '"' && *p != '\\' && *p != 0 )
+        p++;
+    return p;
+}
+
+// Decode pairs of hex digits into dst. Stops at the first pair containing
+// a non hex digit. Returns number of bytes decoded.
+static int hexDecode (u1_t* dst, const char* s, int n) {
+    int i = 0;
+#if defined(UJ_SSE2)
+    for( ; i+8 <= n; i += 8 ) {
+        __m128i v  = _mm_loadu_si128((const __m128i*)(s+2*i));
+        __m128i lc = _mm_or_si128(v, _mm_set1_epi8(0x20));
+        __m128i dg = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0'-1)), _mm_cmplt_epi8(v, _mm_set1_epi8('9'+1)));
+        __m128i al = _mm_and_si128(_mm_cmpgt_epi8(lc, _mm_set1_epi8('a'-1)), _mm_cmplt_epi8(lc, _mm_set1_epi8('f'+1)));
+        if( _mm_movemask_epi8(_mm_or_si128(dg, al)) != 0xFFFF )
+            break;
+        __m128i nib = _mm_or_si128(_mm_and_si128(dg, _mm_sub_epi8(v, _mm_set1_epi8('0'))),
+                                   _mm_andnot_si128(dg, _mm_sub_epi8(lc, _mm_set1_epi8('a'-10))));
+        // 16 bit lanes hold (lo digit)<<8 | (hi digit)
+        __m128i b = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(nib, _mm_set1_epi16(0xFF)), 4),
+                                 _mm_srli_epi16(nib, 8));
+        _mm_storel_epi64((__m128i*)(dst+i), _mm_packus_epi16(b, b));
+    }
+#elif defined(UJ_NEON)
+    for( ; i+8 <= n; i += 8 ) {
+        uint8x8x2_t v = vld2_u8((const u1_t*)s+2*i);   // val[0] high, val[1] low digits
+        uint8x8_t nib[2];
+        uint8x8_t ok = vdup_n_u8(0xFF);
+        for( int k=0; k<2; k++ ) {
+            uint8x8_t c  = v.val[k];
+            uint8x8_t lc = vorr_u8(c, vdup_n_u8(0x20));
+            uint8x8_t dg = vand_u8(vcge_u8(c, vdup_n_u8('0')), vcle_u8(c, vdup_n_u8('9')));
+            uint8x8_t al = vand_u8(vcge_u8(lc, vdup_n_u8('a')), vcle_u8(lc, vdup_n_u8('f')));
+            ok = vand_u8(ok, vorr_u8(dg, al));
+            nib[k] = vbsl_u8(dg, vsub_u8(c, vdup_n_u8('0')), vsub_u8(lc, vdup_n_u8('a'-10)));
+        }
+        if( vget_lane_u64(vreinterpret_u64_u8(ok), 0) != ~(uint64_t)0 )
+            break;
+        vst1_u8(dst+i, vorr_u8(vshl_n_u8(nib[0], 4), nib[1]));
+    }
+#endif
+    for( ; i<n; i++ ) {
+        int b = (rt_hexDigit(s[2*i])<<4) | rt_hexDigit(s[2*i+1]);
+        if( b < 0 )
+            break;
+        dst[i] = b;
+    }
+    return i;
+}
+
 
 static int nextChar (ujdec_t* dec) {
     if( dec->read_pos >= dec->json_end ) {
@@ -47,6 +170,9 @@ static void backChar (ujdec_t* dec) {
 
 static int skipWsp (ujdec_t* dec) {
     while(1) {
+        char* p = dec->read_pos;
+        if( p+1 < dec->json_end && p[0] <= ' ' && p[1] <= ' ' )
+            dec->read_pos = (char*)scanWsp(p, dec->json_end);  // longer run - e.g. indentation
         int c = nextChar(dec);
         switch( c ) {
         case '\t':
@@ -93,6 +219,19 @@ static void parseString (ujdec_t* dec) {
     dec->str.beg = dec->read_pos;
     assert(dec->read_pos[-1] == '"');
     while(1) {
+        if( dec->read_pos < dec->json_end ) {
+            // Plain run up to next quote/backslash
+            char* p = dec->read_pos;
+            char* q = (char*)scanStrRun(p, dec->json_end);
+            for( char* r=p; r < q; r++ )
+                crc = UJ_UPDATE_CRC(crc,*r);
+            if( wp ) {
+                if( wp != p )
+                    memmove(wp, p, q-p);
+                wp += q-p;
+            }
+            dec->read_pos = q;
+        }
         int c = nextChar(dec);
         switch( c ) {
         case 0: {
@@ -558,12 +697,9 @@ int uj_hexstr (ujdec_t* dec, u1_t* buf, int bufsiz) {
         uj_error(dec,"Hex string has odd number of characters");
     if( len/2 > bufsiz )
         uj_error(dec,"Hex string too long: %d bytes, buffer is %d", len/2, bufsiz);
-    for( int i=0; i<len; i+=2 ) {
-        int b = (rt_hexDigit(s[i])<<4) | rt_hexDigit(s[i+1]);
-        if( b < 0 )
-            uj_error(dec,"Hex string contains illegal characters: %c%c", s[i], s[i+1]);
-        buf[i/2] = b;
-    }
+    int i = 2*hexDecode(buf, s, len/2);
+    if( i < len )
+        uj_error(dec,"Hex string contains illegal characters: %c%c", s[i], s[i+1]);
     return len/2;
 }
 
@@ -637,6 +773,26 @@ ujcrc_t uj_msgtype(ujdec_t* dec) {
     return 0;
 }
 
+// Enter the top level object of a message and return its msgtype (0 if none).
+// Usually msgtype is the first field - it is consumed right away and the caller
+// continues with uj_nextField in the same pass. Otherwise the raw buffer is scanned
+// with uj_msgtype and the decoder stays before the first field - handlers must
+// skip msgtype wherever it appears.
+// Must be called after uj_decode - may raise an error.
+ujcrc_t uj_enterMsg (ujdec_t* dec) {
+    uj_nextValue(dec);
+    uj_enterObject(dec);
+    const char* p = scanWsp(dec->read_pos, dec->json_end);
+    if( p+9 <= dec->json_end && memcmp(p, "\"msgtype\"", 9) == 0 ) {
+        uj_nextField(dec);
+        return uj_keyword(dec);
+    }
+    char* pos = dec->read_pos;
+    ujcrc_t msgtype = uj_msgtype(dec);
+    dec->read_pos = pos;
+    return msgtype;
+}
+
 
 // --------------------------------------------------------------------------------
 //
@@ -1126,7 +1282,7 @@ static void padField (ujbuf_t* b, ujoff_t beg, int width, int padding) {
 
 
 // Max size of a format element passed along to snprintf
-enum { MAX_FMT_SIZE = 16 };
+enum { MAX_FMT_SIZE = XPRINTF_MAX_FMT };
 
 int vxprintf(ujbuf_t* b, const char* fmt, va_list args) {
     if( b == NULL ) {
@@ -1254,7 +1410,7 @@ int vxprintf(ujbuf_t* b, const char* fmt, va_list args) {
                     break;
                 }
                 }
-                b->pos += max(0,n);
+                b->pos += max(0,min(n,bl));  // snprintf returns untruncated length
                 goto doneElem;
             }
             case 'H': {
@@ -107,6 +107,7 @@ uL_t      uj_eui    (ujdec_t*);
 ujcrc_t   uj_keyword(ujdec_t*);
 int       uj_hexstr (ujdec_t*, u1_t* buf, int bufsiz);
 ujcrc_t   uj_msgtype(ujdec_t*);
+ujcrc_t   uj_enterMsg(ujdec_t*);  // enter top level object and resolve msgtype
 void      uj_error  (ujdec_t*, str_t msg, ...);
 int       uj_indexedField (ujdec_t*, str_t prefix);  // common case in radio config files
 sL_t      uj_intRange     (ujdec_t*, sL_t minval, sL_t maxval);  // convenience - check value range
@@ -133,6 +134,8 @@ void uj_encId6  (ujbuf_t* buf, uL_t eui);
 void uj_encKV   (ujbuf_t* buf, const char* key, char type, ...);
 void uj_encKVn  (ujbuf_t* buf, ...);
 
+enum { XPRINTF_MAX_FMT = 16 };  // max size of a format element following a %
+
 int  xeos   (ujbuf_t* buf);
 int  xeol   (ujbuf_t* buf);
 void xputs  (ujbuf_t* buf, const char* s, int n);
@@ -31,6 +31,7 @@
 #include "sys.h"
 #include "uj.h"
 #include "kwcrc.h"
+#include "metrics.h"
 
 static web_t* WEB;
 
@@ -248,8 +249,25 @@ int handle_version(httpd_pstate_t* pstate, httpd_t* hd, dbuf_t* b) {
     return 200;
 }
 
+int handle_metrics(httpd_pstate_t* pstate, httpd_t* hd, dbuf_t* b) {
+    if ( pstate->method != HTTP_GET )
+        return 405; // Method not allowed
+
+    for( int bufsize = 8*1024; ; bufsize *= 2 ) {
+        b->buf = _rt_malloc(bufsize,0);
+        b->bufsize = bufsize;
+        b->pos = 0;
+        if( metrics_render(b) )
+            break;
+        rt_free(b->buf);
+    }
+    pstate->contentType = "text/plain; version=0.0.4";
+    return 200;
+}
+
 static const web_handler_t HANDLERS[] = {
     { J_api,     handle_api     },
     { J_version, handle_version },
+    { J_metrics, handle_metrics },
     { 0,         NULL           },
 };
@@ -39,6 +39,7 @@ typedef conn_t ws_t;
 // Websocket states
 enum {
     WS_DEAD = 0,
+    WS_TCP_CONNECTING,
     WS_TLS_HANDSHAKE,
     WS_CLIENT_REQ,
     WS_SERVER_RESP,
@@ -74,6 +75,7 @@ void   ws_ini        (ws_t*, int rbufsize, int wbufsize);
 void   ws_free       (ws_t*);                   // free all resources (=> ws_ini)
 int    ws_connect    (ws_t*, char* host, char* port, char* uripath);
 
-int    ws_getRtt     (ws_t*, u2_t* q_80_90_95); // round trip quantiles 80/90/95% in millis
+int    ws_getRtt     (ws_t*, u2_t* q_80_90_95); // round trip quantiles 80/90/95% in millis - returns #samples
+void   ws_addRtt     (ws_t*, ustime_t rtt);     // feed round trip measured by upper layers
 
 #endif // _ws_h_
@@ -41,6 +41,10 @@
 // associated txdata section is removed and txdata is compacted immediately.
 // The remainder of txdata is always the available free data space.
 //
+// With CFG_txslots each txjob owns a fixed slot of TXSLOT_SIZE bytes in txdata.
+// Reserving, committing and freeing data is then O(1) without moving any data
+// at the cost of txdata being sized for MAX_TXJOBS max sized frames.
+//
 
 
 void txq_ini (txq_t* txq) {
@@ -130,6 +134,38 @@ txjob_t* txq_reserveJob (txq_t* txq) {
 }
 
 
+#if defined(CFG_txslots)
+
+u1_t* txq_reserveData (txq_t* txq, txoff_t maxlen) {
+    txidx_t idx = txq->freeJobs;
+    if( maxlen > TXSLOT_SIZE || idx == TXIDX_END )
+        return NULL;  // no enough data space
+    return &txq->txdata[idx*TXSLOT_SIZE];
+}
+
+
+void txq_commitJob (txq_t* txq, txjob_t*j) {
+    assert(j == &txq->txjobs[txq->freeJobs]);
+    assert(j->len <= TXSLOT_SIZE);
+    assert(j->off == TXOFF_NIL);
+    // Unqueue free head
+    txq->freeJobs = j->next;
+    j->next = TXIDX_NIL;
+    j->off = (j - txq->txjobs) * TXSLOT_SIZE;
+    txq->txdataInUse += j->len;
+}
+
+
+void txq_freeData (txq_t* txq, txjob_t* j) {
+    if( j->off == TXOFF_NIL )
+        return;
+    txq->txdataInUse -= j->len;
+    j->off = TXOFF_NIL;
+    j->len = 0;
+}
+
+#else // !defined(CFG_txslots)
+
 u1_t* txq_reserveData (txq_t* txq, txoff_t maxlen) {
     if( maxlen > MAX_TXDATA - txq->txdataInUse )
         return NULL;  // no enough data space
@@ -149,8 +185,6 @@ void txq_commitJob (txq_t* txq, txjob_t*j) {
 }
 
 
-
-
 void txq_freeData (txq_t* txq, txjob_t* j) {
     
     // If job had data compactify and fix offset of jobs in any tx queues
@@ -171,6 +205,8 @@ void txq_freeData (txq_t* txq, txjob_t* j) {
     j->len = 0;
 }
 
+#endif // !defined(CFG_txslots)
+
 
 // --------------------------------------------------------------------------------
 //
@@ -192,10 +228,68 @@ void txq_freeData (txq_t* txq, txjob_t* j) {
 //       |      |                      |      |  compaction
 //  |----|xxxxxx|----|         |-------|xxxxxx|    ==>  |xxxxxx|-------|
 //
+// Queued jobs are indexed by a hash over (dr,len,payload) in a small set associative
+// table (mirrorIdx) which makes the lookup of mirror frames constant time.
+// Entries store job indices and are fixed up whenever jobs move.
+// Entries referring to jobs no longer queued are simply ignored - any candidate is
+// verified against the actual job before being reported as a mirror.
 //
 
+static void mirror_clear (rxq_t* rxq) {
+    memset(rxq->mirrorIdx, RXIDX_NIL, sizeof(rxq->mirrorIdx));
+}
+
+// All jobs moved down by delta - entries below delta are gone
+static void mirror_shift (rxq_t* rxq, rxidx_t delta) {
+    rxidx_t* e = &rxq->mirrorIdx[0][0];
+    for( int i=0; i < MIRROR_BUCKETS*MIRROR_WAYS; i++ ) {
+        if( e[i] != RXIDX_NIL )
+            e[i] = e[i] < delta ? RXIDX_NIL : e[i] - delta;
+    }
+}
+
+// Job at idx removed and jobs above moved down by one
+static void mirror_remove (rxq_t* rxq, rxidx_t idx) {
+    rxidx_t* e = &rxq->mirrorIdx[0][0];
+    for( int i=0; i < MIRROR_BUCKETS*MIRROR_WAYS; i++ ) {
+        if( e[i] != RXIDX_NIL && e[i] >= idx )
+            e[i] = e[i] == idx ? RXIDX_NIL : e[i] - 1;
+    }
+}
+
+static u4_t mirror_hash (rxq_t* rxq, rxjob_t* p) {
+    return rt_crc32(((u4_t)p->dr<<8) | p->len, &rxq->rxdata[p->off], p->len);
+}
+
+static void mirror_add (rxq_t* rxq, rxidx_t idx) {
+    rxidx_t* ways = rxq->mirrorIdx[rxq->rxjobs[idx].mhash & (MIRROR_BUCKETS-1)];
+    int w = 0;
+    for( int i=0; i < MIRROR_WAYS; i++ ) {
+        if( ways[i] == RXIDX_NIL || ways[i] < rxq->first || ways[i] >= idx ) {
+            w = i;   // free or stale entry
+            break;
+        }
+        if( ways[i] < ways[w] )
+            w = i;   // evict oldest job
+    }
+    ways[w] = idx;
+}
+
+
 void rxq_ini (rxq_t* rxq) {
     rxq->first = rxq->next = 0;
+    mirror_clear(rxq);
+}
+
+// Number of max size frames which can be added for sure - limited by free
+// job slots and data space (assuming compaction by rxq_nextJob).
+int rxq_room (rxq_t* rxq) {
+    rxidx_t first = rxq->first;
+    rxidx_t next = rxq->next;
+    int used = 0;
+    if( first < next )
+        used = rxq->rxjobs[next-1].off + rxq->rxjobs[next-1].len - rxq->rxjobs[first].off;
+    return min(MAX_RXJOBS - (next-first), (MAX_RXDATA - used) / MAX_RXFRAME_LEN);
 }
 
 // Allocate next job and optionally compact if we need space.
@@ -208,9 +302,12 @@ rxjob_t* rxq_nextJob (rxq_t* rxq) {
     rxidx_t first = rxq->first;
     rxidx_t next = rxq->next;
     if( first==next ) {
+        if( next != 0 )
+            mirror_clear(rxq);
         rxq->first = rxq->next = 0;
         jobs[0].off = jobs[0].len = 0;
         jobs[0].fts = -1;
+        jobs[0].mhash = 0;
         return &jobs[0];
     }
     if( next >= MAX_RXJOBS ) {
@@ -220,6 +317,7 @@ rxjob_t* rxq_nextJob (rxq_t* rxq) {
             return NULL;
         }
         memmove(&jobs[0], &jobs[first], sizeof(jobs[0])*(next-first));
+        mirror_shift(rxq, first);
         rxq->next = next -= first;
         rxq->first = first = 0;
     }
@@ -244,14 +342,39 @@ rxjob_t* rxq_nextJob (rxq_t* rxq) {
     last->off = end;
     last->len = 0;
     last->fts = -1;
+    last->mhash = 0;
     return last;
 }
 
 void rxq_commitJob (rxq_t* rxq, rxjob_t* p) {
     assert(p == &rxq->rxjobs[rxq->next]);
+    if( p->mhash == 0 )
+        p->mhash = mirror_hash(rxq, p);
+    mirror_add(rxq, rxq->next);
     rxq->next += 1;
 }
 
+// Find a queued job with the same DR and payload as the not yet committed job p.
+// Only jobs with rxtime >= since are considered.
+rxjob_t* rxq_findMirror (rxq_t* rxq, rxjob_t* p, ustime_t since) {
+    assert(p == &rxq->rxjobs[rxq->next]);
+    p->mhash = mirror_hash(rxq, p);
+    rxidx_t* ways = rxq->mirrorIdx[p->mhash & (MIRROR_BUCKETS-1)];
+    for( int i=0; i < MIRROR_WAYS; i++ ) {
+        rxidx_t idx = ways[i];
+        if( idx == RXIDX_NIL || idx < rxq->first || idx >= rxq->next )
+            continue;
+        rxjob_t* q = &rxq->rxjobs[idx];
+        if( q->mhash == p->mhash &&
+            q->dr == p->dr &&
+            q->len == p->len &&
+            q->rxtime >= since &&
+            memcmp(&rxq->rxdata[q->off], &rxq->rxdata[p->off], p->len) == 0 )
+            return q;
+    }
+    return NULL;
+}
+
 // Drop job j from list and return new pointer to last job
 // Used to delete shadow frames.
 rxjob_t* rxq_dropJob (rxq_t* rxq, rxjob_t* p) {
@@ -261,6 +384,7 @@ rxjob_t* rxq_dropJob (rxq_t* rxq, rxjob_t* p) {
     rxoff_t poff = p->off;
     rxoff_t pend = poff + p->len;
     assert(p >= jobs && p < last);
+    mirror_remove(rxq, p - jobs);
     memmove(&rxdata[poff], &rxdata[pend], last->off + last->len - pend);
     memmove(&p[0], &p[1], sizeof(jobs[0])*(last-p+1));
     poff = pend-poff;
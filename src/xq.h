@@ -67,11 +67,19 @@ typedef struct txjob {
     u2_t     preamble; // preamble length - if zero use default
 } txjob_t;
 
+#if defined(CFG_txslots)
+// Each txjob owns a fixed slot in txdata - no compaction needed
+enum { TXSLOT_SIZE = MAX_TXFRAME_LEN+1 };
+enum { TXDATA_SIZE = MAX_TXJOBS*TXSLOT_SIZE };
+#else // !defined(CFG_txslots)
+enum { TXDATA_SIZE = MAX_TXDATA };
+#endif // !defined(CFG_txslots)
+
 typedef struct txq {
     txjob_t txjobs[MAX_TXJOBS];  // pool of txjobs
-    u1_t    txdata[MAX_TXDATA];  // pool for pending txdata
+    u1_t    txdata[TXDATA_SIZE]; // pool for pending txdata
     txidx_t freeJobs;            // linked list of free txjob elements
-    txoff_t txdataInUse;         // free buffer space from here to end of txdata
+    txoff_t txdataInUse;         // free buffer space from here to end of txdata (txslots: bytes in use)
 } txq_t;
 
 
@@ -92,11 +100,17 @@ void     txq_commitJob   (txq_t* txq, txjob_t*j);
 typedef u2_t rxoff_t;
 typedef u1_t rxidx_t;
 
+enum { RXIDX_NIL = 255 };
+enum { MIRROR_BUCKETS = 64 };   // must be a power of 2
+enum { MIRROR_WAYS    =  4 };
+
 typedef struct rxjob {
     sL_t     rctx;
     sL_t     xtime;
+    ustime_t rxtime; // local time frame was added to rxq
     s4_t     fts;
     u4_t     freq;
+    u4_t     mhash;  // hash over (dr,len,payload) - see rxq_findMirror
     rxoff_t  off;    // frame start in rxdata
     u1_t     rssi;   // scaled RSSI (*-1)
     s1_t     snr;    // scaled SNR (*4)
@@ -109,13 +123,16 @@ typedef struct rxq {
     u1_t    rxdata[MAX_RXDATA];
     rxidx_t first;   // first filled job
     rxidx_t next;    // next job to fill
+    rxidx_t mirrorIdx[MIRROR_BUCKETS][MIRROR_WAYS];  // hash index of queued jobs
 } rxq_t;
 
 
-void     rxq_ini       (rxq_t* rxq);
-rxjob_t* rxq_nextJob   (rxq_t* rxq);
-void     rxq_commitJob (rxq_t* rxq, rxjob_t* p);
-rxjob_t* rxq_dropJob   (rxq_t* rxq, rxjob_t* p);
+void     rxq_ini        (rxq_t* rxq);
+rxjob_t* rxq_nextJob    (rxq_t* rxq);
+void     rxq_commitJob  (rxq_t* rxq, rxjob_t* p);
+rxjob_t* rxq_dropJob    (rxq_t* rxq, rxjob_t* p);
+rxjob_t* rxq_findMirror (rxq_t* rxq, rxjob_t* p, ustime_t since);
+int      rxq_room       (rxq_t* rxq);  // frames that can be added for sure (jobs/data space)
 
 
 #endif // _xq_h_